@@ -8,46 +8,189 @@
 #ifndef __ALTITUDE_H
 #define __ALTITUDE_H
 
-#include <cmath>
+#include <cstddef>
+#include <cstdint>
 
 #include <drivers/sensor.h>
 #include <zephyr.h>
 
-#include "synced_var.hpp"
+#include "linalg.h"
+#include "linalg_kernels.h"
+
+#include "seqlock_var.hpp"
 
 namespace z_quad_rotor {
 
-/// Stores altitude; updates based on raw pressure inputs
+/// Barometric formula (international standard atmosphere), tabulated at compile time
+namespace baro {
+
+constexpr double SEA_LEVEL_KPA = 101.325;
+constexpr double EXPONENT = 0.1902949;
+constexpr double SCALE_M = 44330.0;
+
+/// Flight envelope: ~5.5 km above to ~700 m below sea level (standard atmosphere); outside it the
+/// end segments are extrapolated (tens of meters off at 5 kPa out)
+constexpr double MIN_KPA = 50.0;
+constexpr double MAX_KPA = 110.0;
+constexpr size_t TABLE_SIZE = 385; // 384 segments of 0.16 kPa (13 - 23 m)
+constexpr double STEP_KPA = (MAX_KPA - MIN_KPA) / (TABLE_SIZE - 1);
+/// Max error within the envelope, & the share of it reserved for float rounding at run time
+constexpr double TOLERANCE_M = 0.01;
+constexpr double ROUNDING_M = 0.001;
+
+/// ln(x) for x > 0 as 2 atanh((x - 1) / (x + 1)); compile time only (converges slowly away from 1)
+constexpr double const_log(double x)
+{
+    double s = (x - 1.0) / (x + 1.0);
+    double s2 = s * s;
+    double power = s;
+    double sum = 0.0;
+    for (int k = 1; k < 200; k += 2) {
+        sum += power / k;
+        power *= s2;
+    }
+    return 2.0 * sum;
+}
+
+/// e^x by Taylor series; compile time only (for small |x|)
+constexpr double const_exp(double x)
+{
+    double term = 1.0;
+    double sum = 1.0;
+    for (int k = 1; k < 40; k++) {
+        term *= x / k;
+        sum += term;
+    }
+    return sum;
+}
+
+/// Altitude in meters at a pressure in kPa
+constexpr double altitude_m(double kpa)
+{
+    return SCALE_M * (1.0 - const_exp(EXPONENT * const_log(kpa / SEA_LEVEL_KPA)));
+}
+
+/// Linear interpolation error is at most max|h''| step^2 / 8; h'' = h' (EXPONENT - 1) / p with
+/// h' = -SCALE_M EXPONENT / p0 (p / p0)^(EXPONENT - 1), both largest at the lowest pressure
+constexpr double interpolation_error_m()
+{
+    double slope = SCALE_M * EXPONENT / SEA_LEVEL_KPA *
+                   const_exp((EXPONENT - 1.0) * const_log(MIN_KPA / SEA_LEVEL_KPA));
+    double curvature = slope * (1.0 - EXPONENT) / MIN_KPA;
+    return curvature * STEP_KPA * STEP_KPA / 8.0;
+}
+static_assert(interpolation_error_m() + ROUNDING_M <= TOLERANCE_M,
+              "Altitude table too coarse for tolerance");
+
+struct AltitudeTable {
+    float meters[TABLE_SIZE];
+};
+
+constexpr AltitudeTable make_altitude_table()
+{
+    AltitudeTable table = {};
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        table.meters[i] = (float)altitude_m(MIN_KPA + i * STEP_KPA);
+    }
+    return table;
+}
+
+constexpr AltitudeTable ALTITUDE_TABLE = make_altitude_table();
+
+/// Altitude in meters at a pressure in kPa; a table lookup & linear interpolation
+static inline float pressure_to_altitude(float kpa)
+{
+    float position = (kpa - (float)MIN_KPA) * (float)(1.0 / STEP_KPA);
+    // clamp to the end segments (the fraction then extrapolates)
+    int32_t index = (int32_t)position;
+    if (position < 0.0f) index = 0;
+    if (index > (int32_t)TABLE_SIZE - 2) index = TABLE_SIZE - 2;
+    float fraction = position - index;
+    float low = ALTITUDE_TABLE.meters[index];
+    return low + fraction * (ALTITUDE_TABLE.meters[index + 1] - low);
+}
+
+} // namespace baro
+
+/// Vertical state estimator -- a Kalman filter over altitude, vertical velocity, and vertical
+/// accel bias. Each fusion step's earth frame vertical accel drives the prediction, barometric
+/// altitude corrects it.
+/// @note predict & update must be called from a single thread; getters never block
 class Altitude {
   public:
-    Altitude() : m_altitude(0.0f) {}
-    /// Updates altitude based on new raw pressure
+    Altitude() : m_state(State(0.0f)), m_cov(), m_init(true) {}
+    /// Propagates the state over one fusion step (ignored until the first pressure update)
+    /// @param accel_up Vertical specific force in the earth frame (m/s^2, +g at rest), as passed
+    /// on by Orientation::drain
+    /// @param time_diff_us Time since the previous step (microseconds)
+    void predict(float accel_up, uint32_t time_diff_us)
+    {
+        if (m_init) return;
+
+        const float dt = time_diff_us * 0.000001f;
+        const float half_dt2 = 0.5f * dt * dt;
+        // update is the other writer, on the same thread, so the working copy cannot go stale
+        State state = m_state.get_var();
+        const float accel = accel_up - STANDARD_GRAVITY - state.z;
+        state.x += (state.y * dt) + (accel * half_dt2);
+        state.y += accel * dt;
+        m_state.set_var(state);
+
+        // P = F P F^T + Q for F = [[1, dt, -dt^2 / 2], [0, 1, -dt], [0, 0, 1]] (column-major here);
+        // accel noise enters through the same gain as accel, the bias walks
+        const Matrix transition = {{1.0f, 0.0f, 0.0f}, {dt, 1.0f, 0.0f}, {-half_dt2, -dt, 1.0f}};
+        const State noise_gain(half_dt2 * ACCEL_NOISE, dt * ACCEL_NOISE, 0.0f);
+        m_cov = linalg::kernels::sym_sandwich(transition, m_cov) +
+                linalg::outerprod(noise_gain, noise_gain);
+        m_cov[2][2] += (BIAS_WALK * BIAS_WALK) * dt;
+    }
+    /// Corrects the state with a new pressure sample (the first one initializes it)
     void update(struct sensor_value pressure)
     {
-        float new_alt =
-            44330.0f * (1.0f - powf(sensor_value_to_double(&pressure) / 101.325f, 0.1902949f));
-        WriteLock<float> write_access = m_altitude.get_write_lock();
-        // if this is the first update, initialize altitude member
+        // float conversion -- sensor_value_to_double is soft float
+        const float measured =
+            baro::pressure_to_altitude(pressure.val1 + pressure.val2 * 0.000001f);
         if (m_init) {
-            write_access.set_var(new_alt);
+            m_state.set_var(State(measured, 0.0f, 0.0f));
+            m_cov = Matrix();
+            m_cov[0][0] = BARO_NOISE * BARO_NOISE;
+            m_cov[1][1] = INIT_VELOCITY_STD * INIT_VELOCITY_STD;
+            m_cov[2][2] = INIT_BIAS_STD * INIT_BIAS_STD;
             m_init = false;
+            return;
         }
-        else {
-            write_access.set_var((new_alt * SMOOTHING_RATIO) +
-                                 ((1 - SMOOTHING_RATIO) * write_access.get_var()));
-        }
+
+        // H = [1, 0, 0], so P H^T is the first column of P
+        State state = m_state.get_var();
+        const State cov_h = m_cov[0];
+        const float inv_s = 1.0f / (cov_h.x + (BARO_NOISE * BARO_NOISE));
+        state += cov_h * ((measured - state.x) * inv_s);
+        m_cov -= linalg::outerprod(cov_h, cov_h * inv_s);
+        m_state.set_var(state);
     }
     /// Returns the current altitude in meters
-    /// @note Will block until alt mutex is available (locked by update)
-    float get_altitude() { return m_altitude.get_read_lock().get_var(); }
+    /// @note Never blocks
+    float get_altitude() const { return m_state.get_var().x; }
+    /// Returns the current vertical velocity (climb rate) in m/s
+    /// @note Never blocks
+    float get_velocity() const { return m_state.get_var().y; }
 
   private:
-    bool m_init = true;
-    SyncedVar<float> m_altitude;
+    using State = linalg::vec<float, 3>; // altitude (m), velocity (m/s), accel bias (m/s^2)
+    using Matrix = linalg::mat<float, 3, 3>;
+
+    SeqLockVar<State> m_state;
+    Matrix m_cov; // only touched by the writer
+    bool m_init;
 
-    constexpr static float SMOOTHING_RATIO = 0.03f;
+    constexpr static float STANDARD_GRAVITY = 9.80665f;
+    constexpr static float BARO_NOISE = 0.3f;        // m, incl. prop wash & drafts
+    constexpr static float ACCEL_NOISE = 0.5f;       // m/s^2, incl. frame vibration
+    constexpr static float BIAS_WALK = 0.02f;        // m/s^2 per sqrt(s)
+    constexpr static float INIT_VELOCITY_STD = 0.5f; // m/s
+    constexpr static float INIT_BIAS_STD = 0.3f;     // m/s^2
 };
 
 } // namespace z_quad_rotor
 
-#endif // __ALTITUDE_H
\ No newline at end of file
+#endif // __ALTITUDE_H
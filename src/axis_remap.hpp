@@ -0,0 +1,112 @@
+/**
+ * @file		axis_remap.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only sensor axis remap policies
+ *
+ * Remaps raw MARG counts from the sensor frame to the body (right-hand) frame while converting to
+ * units. AxisRemap covers sign/permutation mounts at compile time (folds to swizzles & negations);
+ * MatrixRemap is the general fallback for arbitrary mounts.
+ *
+ *
+ */
+
+#ifndef __AXIS_REMAP_H
+#define __AXIS_REMAP_H
+
+#include <cstdint>
+
+#include "linalg.h"
+
+#include "marg_sensor.hpp"
+#include "orientation_defs.hpp"
+
+namespace z_quad_rotor {
+
+/// Signed sensor axis, used to select the source of each body axis
+enum class Axis : int8_t {
+    X = 1,
+    Y = 2,
+    Z = 3,
+    NEG_X = -1,
+    NEG_Y = -2,
+    NEG_Z = -3,
+};
+
+/// Compile-time remap: body axis i is taken from the selected (signed) sensor axis
+/// (e.g. AxisRemap<Axis::NEG_X, Axis::Z, Axis::Y>)
+template <Axis BX, Axis BY, Axis BZ>
+struct AxisRemap {
+    /// Converts raw counts to units and remaps; one multiply per axis
+    template <class S, class Scale>
+    static MargDataT<S> apply(const MargData &in, const MargScaleT<Scale> &scale)
+    {
+        return MargDataT<S>(remap<S>(in.accel[0], in.accel[1], in.accel[2], scale.accel),
+                            remap<S>(in.gyro[0], in.gyro[1], in.gyro[2], scale.gyro),
+                            remap<S>(in.magn[0], in.magn[1], in.magn[2], scale.magn));
+    }
+    /// Float conversion (scalar type deduced from the scale)
+    static MargDataFloat apply(const MargData &in, const MargScale &scale)
+    {
+        return apply<float>(in, scale);
+    }
+
+  private:
+    template <class S, class Scale>
+    static linalg::vec<S, 3> remap(int16_t x, int16_t y, int16_t z, Scale scale)
+    {
+        return {ScalarTraits<S>::from_counts(select<BX>(x, y, z), scale),
+                ScalarTraits<S>::from_counts(select<BY>(x, y, z), scale),
+                ScalarTraits<S>::from_counts(select<BZ>(x, y, z), scale)};
+    }
+    template <Axis A>
+    static int32_t select(int16_t x, int16_t y, int16_t z)
+    {
+        constexpr int idx = static_cast<int>(A) > 0 ? static_cast<int>(A) : -static_cast<int>(A);
+        static_assert(idx >= 1 && idx <= 3, "Invalid axis");
+        int32_t val = (idx == 1) ? x : ((idx == 2) ? y : z);
+        return (static_cast<int>(A) > 0) ? val : -val;
+    }
+};
+
+/// Identity remap (sensor frame is the body frame)
+using IdentityRemap = AxisRemap<Axis::X, Axis::Y, Axis::Z>;
+
+/// Runtime remap by an arbitrary rotation matrix (e.g. [-1, 0, 0, 0, 0, 1, 0, 1, 0])
+struct MatrixRemap {
+    MatrixRemap(const RotationMatrix &remap_matrix) : matrix(remap_matrix) {}
+    /// Converts raw counts to units and remaps; three 3x3 products
+    /// @note For fixed point scalars the matrix elements are converted on every call
+    template <class S, class Scale>
+    MargDataT<S> apply(const MargData &in, const MargScaleT<Scale> &scale) const
+    {
+        MargDataT<S> remapped(in, scale);
+        remapped.accel = rotate(remapped.accel);
+        remapped.gyro = rotate(remapped.gyro);
+        remapped.magn = rotate(remapped.magn);
+
+        return remapped;
+    }
+    MargDataFloat apply(const MargData &in, const MargScale &scale) const
+    {
+        return apply<float>(in, scale);
+    }
+
+    RotationMatrix matrix;
+
+  private:
+    /// matrix * vec, element-wise so that it also covers non-arithmetic (fixed point) scalars
+    template <class S>
+    linalg::vec<S, 3> rotate(const linalg::vec<S, 3> &vec) const
+    {
+        linalg::vec<S, 3> rotated;
+        for (int row = 0; row < 3; row++) {
+            rotated[row] = S(matrix[0][row]) * vec.x + S(matrix[1][row]) * vec.y +
+                           S(matrix[2][row]) * vec.z;
+        }
+        return rotated;
+    }
+};
+
+} // namespace z_quad_rotor
+
+#endif // __AXIS_REMAP_H
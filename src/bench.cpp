@@ -0,0 +1,999 @@
+/**
+ * @file	bench.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the bench module
+ *
+ */
+
+#include "bench.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include <drivers/sensor.h>
+#include <shell/shell.h>
+#include <zephyr.h>
+
+#include "linalg.h"
+#include "linalg_kernels.h"
+
+#include "altitude.hpp"
+#include "axis_remap.hpp"
+#include "controller.hpp"
+#include "cycle_counter.hpp"
+#include "fastmath.hpp"
+#include "fusion.hpp"
+#include "marg_sensor.hpp"
+#include "mixer.hpp"
+#include "orientation.hpp"
+#include "orientation_defs.hpp"
+#include "seqlock_var.hpp"
+#include "synced_var.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr size_t BENCH_STACK_SIZE = 1024;
+static constexpr int READER_PRIO = 5; // reader preempts writer, as the fusion loop does
+static constexpr int WRITER_PRIO = 6;
+static constexpr uint32_t CONTENTION_READS = 2000;
+static constexpr int32_t CONTENTION_READ_PERIOD_US = 337; // not a multiple of the write period
+static constexpr uint32_t CONTENTION_WORK_US = 40;        // ~ i2c fetch of one sample
+static constexpr uint32_t CONVERT_ITERATIONS = 1000;
+static constexpr uint32_t FUSION_ITERATIONS = 2000;
+static constexpr size_t FUSION_INPUT_COUNT = 128; // power of 2
+static constexpr uint32_t FUSION_TIME_DIFF_US = 5000;
+static constexpr uint32_t ESKF_LOOP_RATE_HZ = 1000;
+static constexpr uint32_t ESKF_TIME_DIFF_US = 1000000 / ESKF_LOOP_RATE_HZ;
+static constexpr double MADGWICK_BETA = 0.041; // as in fusion.cpp
+static constexpr uint32_t MADGWICK9_MAX_ULP = 4; // restructure may only reorder roundings
+static constexpr uint32_t FASTMATH_ITERATIONS = 1000;
+static constexpr size_t FASTMATH_INPUT_COUNT = 64; // power of 2
+static constexpr uint32_t FASTMATH_SWEEP_POINTS = 16384;
+static constexpr float BARO_EXPONENT = (float)baro::EXPONENT;
+static constexpr uint32_t ALTITUDE_SWEEP_POINTS = 65536;
+static constexpr uint32_t THRUST_SWEEP_POINTS = 65536;
+static constexpr uint32_t CONTROLLER_LOOP_RATE_HZ = 1000;
+static constexpr uint32_t CONTROLLER_TIME_DIFF_US = 1000000 / CONTROLLER_LOOP_RATE_HZ;
+static constexpr uint32_t CONTROLLER_BUDGET_PCT = 10; // fusion & control stage, of the period
+static constexpr uint32_t ORIENTATION_BATCHES = 100;
+static constexpr size_t ORIENTATION_BATCH_SIZE = MargSensor::QUEUE_DEPTH;
+
+// types
+struct LatencyStats {
+    uint32_t min_ns = UINT32_MAX;
+    uint32_t max_ns = 0;
+    uint64_t total_ns = 0;
+    uint32_t count = 0;
+
+    void add(uint32_t start, uint32_t end)
+    {
+        uint32_t ns = (uint32_t)cycle_counter::to_ns((end - start));
+        min_ns = MIN(min_ns, ns);
+        max_ns = MAX(max_ns, ns);
+        total_ns += ns;
+        count++;
+    }
+    uint32_t avg_ns() const { return count ? (uint32_t)(total_ns / count) : 0; }
+};
+
+/// MARG data as delivered by sensor_channel_get, before the raw count pipeline
+struct SensorValueMargData {
+    struct sensor_value accel[3];
+    struct sensor_value gyro[3];
+    struct sensor_value magn[3];
+};
+
+// private variables
+static k_thread s_reader_thread;
+static k_thread s_writer_thread;
+K_THREAD_STACK_DEFINE(s_reader_stack, BENCH_STACK_SIZE);
+K_THREAD_STACK_DEFINE(s_writer_stack, BENCH_STACK_SIZE);
+static volatile bool s_stop;
+
+static SyncedVar<AccelMagnData> s_synced_var;
+static SeqLockVar<AccelMagnData> s_seqlock_var;
+
+// non-const so that conversions can't be folded (loops re-read these through a compiler barrier)
+static SensorValueMargData s_sv_marg = {
+    {{0, 98000}, {-1, -500000}, {9, 806650}},
+    {{0, 10910}, {0, -21820}, {1, 0}},
+    {{0, 230000}, {0, -40000}, {0, -510000}},
+};
+// counts & scales at the board's ranges (CONFIG_FXOS8700_RANGE_2G, CONFIG_FXAS21002_RANGE=3)
+static MargData s_raw_marg = {{40, -614, 4096}, {10, -20, 917}, {230, -40, -510}};
+static MargScale s_raw_scale = {9.80665f / 4096.0f, 1091e-6f / 8, 0.001f};
+
+static MargData s_fusion_input[FUSION_INPUT_COUNT];
+
+// the pipeline under test for bench orientation (separate from main's)
+static MargSensor s_bench_marg_sensor;
+static Orientation<MadgwickFusion6, IdentityRemap, false> s_bench_orientation;
+
+// non-const (as above); fill_fastmath_input() spreads these over each function's domain
+static float s_fastmath_x[FASTMATH_INPUT_COUNT];
+static float s_fastmath_y[FASTMATH_INPUT_COUNT];
+
+// private function definitions
+static void synced_writer_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (!s_stop) {
+        // mirrors the old trigger handlers: sample work happens while holding the lock
+        WriteLock<AccelMagnData> write_lock = s_synced_var.get_write_lock();
+        k_busy_wait(CONTENTION_WORK_US);
+        write_lock.get_ref().accel[0]++;
+    }
+}
+
+static void seqlock_writer_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    AccelMagnData data = {};
+    while (!s_stop) {
+        k_busy_wait(CONTENTION_WORK_US);
+        data.accel[0]++;
+        s_seqlock_var.set_var(data);
+    }
+}
+
+static void synced_reader_func(void *p1, void *p2, void *p3)
+{
+    LatencyStats *stats = static_cast<LatencyStats *>(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (uint32_t i = 0; i < CONTENTION_READS; i++) {
+        k_usleep(CONTENTION_READ_PERIOD_US);
+        uint32_t start = cycle_counter::now();
+        volatile AccelMagnData data = s_synced_var.get_read_lock().get_var();
+        uint32_t end = cycle_counter::now();
+        ARG_UNUSED(data);
+        stats->add(start, end);
+    }
+}
+
+static void seqlock_reader_func(void *p1, void *p2, void *p3)
+{
+    LatencyStats *stats = static_cast<LatencyStats *>(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (uint32_t i = 0; i < CONTENTION_READS; i++) {
+        k_usleep(CONTENTION_READ_PERIOD_US);
+        uint32_t start = cycle_counter::now();
+        volatile AccelMagnData data = s_seqlock_var.get_var();
+        uint32_t end = cycle_counter::now();
+        ARG_UNUSED(data);
+        stats->add(start, end);
+    }
+}
+
+/// runs reader & writer threads to completion of the reader, stores reader stats
+static void run_contention(k_thread_entry_t reader_func, k_thread_entry_t writer_func,
+                           LatencyStats *stats)
+{
+    s_stop = false;
+    k_thread_create(&s_writer_thread, s_writer_stack, K_THREAD_STACK_SIZEOF(s_writer_stack),
+                    writer_func, NULL, NULL, NULL, WRITER_PRIO, 0, K_NO_WAIT);
+    k_thread_create(&s_reader_thread, s_reader_stack, K_THREAD_STACK_SIZEOF(s_reader_stack),
+                    reader_func, stats, NULL, NULL, READER_PRIO, 0, K_NO_WAIT);
+    k_thread_join(&s_reader_thread, K_FOREVER);
+    s_stop = true;
+    k_thread_join(&s_writer_thread, K_FOREVER);
+}
+
+static void print_stats(const struct shell *shell, const char *name, const LatencyStats &stats)
+{
+    shell_print(shell, "%-12s reads: %u min: %u ns avg: %u ns max: %u ns", name, stats.count,
+                stats.min_ns, stats.avg_ns(), stats.max_ns);
+}
+
+static linalg::vec<float, 3> sensor_value_to_vec(const struct sensor_value *val)
+{
+    return {(float)sensor_value_to_double(&val[0]), (float)sensor_value_to_double(&val[1]),
+            (float)sensor_value_to_double(&val[2])};
+}
+
+/// deterministic sensor input: sawtooth rates, ~1 g with jitter, fixed magnetic field
+static void fill_fusion_input()
+{
+    for (int i = 0; i < (int)FUSION_INPUT_COUNT; i++) {
+        MargData &in = s_fusion_input[i];
+        in.accel[0] = (int16_t)(40 + (i % 7) - 3);
+        in.accel[1] = (int16_t)(-614 + (i % 5) - 2);
+        in.accel[2] = 4096;
+        in.gyro[0] = (int16_t)((i % 100) * 40 - 2000);
+        in.gyro[1] = (int16_t)(300 - (i % 13) * 50);
+        in.gyro[2] = 800;
+        in.magn[0] = 230;
+        in.magn[1] = -40;
+        in.magn[2] = -510;
+    }
+}
+
+/// runs FUSION_ITERATIONS updates (raw count conversion included) from identity, returns cycles
+/// per update; quat receives the final orientation
+template <class F>
+static uint32_t run_fusion(QuaternionT<double> &quat, uint32_t time_diff_us = FUSION_TIME_DIFF_US)
+{
+    using S = typename F::Scalar;
+
+    F fusion_impl;
+    const MargScaleT<typename ScalarTraits<S>::Scale> scale = scale_cast<S>(s_raw_scale);
+    QuaternionT<S> scalar_quat(S(0), S(0), S(0), S(1));
+
+    uint32_t start = cycle_counter::now();
+    for (uint32_t i = 0; i < FUSION_ITERATIONS; i++) {
+        MargDataT<S> marg_data =
+            IdentityRemap::apply<S>(s_fusion_input[i & (FUSION_INPUT_COUNT - 1)], scale);
+        fusion_impl.update(marg_data, scalar_quat, time_diff_us);
+    }
+    uint32_t end = cycle_counter::now();
+
+    quat = QuaternionT<double>(scalar_quat);
+    return (end - start) / FUSION_ITERATIONS;
+}
+
+/// angle between two orientations (micro degrees)
+static uint32_t angle_error_udeg(const QuaternionT<double> &a, const QuaternionT<double> &b)
+{
+    // normalized here, so that residual norm error (fastmath::inv_sqrt) isn't read as angle
+    double cos_half = std::fabs(linalg::dot(a, b)) / (linalg::length(a) * linalg::length(b));
+    return (uint32_t)(2.0 * std::acos(MIN(cos_half, 1.0)) * RAD_TO_DEG * 1000000.0);
+}
+
+/// prints cycles per update for each scalar type, error is vs the double run of the same filter
+template <template <class> class F>
+static void compare_filter(const struct shell *shell, const char *name)
+{
+    QuaternionT<double> reference;
+    QuaternionT<double> quat;
+    uint32_t double_cycles = run_fusion<F<double>>(reference);
+
+    uint32_t cycles = run_fusion<F<float>>(quat);
+    shell_print(shell, "%-9s float  %6u cycles/update, error %8u udeg", name, cycles,
+                angle_error_udeg(quat, reference));
+    cycles = run_fusion<F<Q24>>(quat);
+    shell_print(shell, "%-9s Q24    %6u cycles/update, error %8u udeg", name, cycles,
+                angle_error_udeg(quat, reference));
+    shell_print(shell, "%-9s double %6u cycles/update (reference)", name, double_cycles);
+}
+
+/// dense 6x6 p = f p f^T, as the block-sparse kernel would otherwise be written
+static void dense_propagate(float p[6][6], const float f[6][6])
+{
+    float fp[6][6];
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 6; j++) {
+            fp[i][j] = 0.0f;
+            for (int k = 0; k < 6; k++) {
+                fp[i][j] += f[i][k] * p[k][j];
+            }
+        }
+    }
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 6; j++) {
+            p[i][j] = 0.0f;
+            for (int k = 0; k < 6; k++) {
+                p[i][j] += fp[i][k] * f[j][k];
+            }
+        }
+    }
+}
+
+template <template <class> class F>
+static void print_eskf(const struct shell *shell, const char *name, uint32_t budget_cycles)
+{
+    QuaternionT<double> reference;
+    QuaternionT<double> quat;
+    run_fusion<F<double>>(reference, ESKF_TIME_DIFF_US);
+    uint32_t cycles = run_fusion<F<float>>(quat, ESKF_TIME_DIFF_US);
+    shell_print(shell, "%-6s %6u cycles/update (%u.%u%% of budget), error %8u udeg vs double", name,
+                cycles, (cycles * 100) / budget_cycles, ((cycles * 1000) / budget_cycles) % 10,
+                angle_error_udeg(quat, reference));
+}
+
+template <int M>
+static bool try_normalize_reference(linalg::vec<float, M> &vec)
+{
+    float length2 = linalg::length2(vec);
+    if (0.0f == length2) return false;
+    vec *= fastmath::inv_sqrt_refined(length2);
+    return true;
+}
+
+/// MadgwickFusion9 (float) as it was before the residual/jacobian restructure -- golden reference
+static void madgwick9_reference(MargDataFloat marg_data, Quaternion &quat, uint32_t time_diff_us)
+{
+    // rate of change of quaternion from gyroscope
+    Quaternion q_dot(
+        quat.w * marg_data.gyro.x + quat.y * marg_data.gyro.z - quat.z * marg_data.gyro.y,
+        quat.w * marg_data.gyro.y - quat.x * marg_data.gyro.z + quat.z * marg_data.gyro.x,
+        quat.w * marg_data.gyro.z + quat.x * marg_data.gyro.y - quat.y * marg_data.gyro.x,
+        -quat.x * marg_data.gyro.x - quat.y * marg_data.gyro.y - quat.z * marg_data.gyro.z);
+    q_dot *= 0.5f;
+
+    // normalize accel and mag
+    if (!try_normalize_reference(marg_data.accel)) return; // skip iteration if nan occurs
+    if (!try_normalize_reference(marg_data.magn)) return;  // skip iteration if nan occurs
+
+    // pre-compute repeated operands
+    float qw_mx_2 = 2.0f * quat.w * marg_data.magn.x;
+    float qw_my_2 = 2.0f * quat.w * marg_data.magn.y;
+    float qw_mz_2 = 2.0f * quat.w * marg_data.magn.z;
+    float qx_mx_2 = 2.0f * quat.x * marg_data.magn.x;
+    float qw_2 = 2.0f * quat.w;
+    float qx_2 = 2.0f * quat.x;
+    float qy_2 = 2.0f * quat.y;
+    float qz_2 = 2.0f * quat.z;
+    float qw_qy_2 = 2.0f * quat.w * quat.y;
+    float qy_qz_2 = 2.0f * quat.y * quat.z;
+    float qw_qw = quat.w * quat.w;
+    float qw_qx = quat.w * quat.x;
+    float qw_qy = quat.w * quat.y;
+    float qw_qz = quat.w * quat.z;
+    float qx_qx = quat.x * quat.x;
+    float qx_qy = quat.x * quat.y;
+    float qx_qz = quat.x * quat.z;
+    float qy_qy = quat.y * quat.y;
+    float qy_qz = quat.y * quat.z;
+    float qz_qz = quat.z * quat.z;
+
+    // reference direction of Earth's magnetic field
+    float hx = marg_data.magn.x * qw_qw - qw_my_2 * quat.z + qw_mz_2 * quat.y +
+               marg_data.magn.x * qx_qx + qx_2 * marg_data.magn.y * quat.y +
+               qx_2 * marg_data.magn.z * quat.z - marg_data.magn.x * qy_qy -
+               marg_data.magn.x * qz_qz;
+    float hy = qw_mx_2 * quat.z + marg_data.magn.y * qw_qw - qw_mz_2 * quat.x + qx_mx_2 * quat.y -
+               marg_data.magn.y * qx_qx + marg_data.magn.y * qy_qy +
+               qy_2 * marg_data.magn.z * quat.z - marg_data.magn.y * qz_qz;
+    float bx_2 = sqrtf(hx * hx + hy * hy);
+    float bz_2 = -qw_mx_2 * quat.y + qw_my_2 * quat.x + marg_data.magn.z * qw_qw +
+                 qx_mx_2 * quat.z - marg_data.magn.z * qx_qx + qy_2 * marg_data.magn.y * quat.z -
+                 marg_data.magn.z * qy_qy + marg_data.magn.z * qz_qz;
+    float bx_4 = 2.0f * bx_2;
+    float bz_4 = 2.0f * bz_2;
+
+    // gradient decent algorithm corrective step
+    float sw =
+        -qy_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
+        qx_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) -
+        bz_2 * quat.y *
+            (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
+        (-bx_2 * quat.z + bz_2 * quat.x) *
+            (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
+        bx_2 * quat.y * (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
+    float sx = qz_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
+               qw_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) -
+               4.0f * quat.x * (1 - 2.0f * qx_qx - 2.0f * qy_qy - marg_data.accel.z) +
+               bz_2 * quat.z *
+                   (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
+               (bx_2 * quat.y + bz_2 * quat.w) *
+                   (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
+               (bx_2 * quat.z - bz_4 * quat.x) *
+                   (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
+    float sy = -qw_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
+               qz_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) -
+               4.0f * quat.y * (1 - 2.0f * qx_qx - 2.0f * qy_qy - marg_data.accel.z) +
+               (-bx_4 * quat.y - bz_2 * quat.w) *
+                   (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
+               (bx_2 * quat.x + bz_2 * quat.z) *
+                   (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
+               (bx_2 * quat.w - bz_4 * quat.y) *
+                   (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
+    float sz =
+        qx_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
+        qy_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) +
+        (-bx_4 * quat.z + bz_2 * quat.x) *
+            (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
+        (-bx_2 * quat.w + bz_2 * quat.y) *
+            (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
+        bx_2 * quat.x * (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
+    // normalize
+    Quaternion step(sx, sy, sz, sw);
+    try_normalize_reference(step);
+
+    // apply feedback step
+    q_dot -= (float)MADGWICK_BETA * step;
+    // integrate rate of change of quaternion to yield quaternion
+    quat += q_dot * (time_diff_us * 0.000001f);
+    // normalize
+    try_normalize_reference(quat);
+}
+
+/// distance between two floats in units in the last place
+static uint32_t ulp_diff(float a, float b)
+{
+    int32_t ia;
+    int32_t ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    // map sign-magnitude to a monotonic integer line
+    ia = (ia < 0) ? (INT32_MIN - ia) : ia;
+    ib = (ib < 0) ? (INT32_MIN - ib) : ib;
+    int64_t diff = (int64_t)ia - ib;
+    return (uint32_t)(diff < 0 ? -diff : diff);
+}
+
+/// x in [0.3, 1.2] (barometric pressure ratios), y in [-1, 1] (asin inputs, atan2 operands)
+static void fill_fastmath_input()
+{
+    for (size_t i = 0; i < FASTMATH_INPUT_COUNT; i++) {
+        float t = (float)i / (FASTMATH_INPUT_COUNT - 1);
+        s_fastmath_x[i] = 0.3f + 0.9f * t;
+        s_fastmath_y[i] = sinf(7.0f * t);
+    }
+}
+
+/// sweep point i of n over [min, max]
+static float sweep_point(uint32_t i, uint32_t n, double min, double max)
+{
+    return (float)(min + ((max - min) * i) / (n - 1));
+}
+
+static void print_accuracy(const struct shell *shell, const char *name, double max_error,
+                           float bound)
+{
+    // printed in units of 1e-9, as float formatting may not be enabled in the shell printf
+    shell_print(shell, "%-9s %s: max error %8u e-9 (bound %8u e-9)", name,
+                (max_error <= bound) ? "PASS" : "FAIL", (uint32_t)(max_error * 1e9 + 0.5),
+                (uint32_t)(bound * 1e9 + 0.5));
+}
+
+/// cycles per call of func over the fastmath inputs
+template <class Func>
+static uint32_t fastmath_cycles(Func func)
+{
+    volatile float sink;
+    float acc = 0.0f;
+    uint32_t start = cycle_counter::now();
+    for (uint32_t i = 0; i < FASTMATH_ITERATIONS; i++) {
+        compiler_barrier();
+        size_t j = i & (FASTMATH_INPUT_COUNT - 1);
+        acc += func(s_fastmath_x[j], s_fastmath_y[j]);
+    }
+    uint32_t end = cycle_counter::now();
+    sink = acc;
+    ARG_UNUSED(sink);
+    return (end - start) / FASTMATH_ITERATIONS;
+}
+
+static void print_cycles(const struct shell *shell, const char *name, uint32_t fast_cycles,
+                         uint32_t libm_cycles)
+{
+    shell_print(shell, "%-9s %4u cycles/call (newlib %4u)", name, fast_cycles, libm_cycles);
+}
+
+/// runs FUSION_ITERATIONS controller updates (raw count conversion included) over the fusion
+/// input, each preceded by the Madgwick6 step that produces its attitude when with_fusion is set;
+/// returns cycles per update
+static uint32_t run_controller(uint32_t outer_divider, bool with_fusion)
+{
+    MadgwickFusion6T<float> fusion_impl;
+    AttitudeController controller(DEFAULT_ATTITUDE_GAINS, DEFAULT_RATE_GAINS, outer_divider);
+    controller.set_setpoint(Quaternion(0.0872f, 0.0f, 0.0f, 0.9962f)); // 10 degrees of roll
+    const MargScale scale = s_raw_scale;
+    // a fixed attitude off the setpoint when not fusing
+    Quaternion quat(0.0f, 0.0436f, 0.0f, 0.9990f);
+    linalg::vec<float, 3> output_sum(0.0f);
+
+    uint32_t start = cycle_counter::now();
+    for (uint32_t i = 0; i < FUSION_ITERATIONS; i++) {
+        compiler_barrier();
+        MargDataFloat marg_data =
+            IdentityRemap::apply<float>(s_fusion_input[i & (FUSION_INPUT_COUNT - 1)], scale);
+        if (with_fusion) fusion_impl.update(marg_data, quat, CONTROLLER_TIME_DIFF_US);
+        output_sum += controller.update(quat, marg_data.gyro, CONTROLLER_TIME_DIFF_US);
+    }
+    uint32_t end = cycle_counter::now();
+
+    // keep the outputs live
+    volatile float sink = output_sum.x + output_sum.y + output_sum.z;
+    ARG_UNUSED(sink);
+    return (end - start) / FUSION_ITERATIONS;
+}
+
+static void print_controller(const struct shell *shell, const char *name, uint32_t cycles,
+                             uint32_t period_cycles)
+{
+    shell_print(shell, "%-24s %6u cycles/update (%u.%u%% of period)", name, cycles,
+                (cycles * 100) / period_cycles, ((cycles * 1000) / period_cycles) % 10);
+}
+
+/// queues ORIENTATION_BATCH_SIZE gyro samples (& accel/magn every other one, as the drivers'
+/// rates) from the fusion input, FUSION_TIME_DIFF_US apart
+static void fill_orientation_batch(uint32_t &timestamp, uint32_t &index)
+{
+    for (size_t i = 0; i < ORIENTATION_BATCH_SIZE; i++, index++) {
+        const MargData &in = s_fusion_input[index & (FUSION_INPUT_COUNT - 1)];
+        timestamp += k_us_to_cyc_near32(FUSION_TIME_DIFF_US);
+        if (0 == (index % 2)) {
+            AccelMagnData &accel_magn = s_bench_marg_sensor.get_accel_magn_slot();
+            accel_magn.timestamp = timestamp;
+            memcpy(accel_magn.accel, in.accel, sizeof(accel_magn.accel));
+            memcpy(accel_magn.magn, in.magn, sizeof(accel_magn.magn));
+            s_bench_marg_sensor.publish_accel_magn();
+        }
+        GyroData &gyro = s_bench_marg_sensor.get_gyro_slot();
+        gyro.timestamp = timestamp;
+        memcpy(gyro.gyro, in.gyro, sizeof(gyro.gyro));
+        s_bench_marg_sensor.publish_gyro();
+    }
+}
+
+// public function definitions
+int bench::seqlock(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    cycle_counter::start();
+
+    LatencyStats synced_stats;
+    LatencyStats seqlock_stats;
+    shell_print(shell, "Reader latency with a writer doing %u us of work per sample...",
+                CONTENTION_WORK_US);
+    run_contention(synced_reader_func, synced_writer_func, &synced_stats);
+    run_contention(seqlock_reader_func, seqlock_writer_func, &seqlock_stats);
+
+    cycle_counter::stop();
+
+    print_stats(shell, "SyncedVar", synced_stats);
+    print_stats(shell, "SeqLockVar", seqlock_stats);
+    return 0;
+}
+
+int bench::convert(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    volatile float sink;
+
+    cycle_counter::start();
+
+    uint32_t start = cycle_counter::now();
+    for (uint32_t i = 0; i < CONVERT_ITERATIONS; i++) {
+        compiler_barrier();
+        linalg::vec<float, 3> accel = sensor_value_to_vec(s_sv_marg.accel);
+        linalg::vec<float, 3> gyro = sensor_value_to_vec(s_sv_marg.gyro);
+        linalg::vec<float, 3> magn = sensor_value_to_vec(s_sv_marg.magn);
+        sink = linalg::sum(accel + gyro + magn);
+    }
+    uint32_t end = cycle_counter::now();
+    uint32_t sv_cycles = (end - start) / CONVERT_ITERATIONS;
+
+    start = cycle_counter::now();
+    for (uint32_t i = 0; i < CONVERT_ITERATIONS; i++) {
+        compiler_barrier();
+        MargDataFloat converted(s_raw_marg, s_raw_scale);
+        sink = linalg::sum(converted.accel + converted.gyro + converted.magn);
+    }
+    end = cycle_counter::now();
+    uint32_t raw_cycles = (end - start) / CONVERT_ITERATIONS;
+
+    cycle_counter::stop();
+    ARG_UNUSED(sink);
+
+    shell_print(shell, "sensor_value path: %u cycles/sample, %u bytes/sample", sv_cycles,
+                (uint32_t)sizeof(SensorValueMargData));
+    shell_print(shell, "raw count path:    %u cycles/sample, %u bytes/sample", raw_cycles,
+                (uint32_t)sizeof(MargData));
+    shell_print(shell, "queued bytes/sample: accel/magn %u (was %u), gyro %u (was %u)",
+                (uint32_t)sizeof(AccelMagnData),
+                (uint32_t)(sizeof(uint32_t) + (6 * sizeof(struct sensor_value))),
+                (uint32_t)sizeof(GyroData),
+                (uint32_t)(sizeof(uint32_t) + (3 * sizeof(struct sensor_value))));
+    return 0;
+}
+
+int bench::fusion(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    fill_fusion_input();
+
+    cycle_counter::start();
+
+    shell_print(shell, "%u updates, %u us steps; error is the final angle vs the double run",
+                FUSION_ITERATIONS, FUSION_TIME_DIFF_US);
+    compare_filter<MadgwickFusion6T>(shell, "Madgwick6");
+    compare_filter<MahonyFusion6T>(shell, "Mahony6");
+    compare_filter<MadgwickFusion9T>(shell, "Madgwick9");
+    compare_filter<MahonyFusion9T>(shell, "Mahony9");
+
+    cycle_counter::stop();
+    return 0;
+}
+
+int bench::orientation(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    fill_fusion_input();
+    s_bench_marg_sensor.set_accel_magn_scale(s_raw_scale.accel, s_raw_scale.magn);
+    s_bench_marg_sensor.set_gyro_scale(s_raw_scale.gyro);
+
+    cycle_counter::start();
+
+    // only the drains are timed; queueing stands in for the drivers
+    uint32_t timestamp = k_cycle_get_32();
+    uint32_t index = 0;
+    uint64_t total_cycles = 0;
+    size_t steps = 0;
+    for (uint32_t i = 0; i < ORIENTATION_BATCHES; i++) {
+        fill_orientation_batch(timestamp, index);
+        uint32_t start = cycle_counter::now();
+        steps += s_bench_orientation.drain(s_bench_marg_sensor);
+        uint32_t end = cycle_counter::now();
+        total_cycles += end - start;
+    }
+
+    cycle_counter::stop();
+
+    const uint32_t cycles = (uint32_t)(total_cycles / steps);
+    const uint64_t step_ns = cycle_counter::to_ns(cycles);
+    shell_print(shell, "Madgwick6 drain, %u batches of %u samples", ORIENTATION_BATCHES,
+                (uint32_t)ORIENTATION_BATCH_SIZE);
+    shell_print(shell, "%6u cycles/step, %u steps/s", cycles,
+                step_ns ? (uint32_t)(1000000000ull / step_ns) : 0);
+    return 0;
+}
+
+int bench::eskf(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    fill_fusion_input();
+
+    cycle_counter::start();
+
+    const uint32_t budget_cycles = cycle_counter::get_freq_mhz() * (1000000 / ESKF_LOOP_RATE_HZ);
+    shell_print(shell, "%u updates at %u Hz, budget %u cycles/update", FUSION_ITERATIONS,
+                ESKF_LOOP_RATE_HZ, budget_cycles);
+    print_eskf<EskfFusion6T>(shell, "ESKF6", budget_cycles);
+    print_eskf<EskfFusion9T>(shell, "ESKF9", budget_cycles);
+
+    // covariance propagation alone, same transition both ways
+    const float dt = ESKF_TIME_DIFF_US * 0.000001f;
+    const linalg::vec<float, 3> gyro(0.3f, -0.2f, 0.5f);
+    const linalg::mat<float, 3, 3> rot_error =
+        linalg::mat<float, 3, 3>(linalg::identity) - linalg::kernels::skew(gyro) * dt;
+    linalg::kernels::sym6_blocks<float> blocks = {linalg::mat<float, 3, 3>(linalg::identity),
+                                                  linalg::mat<float, 3, 3>(),
+                                                  linalg::mat<float, 3, 3>(linalg::identity)};
+    float dense[6][6] = {};
+    float transition[6][6] = {};
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            transition[i][j] = rot_error[j][i];
+        }
+        transition[i][i + 3] = -dt;
+        transition[i + 3][i + 3] = 1.0f;
+        dense[i][i] = 1.0f;
+        dense[i + 3][i + 3] = 1.0f;
+    }
+
+    uint32_t start = cycle_counter::now();
+    for (uint32_t i = 0; i < FUSION_ITERATIONS; i++) {
+        compiler_barrier();
+        linalg::kernels::propagate_rotation_bias(blocks, rot_error, dt);
+    }
+    uint32_t end = cycle_counter::now();
+    uint32_t block_cycles = (end - start) / FUSION_ITERATIONS;
+
+    start = cycle_counter::now();
+    for (uint32_t i = 0; i < FUSION_ITERATIONS; i++) {
+        compiler_barrier();
+        dense_propagate(dense, transition);
+    }
+    end = cycle_counter::now();
+    uint32_t dense_cycles = (end - start) / FUSION_ITERATIONS;
+
+    cycle_counter::stop();
+
+    shell_print(shell, "covariance propagation: block-sparse %u cycles, dense 6x6 %u cycles",
+                block_cycles, dense_cycles);
+    // keep the propagated covariances live
+    volatile float sink = blocks.a[0][0] + dense[0][0];
+    ARG_UNUSED(sink);
+    return 0;
+}
+
+int bench::controller(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    fill_fusion_input();
+
+    cycle_counter::start();
+
+    const uint32_t period_cycles =
+        cycle_counter::get_freq_mhz() * (1000000 / CONTROLLER_LOOP_RATE_HZ);
+    const uint32_t budget_cycles = (period_cycles * CONTROLLER_BUDGET_PCT) / 100;
+    shell_print(shell, "%u updates at %u Hz, period %u cycles", FUSION_ITERATIONS,
+                CONTROLLER_LOOP_RATE_HZ, period_cycles);
+    // a divider past the iteration count runs the attitude loop once -- the rate loop alone
+    uint32_t rate_cycles = run_controller(UINT32_MAX, false);
+    uint32_t divided_cycles = run_controller(AttitudeController::DEFAULT_OUTER_DIVIDER, false);
+    uint32_t full_cycles = run_controller(1, false);
+    // worst case stage: a fusion step & both loops, every update
+    uint32_t stage_cycles = run_controller(1, true);
+
+    cycle_counter::stop();
+
+    print_controller(shell, "rate loop", rate_cycles, period_cycles);
+    print_controller(shell, "rate + divided attitude", divided_cycles, period_cycles);
+    print_controller(shell, "rate + attitude", full_cycles, period_cycles);
+    print_controller(shell, "fusion + rate + attitude", stage_cycles, period_cycles);
+    shell_print(shell, "%s: stage %u cycles (budget %u cycles, %u%% of period)",
+                (stage_cycles <= budget_cycles) ? "PASS" : "FAIL", stage_cycles, budget_cycles,
+                CONTROLLER_BUDGET_PCT);
+    return 0;
+}
+
+int bench::madgwick9(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    fill_fusion_input();
+    const MargScale scale = s_raw_scale;
+
+    // golden comparison: every step starts from the reference trajectory
+    MadgwickFusion9 fusion_impl;
+    Quaternion quat(0.0f, 0.0f, 0.0f, 1.0f);
+    uint32_t max_ulp = 0;
+    uint32_t exact_steps = 0;
+    for (uint32_t i = 0; i < FUSION_ITERATIONS; i++) {
+        MargDataFloat marg_data(s_fusion_input[i & (FUSION_INPUT_COUNT - 1)], scale);
+        Quaternion restructured = quat;
+        fusion_impl.update(marg_data, restructured, FUSION_TIME_DIFF_US);
+        madgwick9_reference(marg_data, quat, FUSION_TIME_DIFF_US);
+
+        uint32_t step_ulp = 0;
+        for (int j = 0; j < 4; j++) {
+            step_ulp = MAX(step_ulp, ulp_diff(quat[j], restructured[j]));
+        }
+        max_ulp = MAX(max_ulp, step_ulp);
+        if (0 == step_ulp) exact_steps++;
+    }
+    shell_print(shell, "%s: %u/%u steps bit-exact, max %u ulp (limit %u)",
+                (max_ulp <= MADGWICK9_MAX_ULP) ? "PASS" : "FAIL", exact_steps, FUSION_ITERATIONS,
+                max_ulp, MADGWICK9_MAX_ULP);
+
+    cycle_counter::start();
+
+    QuaternionT<double> unused;
+    uint32_t restructured_cycles = run_fusion<MadgwickFusion9>(unused);
+
+    quat = Quaternion(0.0f, 0.0f, 0.0f, 1.0f);
+    uint32_t start = cycle_counter::now();
+    for (uint32_t i = 0; i < FUSION_ITERATIONS; i++) {
+        MargDataFloat marg_data(s_fusion_input[i & (FUSION_INPUT_COUNT - 1)], scale);
+        madgwick9_reference(marg_data, quat, FUSION_TIME_DIFF_US);
+    }
+    uint32_t end = cycle_counter::now();
+    uint32_t reference_cycles = (end - start) / FUSION_ITERATIONS;
+
+    cycle_counter::stop();
+
+    // corrective step flops, counted on the source (negations excluded)
+    shell_print(shell, "reference:    %6u cycles/update, step 126 add 138 mul", reference_cycles);
+    shell_print(shell, "restructured: %6u cycles/update, step  69 add 112 mul",
+                restructured_cycles);
+    return 0;
+}
+
+int bench::fastmath(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    // accuracy -- inv_sqrt exhaustively over [1, 4) (all mantissas of an even & odd exponent, the
+    // relative error repeats from there), the rest swept against double references
+    double max_error = 0.0;
+    double max_refined_error = 0.0;
+    for (int32_t bits = fastmath::float_to_bits(1.0f); bits < fastmath::float_to_bits(4.0f);
+         bits++) {
+        float x = fastmath::bits_to_float(bits);
+        // float reference (double sqrt is soft float) -- it rounds within 1 ulp (6e-8)
+        float exact = 1.0f / sqrtf(x);
+        max_error = MAX(max_error, std::fabs((double)fastmath::inv_sqrt(x) - exact) / exact);
+        max_refined_error = MAX(max_refined_error,
+                                std::fabs((double)fastmath::inv_sqrt_refined(x) - exact) / exact);
+    }
+    print_accuracy(shell, "inv_sqrt", max_error, fastmath::INV_SQRT_MAX_ERROR);
+    print_accuracy(shell, "refined", max_refined_error, fastmath::INV_SQRT_REFINED_MAX_ERROR);
+
+    max_error = 0.0;
+    for (uint32_t i = 0; i < FASTMATH_SWEEP_POINTS; i++) {
+        float angle = sweep_point(i, FASTMATH_SWEEP_POINTS, -M_PI, M_PI);
+        // operands over a range of magnitudes
+        float radius = (i & 1) ? 1000.0f : 0.001f;
+        float y = radius * sinf(angle);
+        float x = radius * cosf(angle);
+        double error = std::fabs(fastmath::atan2(y, x) - std::atan2((double)y, (double)x));
+        // +/- pi are the same angle
+        max_error = MAX(max_error, MIN(error, 2.0 * M_PI - error));
+    }
+    print_accuracy(shell, "atan2", max_error, fastmath::ATAN2_MAX_ERROR);
+
+    max_error = 0.0;
+    for (uint32_t i = 0; i < FASTMATH_SWEEP_POINTS; i++) {
+        // squared spacing, dense near +/- 1 where the error peaks
+        float t = sweep_point(i, FASTMATH_SWEEP_POINTS, -1.0, 1.0);
+        float x = copysignf(1.0f - (1.0f - std::fabs(t)) * (1.0f - std::fabs(t)), t);
+        max_error = MAX(max_error, std::fabs(fastmath::asin(x) - std::asin((double)x)));
+    }
+    print_accuracy(shell, "asin", max_error, fastmath::ASIN_MAX_ERROR);
+
+    max_error = 0.0;
+    for (uint32_t i = 0; i < FASTMATH_SWEEP_POINTS; i++) {
+        float x = sweep_point(i, FASTMATH_SWEEP_POINTS, 1.0 / 16.0, 16.0);
+        max_error = MAX(max_error, std::fabs(fastmath::log2(x) - std::log2((double)x)));
+    }
+    print_accuracy(shell, "log2", max_error, fastmath::LOG2_MAX_ERROR);
+
+    max_error = 0.0;
+    for (uint32_t i = 0; i < FASTMATH_SWEEP_POINTS; i++) {
+        float x = sweep_point(i, FASTMATH_SWEEP_POINTS, -125.0, 126.99);
+        double exact = std::exp2((double)x);
+        max_error = MAX(max_error, std::fabs(fastmath::exp2(x) - exact) / exact);
+    }
+    print_accuracy(shell, "exp2", max_error, fastmath::EXP2_MAX_ERROR);
+
+    max_error = 0.0;
+    for (uint32_t i = 0; i < FASTMATH_SWEEP_POINTS; i++) {
+        float x = sweep_point(i, FASTMATH_SWEEP_POINTS, 0.3, 1.2);
+        double exact = std::pow((double)x, (double)BARO_EXPONENT);
+        max_error =
+            MAX(max_error, std::fabs(fastmath::pow(x, BARO_EXPONENT) - exact) / exact);
+    }
+    print_accuracy(shell, "pow", max_error, fastmath::POW_BARO_MAX_ERROR);
+
+    // cycles
+    fill_fastmath_input();
+    cycle_counter::start();
+
+    uint32_t fast_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return fastmath::inv_sqrt(x);
+    });
+    uint32_t libm_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return 1.0f / sqrtf(x);
+    });
+    print_cycles(shell, "inv_sqrt", fast_cycles, libm_cycles);
+    fast_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return fastmath::inv_sqrt_refined(x);
+    });
+    print_cycles(shell, "refined", fast_cycles, libm_cycles);
+
+    fast_cycles = fastmath_cycles([](float x, float y) { return fastmath::atan2(y, x); });
+    libm_cycles = fastmath_cycles([](float x, float y) { return atan2f(y, x); });
+    print_cycles(shell, "atan2", fast_cycles, libm_cycles);
+
+    fast_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(x);
+        return fastmath::asin(y);
+    });
+    libm_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(x);
+        return asinf(y);
+    });
+    print_cycles(shell, "asin", fast_cycles, libm_cycles);
+
+    fast_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return fastmath::pow(x, BARO_EXPONENT);
+    });
+    libm_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return powf(x, BARO_EXPONENT);
+    });
+    print_cycles(shell, "pow", fast_cycles, libm_cycles);
+
+    cycle_counter::stop();
+    return 0;
+}
+
+int bench::altitude(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    // accuracy across the envelope vs the double formula
+    double max_error_m = 0.0;
+    for (uint32_t i = 0; i < ALTITUDE_SWEEP_POINTS; i++) {
+        float kpa = sweep_point(i, ALTITUDE_SWEEP_POINTS, baro::MIN_KPA, baro::MAX_KPA);
+        double exact =
+            baro::SCALE_M * (1.0 - std::pow(kpa / baro::SEA_LEVEL_KPA, baro::EXPONENT));
+        max_error_m = MAX(max_error_m, std::fabs(baro::pressure_to_altitude(kpa) - exact));
+    }
+    shell_print(shell, "%s: max error %u um over %u-%u kPa (tolerance %u um, bound %u um)",
+                (max_error_m <= baro::TOLERANCE_M) ? "PASS" : "FAIL",
+                (uint32_t)(max_error_m * 1e6 + 0.5), (uint32_t)baro::MIN_KPA,
+                (uint32_t)baro::MAX_KPA, (uint32_t)(baro::TOLERANCE_M * 1e6 + 0.5),
+                (uint32_t)(baro::interpolation_error_m() * 1e6 + 0.5));
+
+    // cycles -- the x inputs are pressure ratios, scaled back to kPa
+    fill_fastmath_input();
+    cycle_counter::start();
+
+    uint32_t table_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return baro::pressure_to_altitude(x * (float)baro::SEA_LEVEL_KPA);
+    });
+    uint32_t fast_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return 44330.0f * (1.0f - fastmath::pow(x, BARO_EXPONENT));
+    });
+    uint32_t libm_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return 44330.0f * (1.0f - powf(x, BARO_EXPONENT));
+    });
+
+    cycle_counter::stop();
+
+    shell_print(shell, "table:         %4u cycles/sample (%u bytes)", table_cycles,
+                (uint32_t)sizeof(baro::ALTITUDE_TABLE));
+    shell_print(shell, "fastmath::pow: %4u cycles/sample", fast_cycles);
+    shell_print(shell, "powf:          %4u cycles/sample", libm_cycles);
+    return 0;
+}
+
+int bench::mix(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    // linearization accuracy over the thrust range vs the double inverse of the thrust curve
+    const double linear = 1.0 - thrust::EXPO;
+    double max_error = 0.0;
+    for (uint32_t i = 0; i < THRUST_SWEEP_POINTS; i++) {
+        float thrust = sweep_point(i, THRUST_SWEEP_POINTS, 0.0, 1.0);
+        double root = std::sqrt(linear * linear + 4.0 * thrust::EXPO * thrust);
+        double exact = (root - linear) / (2.0 * thrust::EXPO);
+        max_error = MAX(max_error, std::fabs(thrust::linearize(thrust) - exact));
+    }
+    shell_print(shell, "%s: max command error %u e-6 (tolerance %u e-6, bound %u e-6)",
+                (max_error <= thrust::TOLERANCE) ? "PASS" : "FAIL",
+                (uint32_t)(max_error * 1e6 + 0.5), (uint32_t)(thrust::TOLERANCE * 1e6 + 0.5),
+                (uint32_t)(thrust::interpolation_error() * 1e6 + 0.5));
+
+    // cycles -- torque demands from the y inputs, throttle from the x inputs
+    fill_fastmath_input();
+    Mixer motor_mixer(mixer::QUAD_X_MIX, 3700.0f);
+    motor_mixer.set_battery_voltage(3500.0f);
+    cycle_counter::start();
+
+    uint32_t mix_cycles = fastmath_cycles([&motor_mixer](float x, float y) {
+        MotorCommands commands =
+            motor_mixer.mix(linalg::vec<float, 3>(0.3f * y, -0.2f * y, 0.1f * y), 0.5f * x);
+        return commands.x + commands.y + commands.z + commands.w;
+    });
+    uint32_t linearize_cycles = fastmath_cycles([](float x, float y) {
+        ARG_UNUSED(y);
+        return thrust::linearize(x - 0.2f);
+    });
+
+    cycle_counter::stop();
+
+    shell_print(shell, "mix:       %4u cycles/call (table %u bytes)", mix_cycles,
+                (uint32_t)sizeof(thrust::COMMAND_TABLE));
+    shell_print(shell, "linearize: %4u cycles/call", linearize_cycles);
+    return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file	bench.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the bench module
+ *
+ * On-target benchmarks, run from the shell (zqr bench ...). Timings use the cycle counter (host
+ * nanoseconds on native_posix, see cycle_counter.hpp), results are printed to the calling shell.
+ *
+ *
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <shell/shell.h>
+
+namespace z_quad_rotor {
+
+namespace bench {
+
+/// Worst-case/average reader latency of SyncedVar vs SeqLockVar under writer contention
+int seqlock(const struct shell *shell, size_t argc, char **argv);
+
+/// Cycles & bytes per sample of the raw count MARG path vs the sensor_value path it replaced
+int convert(const struct shell *shell, size_t argc, char **argv);
+
+/// Cycles per update & accuracy (vs the double reference) of the Madgwick & Mahony fusion
+/// implementations, for float, Q24, and double
+int fusion(const struct shell *shell, size_t argc, char **argv);
+
+/// Cycles per fusion step & steps per second of Orientation::drain over full sample queues, queue
+/// handling & pairing included
+int orientation(const struct shell *shell, size_t argc, char **argv);
+
+/// ESKF cycles per update vs a 1 kHz loop budget, block-sparse vs dense covariance propagation
+int eskf(const struct shell *shell, size_t argc, char **argv);
+
+/// Golden comparison (ulp) & cycles of MadgwickFusion9 vs its pre-restructure formulation
+int madgwick9(const struct shell *shell, size_t argc, char **argv);
+
+/// Table altitude's max error over the flight envelope, & cycles vs fastmath::pow and powf
+int altitude(const struct shell *shell, size_t argc, char **argv);
+
+/// Cycles per attitude controller update (rate loop alone & with the attitude loop) vs a 1 kHz
+/// loop budget
+int controller(const struct shell *shell, size_t argc, char **argv);
+
+/// Thrust linearization table's max error vs tolerance, & cycles per mix of four motor commands
+int mix(const struct shell *shell, size_t argc, char **argv);
+
+/// Max error of the fastmath approximations vs their documented bounds, & cycles vs newlib
+int fastmath(const struct shell *shell, size_t argc, char **argv);
+
+} // namespace bench
+
+} // namespace z_quad_rotor
+
+#endif // __BENCH_H
@@ -0,0 +1,326 @@
+/**
+ * @file	blackbox.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the blackbox module
+ *
+ */
+
+#include "blackbox.hpp"
+
+#include <fs/fcb.h>
+#include <logging/log.h>
+#include <storage/flash_map.h>
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+#include "spsc_queue.hpp"
+#include "trace.hpp"
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(blackbox, LOG_LEVEL_DBG);
+
+// constants
+#define BLACKBOX_AREA_ID FLASH_AREA_ID(blackbox)
+
+static constexpr size_t STACK_SIZE = 1536;
+static constexpr int THREAD_PRIO = K_LOWEST_APPLICATION_THREAD_PRIO;
+static constexpr size_t QUEUE_DEPTH = 64; // 320 ms at 200 Hz; covers a sector erase (~50 ms)
+static constexpr uint32_t POLL_PERIOD_MS = 10;
+static constexpr size_t MAX_SECTORS = 255; // fcb sector count is 8 bit
+static constexpr uint32_t FCB_MAGIC = 0x5A514242; // "ZQBB"
+static constexpr uint8_t FORMAT_VERSION = 1;      // bumped on any change to the record encoding
+
+static constexpr size_t CHUNK_SIZE = 512;
+static constexpr size_t MARG_CHANNELS = 9;
+static constexpr size_t CHANNEL_COUNT = MARG_CHANNELS + 4 + 3 + 3; // marg, quat, setpoint, torque
+static constexpr size_t MAX_VARINT_SIZE = 5;
+// flags, timestamp, channels, pressure
+static constexpr size_t MAX_RECORD_SIZE = 1 + MAX_VARINT_SIZE * (CHANNEL_COUNT + 2);
+static constexpr uint32_t RAW_RECORD_SIZE = 4 + (CHANNEL_COUNT * 2); // timestamp, int16 channels
+
+static constexpr uint8_t RECORD_KEY = BIT(0); // predictors reset -- first record of a chunk
+static constexpr uint8_t RECORD_PRESSURE = BIT(1);
+
+static constexpr float QUAT_SCALE = 16384.0f;  // Q14
+static constexpr float RATE_SCALE = 1000.0f;   // mrad/s
+static constexpr float TORQUE_SCALE = 16384.0f; // Q14
+
+// types
+struct Predictor {
+    int32_t prev[CHANNEL_COUNT];
+    int32_t prev2[CHANNEL_COUNT];
+    uint32_t timestamp_us;
+    int32_t pressure_pa;
+};
+
+struct WalkContext {
+    void (*on_chunk)(const uint8_t *data, size_t len, void *arg);
+    void *arg;
+};
+
+// private variables
+static SpscQueue<blackbox::Sample, QUEUE_DEPTH> s_queue;
+static k_thread s_thread;
+K_THREAD_STACK_DEFINE(s_stack, STACK_SIZE);
+static atomic_t s_running = ATOMIC_INIT(0);
+
+// fcb access is shared by the writer thread & shell commands (for_each_chunk, erase)
+K_MUTEX_DEFINE(s_fcb_mutex);
+static struct fcb s_fcb;
+static struct flash_sector s_sectors[MAX_SECTORS];
+static bool s_ready;
+
+// writer thread only
+static uint8_t s_chunk[CHUNK_SIZE];
+static size_t s_chunk_len;
+static Predictor s_predictor;
+static uint8_t s_read_chunk[CHUNK_SIZE]; // for_each_chunk, under the mutex
+
+// control thread only
+static int32_t s_pending_pressure_pa;
+static bool s_has_pending_pressure;
+
+static atomic_t s_samples = ATOMIC_INIT(0);
+static atomic_t s_written_bytes = ATOMIC_INIT(0);
+static atomic_t s_write_errors = ATOMIC_INIT(0);
+
+// private function definitions
+static uint32_t zigzag(int32_t val) { return ((uint32_t)val << 1) ^ (uint32_t)(val >> 31); }
+
+/// LEB128; returns the encoded size
+static size_t put_varint(uint8_t *out, uint32_t val)
+{
+    size_t len = 0;
+    while (val >= 0x80) {
+        out[len++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    out[len++] = (uint8_t)val;
+    return len;
+}
+
+static int32_t quantize(float val, float scale)
+{
+    float scaled = val * scale;
+    if (scaled > INT16_MAX) return INT16_MAX;
+    if (scaled < INT16_MIN) return INT16_MIN;
+    return (int32_t)((scaled < 0.0f) ? (scaled - 0.5f) : (scaled + 0.5f));
+}
+
+static void to_channels(const blackbox::Sample &sample, int32_t (&channels)[CHANNEL_COUNT])
+{
+    const MargData &marg = sample.marg_data;
+    size_t i = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        channels[i++] = marg.accel[axis];
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        channels[i++] = marg.gyro[axis];
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        channels[i++] = marg.magn[axis];
+    }
+    for (int axis = 0; axis < 4; axis++) {
+        channels[i++] = quantize(sample.quat[axis], QUAT_SCALE);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        channels[i++] = quantize(sample.rate_setpoint[axis], RATE_SCALE);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        channels[i++] = quantize(sample.torque[axis], TORQUE_SCALE);
+    }
+}
+
+/// appends one record to s_chunk; the first record of a chunk is a key record (predictors reset,
+/// values absolute) so that every chunk decodes on its own
+static void encode_record(const blackbox::Sample &sample)
+{
+    const bool key = (0 == s_chunk_len);
+    int32_t channels[CHANNEL_COUNT];
+    to_channels(sample, channels);
+    uint8_t *out = &s_chunk[s_chunk_len];
+    size_t len = 0;
+
+    out[len++] = (key ? RECORD_KEY : 0) | (sample.has_pressure ? RECORD_PRESSURE : 0);
+    uint32_t timestamp_us = k_cyc_to_us_floor32(sample.timestamp);
+    len += put_varint(&out[len], key ? timestamp_us : (timestamp_us - s_predictor.timestamp_us));
+    s_predictor.timestamp_us = timestamp_us;
+
+    Predictor &p = s_predictor;
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        // previous value for raw counts, straight line through the previous two otherwise (after
+        // a key record, prev2 == prev, so that is the previous value too)
+        int32_t predicted = 0;
+        if (!key) predicted = (i < MARG_CHANNELS) ? p.prev[i] : (2 * p.prev[i]) - p.prev2[i];
+        len += put_varint(&out[len], zigzag(channels[i] - predicted));
+        p.prev2[i] = key ? channels[i] : p.prev[i];
+        p.prev[i] = channels[i];
+    }
+
+    if (key) p.pressure_pa = 0;
+    if (sample.has_pressure) {
+        len += put_varint(&out[len], zigzag(sample.pressure_pa - p.pressure_pa));
+        p.pressure_pa = sample.pressure_pa;
+    }
+
+    s_chunk_len += len;
+}
+
+/// takes s_fcb_mutex, tracing the wait (the writer thread vs shell dump/erase)
+static void lock_fcb()
+{
+    trace::lock_wait_start(s_fcb_mutex);
+    k_mutex_lock(&s_fcb_mutex, K_FOREVER);
+    trace::lock_wait_end(s_fcb_mutex);
+}
+
+/// appends s_chunk to the log as one entry, erasing the oldest sector if the log is full
+static void flush_chunk()
+{
+    lock_fcb();
+    struct fcb_entry loc;
+    int err = fcb_append(&s_fcb, s_chunk_len, &loc);
+    if (-ENOSPC == err) {
+        err = fcb_rotate(&s_fcb);
+        if (!err) err = fcb_append(&s_fcb, s_chunk_len, &loc);
+    }
+    if (!err) err = flash_area_write(s_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), s_chunk, s_chunk_len);
+    if (!err) err = fcb_append_finish(&s_fcb, &loc);
+    k_mutex_unlock(&s_fcb_mutex);
+
+    if (err) {
+        LOG_ERR("Blackbox write err: %d.", err);
+        atomic_inc(&s_write_errors);
+    }
+    else {
+        atomic_add(&s_written_bytes, s_chunk_len);
+    }
+    s_chunk_len = 0;
+}
+
+static void thread_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        blackbox::Sample sample;
+        if (s_queue.pop(sample)) {
+            encode_record(sample);
+            atomic_inc(&s_samples);
+            if ((CHUNK_SIZE - s_chunk_len) < MAX_RECORD_SIZE) flush_chunk();
+        }
+        else {
+            // idle: once stopped, write out the partial chunk
+            if (!atomic_get(&s_running) && s_chunk_len) flush_chunk();
+            k_sleep(K_MSEC(POLL_PERIOD_MS));
+        }
+    }
+}
+
+static int walk_cb(struct fcb_entry_ctx *loc_ctx, void *arg)
+{
+    const WalkContext &ctx = *static_cast<const WalkContext *>(arg);
+    uint16_t len = loc_ctx->loc.fe_data_len;
+    if (len > sizeof(s_read_chunk)) return 0; // not ours; skip
+    int err = flash_area_read(loc_ctx->fap, FCB_ENTRY_FA_DATA_OFF(loc_ctx->loc), s_read_chunk,
+                              len);
+    if (err) return err;
+    ctx.on_chunk(s_read_chunk, len, ctx.arg);
+    return 0;
+}
+
+// public function definitions
+int blackbox::setup()
+{
+    int err = 0;
+    // describe the partition's sectors to the fcb
+    uint32_t sector_count = ARRAY_SIZE(s_sectors);
+    err = flash_area_get_sectors(BLACKBOX_AREA_ID, &sector_count, s_sectors);
+    if (err) {
+        LOG_ERR("Blackbox flash area err: %d.", err);
+    }
+    if (!err) {
+        s_fcb.f_magic = FCB_MAGIC;
+        s_fcb.f_version = FORMAT_VERSION;
+        s_fcb.f_sector_cnt = (uint8_t)sector_count;
+        s_fcb.f_scratch_cnt = 0;
+        s_fcb.f_sectors = s_sectors;
+        err = fcb_init(BLACKBOX_AREA_ID, &s_fcb);
+        if (err) {
+            LOG_ERR("Unable to open blackbox log; err: %d.", err);
+        }
+    }
+    // start writer thread
+    if (!err) {
+        s_ready = true;
+        k_tid_t tid = k_thread_create(&s_thread, s_stack, K_THREAD_STACK_SIZEOF(s_stack),
+                                      thread_func, NULL, NULL, NULL, THREAD_PRIO, 0, K_NO_WAIT);
+        k_thread_name_set(tid, "blackbox");
+    }
+
+    return err;
+}
+
+void blackbox::start()
+{
+    if (s_ready) atomic_set(&s_running, 1);
+}
+
+void blackbox::stop() { atomic_set(&s_running, 0); }
+
+bool blackbox::is_running() { return atomic_get(&s_running); }
+
+void blackbox::log(Sample &sample)
+{
+    if (!atomic_get(&s_running)) return;
+
+    sample.has_pressure = s_has_pending_pressure;
+    sample.pressure_pa = s_pending_pressure_pa;
+    s_has_pending_pressure = false;
+    s_queue.push(sample);
+}
+
+void blackbox::log_pressure(struct sensor_value pressure)
+{
+    // kPa -> Pa, integer
+    s_pending_pressure_pa = (pressure.val1 * 1000) + (pressure.val2 / 1000);
+    s_has_pending_pressure = true;
+}
+
+int blackbox::for_each_chunk(void (*on_chunk)(const uint8_t *data, size_t len, void *arg),
+                             void *arg)
+{
+    if (!s_ready) return ENXIO;
+    if (atomic_get(&s_running)) return EBUSY;
+
+    WalkContext ctx = {on_chunk, arg};
+    lock_fcb();
+    int err = fcb_walk(&s_fcb, NULL, walk_cb, &ctx);
+    k_mutex_unlock(&s_fcb_mutex);
+    return err;
+}
+
+int blackbox::erase()
+{
+    if (!s_ready) return ENXIO;
+    if (atomic_get(&s_running)) return EBUSY;
+
+    lock_fcb();
+    int err = fcb_clear(&s_fcb);
+    k_mutex_unlock(&s_fcb_mutex);
+    return err;
+}
+
+blackbox::Stats blackbox::get_stats()
+{
+    Stats stats;
+    stats.samples = atomic_get(&s_samples);
+    stats.dropped = s_queue.get_overflow_count();
+    stats.raw_bytes = stats.samples * RAW_RECORD_SIZE;
+    stats.written_bytes = atomic_get(&s_written_bytes);
+    stats.write_errors = atomic_get(&s_write_errors);
+    return stats;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file	blackbox.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the blackbox module
+ *
+ * Full rate flight log on the external QSPI flash; a low priority thread compresses & writes the
+ * samples the control loop queues, so logging never blocks it. tools/blackbox.py decodes a dump.
+ *
+ *
+ */
+
+#ifndef __BLACKBOX_H
+#define __BLACKBOX_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <drivers/sensor.h>
+
+#include "linalg.h"
+
+#include "marg_sensor.hpp"
+#include "orientation_defs.hpp"
+
+namespace z_quad_rotor {
+
+namespace blackbox {
+
+/// One fusion step's input & estimator/controller state
+struct Sample {
+    uint32_t timestamp;                  // gyro data ready (hw cycles)
+    MargData marg_data;                  // raw counts
+    Quaternion quat;                     // logged in Q14
+    linalg::vec<float, 3> rate_setpoint; // rad/s, logged in mrad/s
+    linalg::vec<float, 3> torque;        // normalized, logged in Q14
+    int32_t pressure_pa;                 // set by log, from log_pressure
+    bool has_pressure;
+};
+
+/// Opens the log (formatting the partition if it holds no valid log) & starts the writer thread;
+/// logging starts stopped
+int setup();
+
+/// Starts/stops logging; stopping writes out the partial chunk
+void start();
+void stop();
+bool is_running();
+
+/// Queues a sample while running (control thread only)
+void log(Sample &sample);
+
+/// Attaches a new pressure sample to the next logged sample (control thread only)
+void log_pressure(struct sensor_value pressure);
+
+/// Calls on_chunk for every chunk in the log, oldest first; fails with EBUSY while running
+int for_each_chunk(void (*on_chunk)(const uint8_t *data, size_t len, void *arg), void *arg);
+
+/// Erases the log; fails with EBUSY while running
+int erase();
+
+/// Statistics since boot
+struct Stats {
+    uint32_t samples;       // encoded
+    uint32_t dropped;       // ring full
+    uint32_t raw_bytes;     // logged fields at their fixed size (the uncompressed equivalent)
+    uint32_t written_bytes; // compressed, appended to flash
+    uint32_t write_errors;  // chunks lost to flash errors
+};
+Stats get_stats();
+
+} // namespace blackbox
+
+} // namespace z_quad_rotor
+
+#endif // __BLACKBOX_H
@@ -0,0 +1,113 @@
+/**
+ * @file	controller.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the controller module
+ *
+ *
+ */
+
+#include "controller.hpp"
+
+#include "linalg.h"
+
+using namespace z_quad_rotor;
+
+// constants
+constexpr float TWO_PI = 2.0f * PI;
+
+// private function definitions
+static float clamp_symmetric(float val, float limit)
+{
+    return (val > limit) ? limit : ((val < -limit) ? -limit : val);
+}
+
+// public function definitions
+RatePid::RatePid(const RateGains &gains) : m_gains(gains)
+{
+    reset();
+}
+
+linalg::vec<float, 3> RatePid::update(const linalg::vec<float, 3> &setpoint,
+                                      const linalg::vec<float, 3> &rate, uint32_t time_diff_us)
+{
+    const float dt = time_diff_us * 0.000001f;
+    // derivative of the measurement through a first order low-pass; a zero step holds the filter
+    if (m_has_last_rate && time_diff_us) {
+        const float alpha = dt / (dt + (1.0f / (TWO_PI * m_gains.d_cutoff_hz)));
+        m_derivative += ((rate - m_last_rate) / dt - m_derivative) * alpha;
+    }
+    m_last_rate = rate;
+    m_has_last_rate = true;
+
+    const linalg::vec<float, 3> error = setpoint - rate;
+    linalg::vec<float, 3> output;
+    for (int i = 0; i < 3; i++) {
+        const float p_d = (m_gains.kp[i] * error[i]) - (m_gains.kd[i] * m_derivative[i]);
+        // anti-windup: the integral holds while the output is saturated in the direction of the
+        // error (conditional integration), & is clamped on its own
+        const float integral = clamp_symmetric(m_integral[i] + (m_gains.ki[i] * error[i] * dt),
+                                               m_gains.integral_limit[i]);
+        const float unclamped = p_d + integral;
+        const bool saturated = (unclamped > m_gains.output_limit && error[i] > 0.0f) ||
+                               (unclamped < -m_gains.output_limit && error[i] < 0.0f);
+        if (!saturated) m_integral[i] = integral;
+        output[i] = clamp_symmetric(p_d + m_integral[i], m_gains.output_limit);
+    }
+
+    return output;
+}
+
+void RatePid::reset()
+{
+    m_integral = linalg::vec<float, 3>(0.0f);
+    m_derivative = linalg::vec<float, 3>(0.0f);
+    m_last_rate = linalg::vec<float, 3>(0.0f);
+    m_has_last_rate = false;
+}
+
+linalg::vec<float, 3> z_quad_rotor::attitude_rate_setpoint(const Quaternion &quat,
+                                                           const Quaternion &setpoint,
+                                                           const AttitudeGains &gains)
+{
+    // error rotation in the body frame; q and -q are the same attitude, so pick the one with
+    // positive w (rotation of at most 180 degrees)
+    Quaternion error = linalg::qmul(linalg::qconj(quat), setpoint);
+    if (error.w < 0.0f) error = -error;
+    // 2 * vector part = 2 sin(angle / 2) * axis -- the rotation vector to first order, & bounded
+    linalg::vec<float, 3> rate_setpoint = gains.kp * (2.0f * error.xyz());
+    for (int i = 0; i < 3; i++) {
+        rate_setpoint[i] = clamp_symmetric(rate_setpoint[i], gains.max_rate[i]);
+    }
+    return rate_setpoint;
+}
+
+AttitudeController::AttitudeController(const AttitudeGains &attitude_gains,
+                                       const RateGains &rate_gains, uint32_t outer_divider)
+    : m_attitude_gains(attitude_gains), m_rate_pid(rate_gains),
+      m_outer_divider(outer_divider ? outer_divider : 1), m_outer_count(0),
+      m_rate_setpoint(0.0f), m_setpoint(Quaternion(0.0f, 0.0f, 0.0f, 1.0f)),
+      m_output(linalg::vec<float, 3>(0.0f))
+{
+}
+
+linalg::vec<float, 3> AttitudeController::update(const Quaternion &quat,
+                                                 const linalg::vec<float, 3> &gyro,
+                                                 uint32_t time_diff_us)
+{
+    if (0 == m_outer_count) {
+        m_rate_setpoint = attitude_rate_setpoint(quat, m_setpoint.get_var(), m_attitude_gains);
+    }
+    if (++m_outer_count >= m_outer_divider) m_outer_count = 0;
+
+    const linalg::vec<float, 3> output = m_rate_pid.update(m_rate_setpoint, gyro, time_diff_us);
+    m_output.set_var(output);
+    return output;
+}
+
+void AttitudeController::reset()
+{
+    m_rate_pid.reset();
+    m_outer_count = 0;
+    m_rate_setpoint = linalg::vec<float, 3>(0.0f);
+    m_output.set_var(linalg::vec<float, 3>(0.0f));
+}
@@ -0,0 +1,116 @@
+/**
+ * @file	controller.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the controller module
+ *
+ * Cascaded attitude controller. The outer loop turns the quaternion error between the estimated
+ * and target attitudes into body rate targets (proportional, no euler angles or trig); the inner
+ * loop is a per axis PID on gyro rates, which outputs normalized roll/pitch/yaw torque commands.
+ * The inner loop runs on every gyro sample, the outer loop on every outer_divider-th.
+ *
+ *
+ */
+
+#ifndef __CONTROLLER_H
+#define __CONTROLLER_H
+
+#include <cstdint>
+
+#include "linalg.h"
+
+#include "orientation_defs.hpp"
+#include "seqlock_var.hpp"
+
+namespace z_quad_rotor {
+
+/// Outer (attitude) loop gains, per body axis (x/roll, y/pitch, z/yaw)
+struct AttitudeGains {
+    linalg::vec<float, 3> kp;       // rad/s of rate target per rad of error
+    linalg::vec<float, 3> max_rate; // rate target limit (rad/s)
+};
+
+/// Inner (rate) loop gains, per body axis; outputs are normalized torque commands
+struct RateGains {
+    linalg::vec<float, 3> kp;             // per rad/s of error
+    linalg::vec<float, 3> ki;             // per rad of integrated error
+    linalg::vec<float, 3> kd;             // per rad/s^2 of (filtered) rate change
+    linalg::vec<float, 3> integral_limit; // clamp on the integral term's output
+    float d_cutoff_hz;                    // derivative low-pass cutoff
+    float output_limit;                   // clamp on each torque command
+};
+
+constexpr AttitudeGains DEFAULT_ATTITUDE_GAINS = {{6.0f, 6.0f, 4.0f}, {3.5f, 3.5f, 2.0f}};
+constexpr RateGains DEFAULT_RATE_GAINS = {
+    {0.05f, 0.05f, 0.12f}, {0.10f, 0.10f, 0.10f}, {0.0015f, 0.0015f, 0.0f},
+    {0.20f, 0.20f, 0.20f}, 40.0f,                 1.0f};
+
+/// Per axis PID on body rates. The derivative acts on the measurement (setpoint steps don't kick)
+/// through a first order low-pass; the integral stops while the output is saturated in the
+/// direction of the error, and is clamped on its own.
+class RatePid {
+  public:
+    explicit RatePid(const RateGains &gains = DEFAULT_RATE_GAINS);
+    /// Runs one step; returns the torque command
+    /// @param setpoint Target body rates (rad/s)
+    /// @param rate Measured body rates (rad/s)
+    /// @param time_diff_us Time since the previous step (microseconds)
+    linalg::vec<float, 3> update(const linalg::vec<float, 3> &setpoint,
+                                 const linalg::vec<float, 3> &rate, uint32_t time_diff_us);
+    /// Clears the integral & derivative state (e.g. on arming)
+    void reset();
+
+  private:
+    const RateGains m_gains;
+    linalg::vec<float, 3> m_integral;   // integral term, in output units
+    linalg::vec<float, 3> m_derivative; // filtered rate derivative (rad/s^2)
+    linalg::vec<float, 3> m_last_rate;
+    bool m_has_last_rate;
+};
+
+/// Outer loop: rate targets that rotate quat towards setpoint along the shortest path
+/// @note Both quaternions must be unit length
+linalg::vec<float, 3> attitude_rate_setpoint(const Quaternion &quat, const Quaternion &setpoint,
+                                             const AttitudeGains &gains);
+
+/// Attitude loop driving a rate loop, fed with each fusion step's attitude & gyro rates
+/// @note update & reset must be called from a single thread; the setpoint may be set, & the
+/// output read, from any thread (never blocks)
+class AttitudeController {
+  public:
+    static constexpr uint32_t DEFAULT_OUTER_DIVIDER = 2; // 100 Hz attitude loop at 200 Hz gyro
+
+    AttitudeController(const AttitudeGains &attitude_gains = DEFAULT_ATTITUDE_GAINS,
+                       const RateGains &rate_gains = DEFAULT_RATE_GAINS,
+                       uint32_t outer_divider = DEFAULT_OUTER_DIVIDER);
+    /// Runs the rate loop, preceded by the attitude loop every outer_divider-th call; returns the
+    /// torque command
+    /// @param quat Estimated attitude
+    /// @param gyro Body rates (rad/s)
+    /// @param time_diff_us Time since the previous call (microseconds)
+    linalg::vec<float, 3> update(const Quaternion &quat, const linalg::vec<float, 3> &gyro,
+                                 uint32_t time_diff_us);
+    /// Clears loop state; the next update runs the attitude loop
+    void reset();
+    /// Sets the target attitude (identity is level, facing the reference heading)
+    /// @note Single writer
+    void set_setpoint(const Quaternion &setpoint) { m_setpoint.set_var(setpoint); }
+    /// Returns the rate loop's current target (rad/s)
+    /// @note Same thread as update only
+    linalg::vec<float, 3> get_rate_setpoint() const { return m_rate_setpoint; }
+    /// Returns the latest torque command (normalized, roll/pitch/yaw)
+    /// @note Never blocks
+    linalg::vec<float, 3> get_output() const { return m_output.get_var(); }
+
+  private:
+    const AttitudeGains m_attitude_gains;
+    RatePid m_rate_pid;
+    const uint32_t m_outer_divider;
+    uint32_t m_outer_count;
+    linalg::vec<float, 3> m_rate_setpoint; // held between attitude loop runs
+    SeqLockVar<Quaternion> m_setpoint;
+    SeqLockVar<linalg::vec<float, 3>> m_output;
+};
+
+} // namespace z_quad_rotor
+
+#endif // __CONTROLLER_H
@@ -0,0 +1,58 @@
+/**
+ * @file		cycle_counter.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only duration measurement for benchmarks & stage timing
+ *
+ * On target, zephyr's timing functions (the DWT cycle counter). On native_posix, code runs in zero
+ * simulated time, so durations come from the host's monotonic clock instead, in nanoseconds -- a
+ * 1000 MHz "cycle" -- and benchmarks measure the host's actual compute.
+ *
+ *
+ */
+
+#ifndef __CYCLE_COUNTER_H
+#define __CYCLE_COUNTER_H
+
+#include <cstdint>
+
+#ifdef CONFIG_ARCH_POSIX
+#include <time.h>
+#else
+#include <timing/timing.h>
+#endif
+
+namespace z_quad_rotor {
+
+namespace cycle_counter {
+
+#ifdef CONFIG_ARCH_POSIX
+static inline void start() {}
+static inline void stop() {}
+/// Returns the counter; differences are valid across wraparound (~4 s on native_posix)
+static inline uint32_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((uint64_t)ts.tv_sec * 1000000000u) + ts.tv_nsec);
+}
+static inline uint32_t get_freq_mhz() { return 1000; }
+static inline uint64_t to_ns(uint64_t cycles) { return cycles; }
+#else
+/// Starts the counter; start/stop pairs nest
+static inline void start()
+{
+    timing_init();
+    timing_start();
+}
+static inline void stop() { timing_stop(); }
+/// Returns the counter; differences are valid across wraparound (~67 s at 64 MHz)
+static inline uint32_t now() { return (uint32_t)timing_counter_get(); }
+static inline uint32_t get_freq_mhz() { return timing_freq_get_mhz(); }
+static inline uint64_t to_ns(uint64_t cycles) { return timing_cycles_to_ns(cycles); }
+#endif
+
+} // namespace cycle_counter
+
+} // namespace z_quad_rotor
+
+#endif // __CYCLE_COUNTER_H
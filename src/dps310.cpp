@@ -8,56 +8,249 @@
 #include "dps310.hpp"
 
 #include <device.h>
+#include <drivers/i2c.h>
 #include <drivers/sensor.h>
 #include <logging/log.h>
+#include <zephyr.h>
+
+#include "perf.hpp"
+#include "trace.hpp"
 
 using namespace z_quad_rotor;
 
 LOG_MODULE_REGISTER(dps310, LOG_LEVEL_DBG);
 
+// constants
+#define DPS310_NODE DT_INST(0, infineon_dps310)
+
+static constexpr uint8_t FIFO_SIZE = 32;
+static constexpr size_t RESULT_SIZE = 3; // 24-bit, msb first
+static constexpr size_t COEF_SIZE = 18;
+static constexpr uint8_t MAX_LOG2 = 7;                // 128 Hz / 128x
+static constexpr uint32_t MAX_MEAS_TIME_US = 1000000; // per second, across both sensors
+
+// registers & bits
+static constexpr uint8_t REG_PSR_B2 = 0x00; // pops the fifo while it is enabled
+static constexpr uint8_t REG_PRS_CFG = 0x06;
+static constexpr uint8_t REG_TMP_CFG = 0x07;
+static constexpr uint8_t REG_MEAS_CFG = 0x08;
+static constexpr uint8_t REG_CFG_REG = 0x09;
+static constexpr uint8_t REG_RESET = 0x0C;
+static constexpr uint8_t REG_COEF = 0x10;
+static constexpr uint8_t REG_COEF_SRCE = 0x28;
+
+static constexpr uint8_t CFG_RATE_SHIFT = 4;
+static constexpr uint8_t TMP_CFG_EXT = BIT(7);
+static constexpr uint8_t MEAS_CFG_COEF_RDY = BIT(7);
+static constexpr uint8_t MEAS_CFG_IDLE = 0x00;
+static constexpr uint8_t MEAS_CFG_CONT_PRS_TMP = 0x07;
+static constexpr uint8_t CFG_REG_T_SHIFT = BIT(3); // required for oversampling > 8x
+static constexpr uint8_t CFG_REG_P_SHIFT = BIT(2);
+static constexpr uint8_t CFG_REG_FIFO_EN = BIT(1);
+static constexpr uint8_t RESET_FIFO_FLUSH = BIT(7);
+static constexpr uint8_t COEF_SRCE_EXT = BIT(7);
+
+static constexpr int32_t FIFO_EMPTY = -0x800000;   // 0x800000 sign extended
+static constexpr int32_t RESULT_PRESSURE = BIT(0); // fifo results are tagged by their lsb
+
+/// compensation scale factors, by oversampling
+static constexpr float SCALE_FACTOR[MAX_LOG2 + 1] = {524288.0f,  1572864.0f, 3670016.0f,
+                                                     7864320.0f, 253952.0f,  516096.0f,
+                                                     1040384.0f, 2088960.0f};
+/// measurement time (us), by oversampling
+static constexpr uint32_t MEAS_TIME_US[MAX_LOG2 + 1] = {3600,  5200,  8400,   14800,
+                                                        27600, 53200, 104400, 206800};
+
+// types
+/// pressure calibration coefficients (the temperature ones, c0 & c1, aren't needed)
+struct Coefficients {
+    float c00, c10, c01, c11, c20, c21, c30;
+};
+
 // private variables
-static const struct device *s_dev;
+static PressureSensor *s_output_sink;
+static const struct device *s_i2c;
 
-// public function definitions
-int dps310::setup(const char *dev_name)
+static Coefficients s_coef;
+static float s_pressure_scale;
+static float s_temp_scale;
+static float s_temp_scaled; // newest scaled raw temperature, pressure compensation input
+static bool s_has_temp;
+
+static void fifo_work_handler(struct k_work *work);
+static void fifo_timer_handler(struct k_timer *timer);
+K_WORK_DEFINE(s_fifo_work, fifo_work_handler);
+K_TIMER_DEFINE(s_fifo_timer, fifo_timer_handler, NULL);
+
+// private function definitions
+static int32_t sign_extend(uint32_t val, int bits)
+{
+    return (int32_t)(val << (32 - bits)) >> (32 - bits);
+}
+
+/// decodes the packed coefficient registers (c0 & c1 occupy the first 3 bytes)
+static void decode_coefficients(const uint8_t *raw, Coefficients &coef)
+{
+    coef.c00 = sign_extend((raw[3] << 12) | (raw[4] << 4) | (raw[5] >> 4), 20);
+    coef.c10 = sign_extend(((raw[5] & 0x0F) << 16) | (raw[6] << 8) | raw[7], 20);
+    coef.c01 = sign_extend((raw[8] << 8) | raw[9], 16);
+    coef.c11 = sign_extend((raw[10] << 8) | raw[11], 16);
+    coef.c20 = sign_extend((raw[12] << 8) | raw[13], 16);
+    coef.c21 = sign_extend((raw[14] << 8) | raw[15], 16);
+    coef.c30 = sign_extend((raw[16] << 8) | raw[17], 16);
+}
+
+/// compensated pressure (kPa) from a scaled raw pressure & the newest scaled raw temperature
+static struct sensor_value compensate_pressure(float pressure_scaled)
+{
+    const Coefficients &c = s_coef;
+    float p = pressure_scaled;
+    float t = s_temp_scaled;
+    float pa = c.c00 + p * (c.c10 + p * (c.c20 + p * c.c30)) + t * c.c01 +
+               t * p * (c.c11 + p * c.c21);
+    float kpa = pa * 0.001f;
+    struct sensor_value pressure;
+    pressure.val1 = (int32_t)kpa;
+    pressure.val2 = (int32_t)((kpa - pressure.val1) * 1000000.0f);
+    return pressure;
+}
+
+/// Pops results until the fifo is empty; temperatures update the compensation input, pressures are
+/// compensated & published
+static int drain_fifo()
 {
     int err = 0;
-    // input validation
-    if (dev_name == nullptr) {
-        LOG_ERR("DPS310 nullptr error at line: %d.", __LINE__);
-        err = EINVAL;
+    for (uint8_t i = 0; i < FIFO_SIZE; i++) {
+        uint8_t raw[RESULT_SIZE];
+        err = i2c_burst_read(s_i2c, DT_REG_ADDR(DPS310_NODE), REG_PSR_B2, raw, sizeof(raw));
+        if (err) break;
+
+        int32_t result = sign_extend((raw[0] << 16) | (raw[1] << 8) | raw[2], 24);
+        if (FIFO_EMPTY == result) break;
+        if (result & RESULT_PRESSURE) {
+            // can't compensate until the first temperature arrives
+            if (s_has_temp) {
+                s_output_sink->set_pressure(compensate_pressure(result / s_pressure_scale));
+            }
+        }
+        else {
+            s_temp_scaled = result / s_temp_scale;
+            s_has_temp = true;
+        }
+    }
+
+    return err;
+}
+
+static void fifo_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    trace::handler_enter(trace::SOURCE_PRESSURE);
+    PERF_BEGIN(PRESSURE_READ);
+    int err = drain_fifo();
+    PERF_END(PRESSURE_READ);
+    trace::handler_exit(trace::SOURCE_PRESSURE, err);
+    if (err) {
+        LOG_ERR("DPS310 FIFO read err: %d.", err);
     }
-    // get device from name
+}
+
+static void fifo_timer_handler(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    // i2c can't run in the timer isr
+    k_work_submit(&s_fifo_work);
+}
+
+/// Reads calibration coefficients, then configures rates, oversampling & the fifo and starts
+/// continuous measurement
+static int configure(const dps310::Config &config)
+{
+    int err = 0;
+    uint16_t addr = DT_REG_ADDR(DPS310_NODE);
+    // stop any measurement in progress (the driver leaves the sensor in command mode)
+    err = i2c_reg_write_byte(s_i2c, addr, REG_MEAS_CFG, MEAS_CFG_IDLE);
+    uint8_t meas_cfg = 0;
+    if (!err) err = i2c_reg_read_byte(s_i2c, addr, REG_MEAS_CFG, &meas_cfg);
+    if (!err && !(meas_cfg & MEAS_CFG_COEF_RDY)) err = EAGAIN;
+    uint8_t coef_raw[COEF_SIZE];
+    if (!err) err = i2c_burst_read(s_i2c, addr, REG_COEF, coef_raw, sizeof(coef_raw));
+    // the temperature sensor must match the one the coefficients were calibrated with
+    uint8_t coef_srce = 0;
+    if (!err) err = i2c_reg_read_byte(s_i2c, addr, REG_COEF_SRCE, &coef_srce);
     if (!err) {
-        s_dev = device_get_binding(dev_name);
-        if (!s_dev) {
-            LOG_ERR("DPS310 binding failed.");
-            err = ENXIO;
-        }
+        uint8_t prs_cfg = (config.pressure_rate_log2 << CFG_RATE_SHIFT) | config.pressure_osr_log2;
+        err = i2c_reg_write_byte(s_i2c, addr, REG_PRS_CFG, prs_cfg);
+    }
+    if (!err) {
+        uint8_t tmp_cfg = ((coef_srce & COEF_SRCE_EXT) ? TMP_CFG_EXT : 0) |
+                          (config.temp_rate_log2 << CFG_RATE_SHIFT) | config.temp_osr_log2;
+        err = i2c_reg_write_byte(s_i2c, addr, REG_TMP_CFG, tmp_cfg);
+    }
+    if (!err) {
+        uint8_t cfg_reg = CFG_REG_FIFO_EN | ((config.pressure_osr_log2 > 3) ? CFG_REG_P_SHIFT : 0) |
+                          ((config.temp_osr_log2 > 3) ? CFG_REG_T_SHIFT : 0);
+        err = i2c_reg_write_byte(s_i2c, addr, REG_CFG_REG, cfg_reg);
+    }
+    if (!err) err = i2c_reg_write_byte(s_i2c, addr, REG_RESET, RESET_FIFO_FLUSH);
+    if (!err) err = i2c_reg_write_byte(s_i2c, addr, REG_MEAS_CFG, MEAS_CFG_CONT_PRS_TMP);
+    if (err) {
+        LOG_ERR("Unable to configure DPS310; err: %d.", err);
+    }
+    // store compensation params
+    if (!err) {
+        decode_coefficients(coef_raw, s_coef);
+        s_pressure_scale = SCALE_FACTOR[config.pressure_osr_log2];
+        s_temp_scale = SCALE_FACTOR[config.temp_osr_log2];
+        s_has_temp = false;
     }
 
     return err;
 }
 
-int dps310::read_pressure(PressureSensor *output)
+// public function definitions
+int dps310::setup(const char *dev_name, PressureSensor *output_sink, const Config &config)
 {
     int err = 0;
     // input validation
-    if (output == nullptr) {
+    if (dev_name == nullptr || output_sink == nullptr) {
         LOG_ERR("DPS310 nullptr error at line: %d.", __LINE__);
         err = EINVAL;
     }
-    // fetch & store data
+    if (!err && (config.pressure_rate_log2 > MAX_LOG2 || config.pressure_osr_log2 > MAX_LOG2 ||
+                 config.temp_rate_log2 > MAX_LOG2 || config.temp_osr_log2 > MAX_LOG2)) {
+        LOG_ERR("DPS310 config out of range.");
+        err = EINVAL;
+    }
     if (!err) {
-        err = sensor_sample_fetch(s_dev);
-        if (!err) {
-            WriteLock<struct sensor_value> write_access = output->get_write_lock();
-            err = sensor_channel_get(s_dev, SENSOR_CHAN_PRESS, &write_access.get_ref());
+        uint32_t meas_time_us =
+            (MEAS_TIME_US[config.pressure_osr_log2] << config.pressure_rate_log2) +
+            (MEAS_TIME_US[config.temp_osr_log2] << config.temp_rate_log2);
+        if (meas_time_us >= MAX_MEAS_TIME_US) {
+            LOG_ERR("DPS310 config exceeds measurement time: %u us/s.", meas_time_us);
+            err = EINVAL;
         }
     }
-
-    if (err) {
-        LOG_ERR("Error reading pressure sensor: %d", err);
+    // get device from name (the driver resets & initializes the sensor) & its bus for raw access
+    if (!err) {
+        const struct device *dev = device_get_binding(dev_name);
+        s_i2c = device_get_binding(DT_BUS_LABEL(DPS310_NODE));
+        if (!dev || !s_i2c) {
+            LOG_ERR("DPS310 binding failed.");
+            err = ENXIO;
+        }
+    }
+    s_output_sink = output_sink;
+    if (!err) {
+        err = configure(config);
     }
+    // drain once per pressure measurement period -- the fifo absorbs workqueue delays
+    if (!err) {
+        k_timeout_t period = K_USEC(1000000 >> config.pressure_rate_log2);
+        k_timer_start(&s_fifo_timer, period, period);
+    }
+
     return err;
-}
\ No newline at end of file
+}
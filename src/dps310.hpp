@@ -3,7 +3,9 @@
  * @author	Andrew Loebs
  * @brief	Header file of the dps310 module
  *
- * Thin wrapper around zephyr's dps310 driver
+ * Thin wrapper around zephyr's dps310 driver. The driver only supports single (command mode)
+ * measurements, so once it has initialized the sensor it is put into continuous background
+ * measurement through its FIFO, which is drained periodically from the system workqueue.
  *
  *
  */
@@ -11,21 +13,29 @@
 #ifndef __DPS310_H
 #define __DPS310_H
 
+#include <cstdint>
+
 #include "pressure_sensor.hpp"
 
 namespace z_quad_rotor {
 
 namespace dps310 {
 
-/// Initializes the sensor
-int setup(const char *dev_name);
+/// Background measurement config; rates & oversampling are log2 of the value (register encoding),
+/// e.g. 5 -> 32 Hz / 32x. Measurement time at the given rates must total less than 1 s.
+struct Config {
+    uint8_t pressure_rate_log2; // 1 - 128 Hz
+    uint8_t pressure_osr_log2;  // 1 - 128x
+    uint8_t temp_rate_log2;     // 1 - 128 Hz
+    uint8_t temp_osr_log2;      // 1 - 128x
+};
 
-/// Reads pressure data and writes to output
-/// @note Blocking call -- will yield thread while waiting on conversion & i2c transaction
-int read_pressure(PressureSensor *output);
+/// Initializes the sensor and starts background measurement; each pressure sample will be written
+/// to output sink (with up to one pressure measurement period of latency).
+int setup(const char *dev_name, PressureSensor *output_sink, const Config &config);
 
 } // namespace dps310
 
 } // namespace z_quad_rotor
 
-#endif // __DPS310_H
\ No newline at end of file
+#endif // __DPS310_H
@@ -0,0 +1,376 @@
+/**
+ * @file	dps310_emul.cpp
+ * @author	Andrew Loebs
+ * @brief	I2C emulator of the DPS310 barometer (see sensor_emul.hpp)
+ *
+ * Models the registers the zephyr driver & dps310.cpp use: reset, product id, calibration
+ * coefficients, command & continuous measurement at the configured rates & oversampling, the
+ * result registers and the 32 result fifo. Raw results invert the compensation equations, so the
+ * compensated pressure & temperature are the trajectory's. Measurements complete immediately.
+ *
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <logging/log.h>
+#include <zephyr.h>
+
+#include "sensor_emul.hpp"
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(dps310_emul, LOG_LEVEL_DBG);
+
+#define DPS310_NODE DT_INST(0, infineon_dps310)
+
+#if DT_NODE_HAS_STATUS(DPS310_NODE, okay)
+
+// constants
+static constexpr size_t REG_COUNT = 0x80;
+static constexpr uint8_t FIFO_SIZE = 32;
+static constexpr uint8_t PRODUCT_ID = 0x10;
+static constexpr size_t RESULT_SIZE = 3; // 24-bit, msb first
+static constexpr int32_t FIFO_EMPTY = -0x800000;
+static constexpr int32_t RESULT_PRESSURE = BIT(0); // fifo results are tagged by their lsb
+static constexpr int32_t RESULT_MAX = 0x7FFFFF;
+static constexpr int NEWTON_STEPS = 4;
+
+// registers & bits
+static constexpr uint8_t REG_PSR_B2 = 0x00; // pops the fifo while it is enabled
+static constexpr uint8_t REG_PSR_B0 = 0x02;
+static constexpr uint8_t REG_TMP_B2 = 0x03;
+static constexpr uint8_t REG_TMP_B0 = 0x05;
+static constexpr uint8_t REG_PRS_CFG = 0x06;
+static constexpr uint8_t REG_TMP_CFG = 0x07;
+static constexpr uint8_t REG_MEAS_CFG = 0x08;
+static constexpr uint8_t REG_CFG_REG = 0x09;
+static constexpr uint8_t REG_INT_STS = 0x0A;
+static constexpr uint8_t REG_FIFO_STS = 0x0B;
+static constexpr uint8_t REG_RESET = 0x0C;
+static constexpr uint8_t REG_PRODUCT_ID = 0x0D;
+static constexpr uint8_t REG_COEF = 0x10;
+static constexpr uint8_t REG_COEF_SRCE = 0x28;
+
+static constexpr uint8_t CFG_RATE_SHIFT = 4;
+static constexpr uint8_t CFG_RATE_MASK = 0x07;
+static constexpr uint8_t CFG_PRC_MASK = 0x07;
+static constexpr uint8_t MEAS_CFG_COEF_RDY = BIT(7);
+static constexpr uint8_t MEAS_CFG_SENSOR_RDY = BIT(6);
+static constexpr uint8_t MEAS_CFG_TMP_RDY = BIT(5);
+static constexpr uint8_t MEAS_CFG_PRS_RDY = BIT(4);
+static constexpr uint8_t MEAS_CFG_CTRL_MASK = 0x07;
+static constexpr uint8_t MEAS_CTRL_PRS = 0x01; // command mode; continuous modes add 0x04
+static constexpr uint8_t MEAS_CTRL_TMP = 0x02;
+static constexpr uint8_t MEAS_CTRL_CONT = 0x04;
+static constexpr uint8_t CFG_REG_FIFO_EN = BIT(1);
+static constexpr uint8_t FIFO_STS_FULL = BIT(1);
+static constexpr uint8_t FIFO_STS_EMPTY = BIT(0);
+static constexpr uint8_t RESET_FIFO_FLUSH = BIT(7);
+static constexpr uint8_t RESET_SOFT_RST_MASK = 0x0F;
+static constexpr uint8_t RESET_SOFT_RST = 0x09;
+static constexpr uint8_t COEF_SRCE_EXT = BIT(7);
+
+/// compensation scale factors, by oversampling
+static constexpr float SCALE_FACTOR[8] = {524288.0f, 1572864.0f, 3670016.0f, 7864320.0f,
+                                          253952.0f, 516096.0f,  1040384.0f, 2088960.0f};
+
+// calibration coefficients of a sample part
+static constexpr int32_t C0 = 204;
+static constexpr int32_t C1 = -261;
+static constexpr int32_t C00 = 80506;
+static constexpr int32_t C10 = -55201;
+static constexpr int32_t C01 = -3047;
+static constexpr int32_t C11 = 1252;
+static constexpr int32_t C20 = -10616;
+static constexpr int32_t C21 = 163;
+static constexpr int32_t C30 = -1390;
+
+static constexpr float PRESSURE_NOISE_PA = 0.5f; // high precision (64x) rms
+static constexpr float TEMP_NOISE_C = 0.01f;
+
+// types
+struct FifoEntry {
+    int32_t result;
+    uint64_t sample_us;
+};
+
+/// register file & measurement state (under s_lock)
+struct Device {
+    uint8_t regs[REG_COUNT];
+    int32_t pressure;
+    int32_t temp;
+    uint8_t meas_rdy; // TMP_RDY & PRS_RDY
+    uint64_t pressure_us;
+    bool is_pressure_unread;
+    FifoEntry fifo[FIFO_SIZE];
+    uint8_t fifo_head;
+    uint8_t fifo_count;
+    int32_t fifo_out; // popped result, as the result registers
+
+    void reset();
+    uint8_t read(uint8_t reg);
+    void write(uint8_t reg, uint8_t val);
+    uint8_t next(uint8_t reg) const { return (reg + 1) % REG_COUNT; }
+    bool is_fifo_enabled() const { return regs[REG_CFG_REG] & CFG_REG_FIFO_EN; }
+    void measure(bool is_pressure);
+};
+
+// private variables
+static struct k_spinlock s_lock;
+static Device s_device;
+static struct i2c_emul s_i2c_emul;
+
+static void pressure_timer_handler(struct k_timer *timer);
+static void temp_timer_handler(struct k_timer *timer);
+K_TIMER_DEFINE(s_pressure_timer, pressure_timer_handler, NULL);
+K_TIMER_DEFINE(s_temp_timer, temp_timer_handler, NULL);
+
+// private function definitions
+static uint8_t get_result_byte(int32_t result, int offset)
+{
+    return (uint8_t)(result >> (8 * (RESULT_SIZE - 1 - offset)));
+}
+
+static int32_t saturate_result(float val)
+{
+    return (int32_t)MAX(MIN(val, (float)RESULT_MAX), (float)-RESULT_MAX);
+}
+
+/// packs the coefficients as the part stores them (c0, c1: 12-bit; c00, c10: 20-bit; others 16)
+static void put_coefficients(uint8_t *raw)
+{
+    raw[0] = (uint8_t)(C0 >> 4);
+    raw[1] = (uint8_t)(((C0 & 0x0F) << 4) | ((C1 >> 8) & 0x0F));
+    raw[2] = (uint8_t)C1;
+    raw[3] = (uint8_t)(C00 >> 12);
+    raw[4] = (uint8_t)(C00 >> 4);
+    raw[5] = (uint8_t)(((C00 & 0x0F) << 4) | ((C10 >> 16) & 0x0F));
+    raw[6] = (uint8_t)(C10 >> 8);
+    raw[7] = (uint8_t)C10;
+    const int32_t c16[] = {C01, C11, C20, C21, C30};
+    for (size_t i = 0; i < ARRAY_SIZE(c16); i++) {
+        raw[8 + (2 * i)] = (uint8_t)(c16[i] >> 8);
+        raw[9 + (2 * i)] = (uint8_t)c16[i];
+    }
+}
+
+/// scaled raw temperature of a temperature (inverse of t = c0 / 2 + c1 t_sc)
+static float temp_scaled(float temp_c) { return (temp_c - (C0 * 0.5f)) / C1; }
+
+/// scaled raw pressure of a pressure, at a scaled raw temperature (newton's method on the
+/// compensation polynomial)
+static float pressure_scaled(float pressure_pa, float t)
+{
+    float p = (pressure_pa - C00 - (t * C01)) / (C10 + (t * C11));
+    for (int i = 0; i < NEWTON_STEPS; i++) {
+        float f = C00 + p * (C10 + p * (C20 + p * C30)) + t * C01 + t * p * (C11 + p * C21) -
+                  pressure_pa;
+        float df = C10 + p * (2.0f * C20 + 3.0f * p * C30) + t * (C11 + 2.0f * p * C21);
+        p -= f / df;
+    }
+    return p;
+}
+
+/// restarts continuous measurement at the configured rates, or stops it
+static void update_timers(const Device &device)
+{
+    uint8_t ctrl = device.regs[REG_MEAS_CFG] & MEAS_CFG_CTRL_MASK;
+    bool is_cont = ctrl & MEAS_CTRL_CONT;
+    uint8_t cfgs[2] = {device.regs[REG_PRS_CFG], device.regs[REG_TMP_CFG]};
+    uint8_t ctrls[2] = {MEAS_CTRL_PRS, MEAS_CTRL_TMP};
+    struct k_timer *timers[2] = {&s_pressure_timer, &s_temp_timer};
+    for (int i = 0; i < 2; i++) {
+        if (is_cont && (ctrl & ctrls[i])) {
+            k_timeout_t period = K_USEC(1000000 >> ((cfgs[i] >> CFG_RATE_SHIFT) & CFG_RATE_MASK));
+            k_timer_start(timers[i], period, period);
+        }
+        else {
+            k_timer_stop(timers[i]);
+        }
+    }
+}
+
+void Device::reset()
+{
+    memset(this, 0, sizeof(*this));
+    regs[REG_PRODUCT_ID] = PRODUCT_ID;
+    regs[REG_MEAS_CFG] = MEAS_CFG_COEF_RDY | MEAS_CFG_SENSOR_RDY;
+    regs[REG_COEF_SRCE] = COEF_SRCE_EXT;
+    put_coefficients(&regs[REG_COEF]);
+}
+
+/// takes one measurement of the trajectory, into the result registers or the fifo
+void Device::measure(bool is_pressure)
+{
+    sensor_emul::Truth truth = sensor_emul::get_truth();
+    float t = temp_scaled(truth.temp_c + sensor_emul::noise(TEMP_NOISE_C));
+    int32_t result;
+    if (is_pressure) {
+        float kp = SCALE_FACTOR[regs[REG_PRS_CFG] & CFG_PRC_MASK];
+        float pa = truth.pressure_pa + sensor_emul::noise(PRESSURE_NOISE_PA);
+        result = saturate_result(pressure_scaled(pa, t) * kp);
+        sensor_emul::record_produced(sensor_emul::SENSOR_DPS310);
+    }
+    else {
+        result = saturate_result(t * SCALE_FACTOR[regs[REG_TMP_CFG] & CFG_PRC_MASK]);
+    }
+    uint64_t sample_us = sensor_emul::now_us();
+
+    if (is_fifo_enabled()) {
+        // a full fifo takes no more results
+        if (FIFO_SIZE == fifo_count) {
+            if (is_pressure) sensor_emul::record_dropped(sensor_emul::SENSOR_DPS310);
+            return;
+        }
+        result = is_pressure ? (result | RESULT_PRESSURE) : (result & ~RESULT_PRESSURE);
+        fifo[(fifo_head + fifo_count) % FIFO_SIZE] = {result, sample_us};
+        fifo_count++;
+    }
+    else if (is_pressure) {
+        if (is_pressure_unread) sensor_emul::record_dropped(sensor_emul::SENSOR_DPS310);
+        pressure = result;
+        pressure_us = sample_us;
+        is_pressure_unread = true;
+        meas_rdy |= MEAS_CFG_PRS_RDY;
+    }
+    else {
+        temp = result;
+        meas_rdy |= MEAS_CFG_TMP_RDY;
+    }
+}
+
+uint8_t Device::read(uint8_t reg)
+{
+    if (reg >= REG_PSR_B2 && reg <= REG_PSR_B0) {
+        int offset = reg - REG_PSR_B2;
+        if (is_fifo_enabled()) {
+            // reading psr_b2 pops one result
+            if (0 == offset) {
+                if (fifo_count) {
+                    const FifoEntry &entry = fifo[fifo_head];
+                    fifo_out = entry.result;
+                    if (entry.result & RESULT_PRESSURE) {
+                        sensor_emul::record_read(sensor_emul::SENSOR_DPS310, entry.sample_us);
+                    }
+                    fifo_head = (fifo_head + 1) % FIFO_SIZE;
+                    fifo_count--;
+                }
+                else {
+                    fifo_out = FIFO_EMPTY;
+                }
+            }
+            return get_result_byte(fifo_out, offset);
+        }
+        if (0 == offset) {
+            meas_rdy &= ~MEAS_CFG_PRS_RDY;
+            if (is_pressure_unread) {
+                is_pressure_unread = false;
+                sensor_emul::record_read(sensor_emul::SENSOR_DPS310, pressure_us);
+            }
+        }
+        return get_result_byte(pressure, offset);
+    }
+    if (reg >= REG_TMP_B2 && reg <= REG_TMP_B0) {
+        int offset = reg - REG_TMP_B2;
+        if (0 == offset) meas_rdy &= ~MEAS_CFG_TMP_RDY;
+        return get_result_byte(temp, offset);
+    }
+    if (REG_MEAS_CFG == reg) return regs[reg] | meas_rdy;
+    if (REG_FIFO_STS == reg) {
+        return (fifo_count ? 0 : FIFO_STS_EMPTY) | ((FIFO_SIZE == fifo_count) ? FIFO_STS_FULL : 0);
+    }
+    if (REG_INT_STS == reg) return 0;
+    return regs[reg % REG_COUNT];
+}
+
+void Device::write(uint8_t reg, uint8_t val)
+{
+    switch (reg) {
+    case REG_MEAS_CFG:
+        regs[reg] = (regs[reg] & ~MEAS_CFG_CTRL_MASK) | (val & MEAS_CFG_CTRL_MASK);
+        // command mode: one measurement, complete on the next read
+        if (MEAS_CTRL_PRS == (val & MEAS_CFG_CTRL_MASK)) measure(true);
+        if (MEAS_CTRL_TMP == (val & MEAS_CFG_CTRL_MASK)) measure(false);
+        update_timers(*this);
+        break;
+    case REG_RESET:
+        if (RESET_SOFT_RST == (val & RESET_SOFT_RST_MASK)) {
+            reset();
+            update_timers(*this);
+        }
+        else if (val & RESET_FIFO_FLUSH) {
+            fifo_count = 0;
+        }
+        break;
+    case REG_PRS_CFG:
+    case REG_TMP_CFG:
+        regs[reg] = val;
+        update_timers(*this);
+        break;
+    case REG_CFG_REG:
+        regs[reg] = val;
+        if (!is_fifo_enabled()) fifo_count = 0;
+        break;
+    case REG_FIFO_STS:
+    case REG_INT_STS:
+    case REG_PRODUCT_ID:
+    case REG_COEF_SRCE:
+        break; // read only
+    default:
+        // result & coefficient registers are read only; the driver's undocumented writes land
+        if ((reg > REG_TMP_B0) && (reg < REG_COEF || reg >= REG_COEF + 18) && reg < REG_COUNT) {
+            regs[reg] = val;
+        }
+        break;
+    }
+}
+
+static void pressure_timer_handler(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    s_device.measure(true);
+    k_spin_unlock(&s_lock, key);
+}
+
+static void temp_timer_handler(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    s_device.measure(false);
+    k_spin_unlock(&s_lock, key);
+}
+
+static int transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr)
+{
+    ARG_UNUSED(emul);
+    ARG_UNUSED(addr);
+
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    int err = sensor_emul::transfer_registers(s_device, msgs, num_msgs);
+    k_spin_unlock(&s_lock, key);
+    return err;
+}
+
+static const struct i2c_emul_api s_i2c_emul_api = {
+    .transfer = transfer,
+};
+
+static int emul_init(const struct emul *emul, const struct device *parent)
+{
+    s_device.reset();
+    s_i2c_emul.api = &s_i2c_emul_api;
+    s_i2c_emul.addr = DT_REG_ADDR(DPS310_NODE);
+    return i2c_emul_register(parent, emul->dev_label, &s_i2c_emul);
+}
+
+EMUL_DEFINE(emul_init, DPS310_NODE, NULL)
+
+#endif // DT_NODE_HAS_STATUS(DPS310_NODE, okay)
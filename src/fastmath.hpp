@@ -0,0 +1,144 @@
+/**
+ * @file		fastmath.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only fast math approximations
+ *
+ * Branch-light float approximations for the hot paths, in place of newlib's libm calls. Each
+ * function's max error over its stated domain is the *_MAX_ERROR constant declared with it, as
+ * checked by zqr bench fastmath (exhaustive over the mantissas for inv_sqrt, sweeps for the rest).
+ *
+ *
+ */
+
+#ifndef __FASTMATH_H
+#define __FASTMATH_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace z_quad_rotor {
+
+namespace fastmath {
+
+constexpr float PI = 3.14159265358979f;
+constexpr float PI_OVER_2 = PI / 2.0f;
+
+/// Reinterprets float bits as an integer (and back) without aliasing issues
+static inline int32_t float_to_bits(float val)
+{
+    int32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+static inline float bits_to_float(int32_t bits)
+{
+    float val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+/// 1 / sqrt(x) for normal x > 0: bit-level initial guess and one Newton step, with the magic
+/// constant and step coefficients tuned together for minimax relative error.
+static constexpr float INV_SQRT_MAX_ERROR = 8.9e-4f; // relative
+static inline float inv_sqrt(float x)
+{
+    float y = bits_to_float(0x5f37776c - (float_to_bits(x) >> 1));
+    return y * (1.50045049f - 0.49956912f * x * y * y);
+}
+
+/// inv_sqrt with a second (classic) Newton step, for normalizations whose result is fed back
+/// (e.g. the fusion quaternion), where the first step's error would compound.
+static constexpr float INV_SQRT_REFINED_MAX_ERROR = 1.4e-6f; // relative
+static inline float inv_sqrt_refined(float x)
+{
+    float y = inv_sqrt(x);
+    return y * (1.5f - 0.5f * x * y * y);
+}
+
+/// atan(x) for |x| <= 1; odd minimax polynomial (error as atan2)
+static inline float atan_unit(float x)
+{
+    float x2 = x * x;
+    return x * (0.99997726f +
+                x2 * (-0.33262347f +
+                      x2 * (0.19354346f + x2 * (-0.11643287f +
+                                                x2 * (0.05265332f + x2 * -0.01172120f)))));
+}
+
+/// atan2(y, x), full circle, atan2(0, 0) == 0.
+static constexpr float ATAN2_MAX_ERROR = 2.0e-6f; // rad
+static inline float atan2(float y, float x)
+{
+    float abs_x = (x < 0.0f) ? -x : x;
+    float abs_y = (y < 0.0f) ? -y : y;
+    if (abs_x == 0.0f && abs_y == 0.0f) return 0.0f;
+
+    // reduce to |ratio| <= 1, so only one division is needed
+    bool swap = abs_y > abs_x;
+    float angle = swap ? (PI_OVER_2 - atan_unit(abs_x / abs_y)) : atan_unit(abs_y / abs_x);
+    if (x < 0.0f) angle = PI - angle;
+    return (y < 0.0f) ? -angle : angle;
+}
+
+/// asin(x) for |x| <= 1 (clamped outside); pi/2 - sqrt(1 - x) * P(x)
+/// (Abramowitz & Stegun 4.4.45).
+static constexpr float ASIN_MAX_ERROR = 7.2e-5f; // rad
+static inline float asin(float x)
+{
+    float abs_x = (x < 0.0f) ? -x : x;
+    if (abs_x > 1.0f) abs_x = 1.0f;
+    float one_minus = 1.0f - abs_x;
+    // sqrt(t) == t / sqrt(t); refined, as the root is scaled up by P(x) ~ pi / 2
+    float root = (one_minus > 0.0f) ? one_minus * inv_sqrt_refined(one_minus) : 0.0f;
+    float angle = PI_OVER_2 -
+                  root * (1.5707288f + abs_x * (-0.2121144f + abs_x * (0.0742610f +
+                                                                       abs_x * -0.0187293f)));
+    return (x < 0.0f) ? -angle : angle;
+}
+
+/// log2(x) for normal x > 0; exponent from the float bits, mantissa reduced to [sqrt(1/2),
+/// sqrt(2)) and expanded as the atanh series in s = (m - 1) / (m + 1).
+/// Absolute error bound holds for x in [1/16, 16) (beyond that, the result's rounding dominates)
+static constexpr float LOG2_MAX_ERROR = 2.4e-7f;
+static inline float log2(float x)
+{
+    int32_t bits = float_to_bits(x);
+    // re-center the mantissa around 1 (exponent moves by one for m >= sqrt(2))
+    int32_t exponent = ((bits - 0x3f3504f3) >> 23);
+    float m = bits_to_float(bits - (int32_t)((uint32_t)exponent << 23));
+    float s = (m - 1.0f) / (m + 1.0f);
+    float s2 = s * s;
+    // 2 / ln(2) * (s + s^3/3 + s^5/5 + s^7/7)
+    float series =
+        s * (2.88539008f + s2 * (0.96179669f + s2 * (0.57707801f + s2 * 0.41219858f)));
+    return (float)exponent + series;
+}
+
+/// 2^x for -125 <= x < 127; integer part into the exponent bits, fraction in [-0.5, 0.5] by
+/// Taylor series of e^(f ln 2).
+static constexpr float EXP2_MAX_ERROR = 2.6e-7f; // relative
+static inline float exp2(float x)
+{
+    float rounded = (float)(int32_t)(x + ((x < 0.0f) ? -0.5f : 0.5f));
+    float f = (x - rounded) * 0.69314718f;
+    float poly =
+        1.0f +
+        f * (1.0f +
+             f * (0.5f +
+                  f * (0.16666667f + f * (0.04166667f + f * (0.00833333f + f * 0.00138889f)))));
+    return bits_to_float(float_to_bits(poly) + (int32_t)((uint32_t)(int32_t)rounded << 23));
+}
+
+/// x^y for normal x > 0 via exp2(y * log2(x)); accuracy holds while |y * log2(x)| is small, as
+/// in the barometric formula (y = 0.19, x = p / p0 in [0.3, 1.2]).
+static constexpr float POW_BARO_MAX_ERROR = 8.5e-8f; // relative (3.8 mm of altitude)
+static inline float pow(float x, float y)
+{
+    return exp2(y * log2(x));
+}
+
+} // namespace fastmath
+
+} // namespace z_quad_rotor
+
+#endif // __FASTMATH_H
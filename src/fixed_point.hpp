@@ -0,0 +1,120 @@
+/**
+ * @file		fixed_point.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only Q-format fixed point scalar
+ *
+ * Signed 32 bit fixed point number with FRAC fractional bits (Q(31-FRAC).FRAC). Products and
+ * quotients are computed in 64 bits and rounded. Arithmetic does not saturate -- callers are
+ * responsible for keeping values within range (+/- 2^(31-FRAC)).
+ *
+ *
+ */
+
+#ifndef __FIXED_POINT_H
+#define __FIXED_POINT_H
+
+#include <cstdint>
+
+namespace z_quad_rotor {
+
+/// Integer square root (bitwise, no division), rounded down
+static inline uint32_t isqrt(uint64_t val)
+{
+    uint64_t root = 0;
+    uint64_t bit = uint64_t(1) << 62;
+    while (bit > val) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (val >= root + bit) {
+            val -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+/// Q-format fixed point scalar (int32 storage, FRAC fractional bits)
+template <int FRAC>
+class Fixed {
+    static_assert(FRAC > 0 && FRAC < 32, "Invalid fraction bits");
+
+  public:
+    /// Raw value of 1.0
+    static constexpr int64_t ONE = int64_t(1) << FRAC;
+
+    constexpr Fixed() : m_raw(0) {}
+    /// Conversions are implicit so that literals mix with fixed point operands (folded at compile
+    /// time for constants)
+    constexpr Fixed(int val) : m_raw((int32_t)(val * ONE)) {}
+    constexpr Fixed(float val) : m_raw(round_to_raw(val * (float)ONE)) {}
+    constexpr Fixed(double val) : m_raw(round_to_raw(val * (double)ONE)) {}
+
+    /// Constructs directly from the raw (scaled) value
+    static constexpr Fixed from_raw(int32_t raw) { return Fixed(raw, RawTag()); }
+    constexpr int32_t raw() const { return m_raw; }
+
+    constexpr explicit operator float() const { return m_raw / (float)ONE; }
+    constexpr explicit operator double() const { return m_raw / (double)ONE; }
+
+    // arithmetic
+    friend constexpr Fixed operator+(Fixed a, Fixed b) { return from_raw(a.m_raw + b.m_raw); }
+    friend constexpr Fixed operator-(Fixed a, Fixed b) { return from_raw(a.m_raw - b.m_raw); }
+    friend constexpr Fixed operator-(Fixed a) { return from_raw(-a.m_raw); }
+    friend constexpr Fixed operator+(Fixed a) { return a; }
+    friend constexpr Fixed operator*(Fixed a, Fixed b)
+    {
+        return from_raw((int32_t)(((int64_t)a.m_raw * b.m_raw + (ONE >> 1)) >> FRAC));
+    }
+    /// @note Division by zero yields zero
+    friend constexpr Fixed operator/(Fixed a, Fixed b)
+    {
+        return b.m_raw ? from_raw((int32_t)(((int64_t)a.m_raw << FRAC) / b.m_raw)) : Fixed();
+    }
+    friend Fixed &operator+=(Fixed &a, Fixed b) { return a = a + b; }
+    friend Fixed &operator-=(Fixed &a, Fixed b) { return a = a - b; }
+    friend Fixed &operator*=(Fixed &a, Fixed b) { return a = a * b; }
+    friend Fixed &operator/=(Fixed &a, Fixed b) { return a = a / b; }
+
+    // comparison
+    friend constexpr bool operator==(Fixed a, Fixed b) { return a.m_raw == b.m_raw; }
+    friend constexpr bool operator!=(Fixed a, Fixed b) { return a.m_raw != b.m_raw; }
+    friend constexpr bool operator<(Fixed a, Fixed b) { return a.m_raw < b.m_raw; }
+    friend constexpr bool operator>(Fixed a, Fixed b) { return a.m_raw > b.m_raw; }
+    friend constexpr bool operator<=(Fixed a, Fixed b) { return a.m_raw <= b.m_raw; }
+    friend constexpr bool operator>=(Fixed a, Fixed b) { return a.m_raw >= b.m_raw; }
+
+    /// Square root; negative values yield zero
+    static Fixed sqrt(Fixed a)
+    {
+        // sqrt(raw / 2^FRAC) * 2^FRAC == sqrt(raw * 2^FRAC)
+        return (a.m_raw > 0) ? from_raw((int32_t)isqrt((uint64_t)a.m_raw << FRAC)) : Fixed();
+    }
+
+  private:
+    struct RawTag {
+    };
+    constexpr Fixed(int32_t raw, RawTag) : m_raw(raw) {}
+
+    template <class F>
+    static constexpr int32_t round_to_raw(F scaled)
+    {
+        return (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+    }
+
+    int32_t m_raw;
+};
+
+/// Q7.24 -- +/- 128 range, ~6e-8 resolution; covers unit quaternions, normalized vectors, and
+/// rad/s rates with headroom for the fusion intermediates
+using Q24 = Fixed<24>;
+/// Q0.31 -- (-1, 1) range; used for raw count scale factors, which are tiny
+using Q31 = Fixed<31>;
+
+} // namespace z_quad_rotor
+
+#endif // __FIXED_POINT_H
@@ -8,63 +8,196 @@
 
 #include "fusion.hpp"
 
+#include <cmath>
 #include <math.h>
 #include <stdlib.h>
 
 #include "linalg.h"
+#include "linalg_kernels.h"
+
+#include "scalar_traits.hpp"
 
 using namespace z_quad_rotor;
 
 // constants
-constexpr float BETA = 0.041f;
+constexpr double BETA = 0.041;
+constexpr double MAHONY_TWO_KP = 2.0 * 0.5;          // proportional gain (x2, errors are halved)
+constexpr double MAHONY_TWO_KI = 2.0 * 0.1;          // integral gain (x2); bias convergence
+constexpr double MAHONY_BIAS_LIMIT = 0.35;           // rad/s (20 dps); integral anti-windup
+constexpr double STANDARD_GRAVITY = 9.80665;         // m/s^2
+constexpr double ESKF_GYRO_NOISE = 0.006;            // rad/s (FXAS21002: 0.025 dps/rtHz, ~200 Hz)
+constexpr double ESKF_GYRO_BIAS_WALK = 0.0002;       // (rad/s)/rt(s)
+constexpr double ESKF_ACCEL_VAR = 0.05 * 0.05;       // normalized accel direction (incl. vibration)
+constexpr double ESKF_MAGN_VAR = 0.1 * 0.1;          // normalized magn direction
+constexpr double ESKF_ACCEL_GATE = 0.15;             // accel observed while |a| within 15% of 1 g
+constexpr double ESKF_INIT_ATTITUDE_VAR = 0.1 * 0.1; // rad^2
+constexpr double ESKF_INIT_BIAS_VAR = 0.05 * 0.05;   // (rad/s)^2
 
 // private function declarations
-static bool try_normalize(linalg::vec<float, 3> &vec3);
+template <class S, int M>
+static bool try_normalize(linalg::vec<S, M> &vec);
+template <class S, int M>
+static linalg::vec<S, M> scale(const linalg::vec<S, M> &vec, S factor);
+template <class S>
+static QuaternionT<S> gyro_rate(const QuaternionT<S> &quat, const linalg::vec<S, 3> &gyro);
+template <class S>
+static void mahony_feedback(linalg::vec<S, 3> &gyro, const linalg::vec<S, 3> &half_error, S dt,
+                            linalg::vec<S, 3> &integral);
+template <class S>
+static void integrate_gyro(const linalg::vec<S, 3> &gyro, QuaternionT<S> &quat, S dt);
+template <class S>
+static void eskf_init(linalg::kernels::sym6_blocks<S> &cov);
+template <class S>
+static void eskf_propagate(const linalg::vec<S, 3> &gyro, S dt, QuaternionT<S> &quat,
+                           linalg::kernels::sym6_blocks<S> &cov);
+template <class S>
+static bool eskf_accel_valid(linalg::vec<S, 3> &accel);
+template <class S>
+static void eskf_observe(const linalg::vec<S, 3> &measured, const linalg::vec<S, 3> &predicted,
+                         S variance, linalg::kernels::sym6_blocks<S> &cov,
+                         linalg::vec<S, 3> &dtheta, linalg::vec<S, 3> &dbias);
+template <class S>
+static void eskf_inject(const linalg::vec<S, 3> &dtheta, const linalg::vec<S, 3> &dbias,
+                        QuaternionT<S> &quat, linalg::vec<S, 3> &bias);
 
 // private function definitions
-static bool try_normalize(linalg::vec<float, 3> &vec3)
-{
-    // find magnitude
-    float length = linalg::length(vec3);
-    // fail on nan
-    if (0.0f == length) return false;
-    // valid normalization -- perform op and return success
-    float norm = 1.0f / length;
-    vec3 *= norm;
+template <class S, int M>
+static bool try_normalize(linalg::vec<S, M> &vec)
+{
+    // fails on a zero length vec
+    return ScalarTraits<S>::try_normalize(vec);
+}
+
+/// vec * factor (linalg only broadcasts arithmetic scalars)
+template <class S, int M>
+static linalg::vec<S, M> scale(const linalg::vec<S, M> &vec, S factor)
+{
+    return vec * linalg::vec<S, M>(factor);
+}
+
+/// rate of change of quaternion from gyroscope (0.5 * quat (x) gyro)
+template <class S>
+static QuaternionT<S> gyro_rate(const QuaternionT<S> &quat, const linalg::vec<S, 3> &gyro)
+{
+    QuaternionT<S> q_dot(quat.w * gyro.x + quat.y * gyro.z - quat.z * gyro.y,
+                         quat.w * gyro.y - quat.x * gyro.z + quat.z * gyro.x,
+                         quat.w * gyro.z + quat.x * gyro.y - quat.y * gyro.x,
+                         -quat.x * gyro.x - quat.y * gyro.y - quat.z * gyro.z);
+    return scale(q_dot, S(0.5f));
+}
+
+/// applies Mahony PI feedback of half_error to gyro; integral accumulates the (negated) bias
+template <class S>
+static void mahony_feedback(linalg::vec<S, 3> &gyro, const linalg::vec<S, 3> &half_error, S dt,
+                            linalg::vec<S, 3> &integral)
+{
+    const S limit = S(MAHONY_BIAS_LIMIT);
+    integral += scale(half_error, S(MAHONY_TWO_KI) * dt);
+    for (int i = 0; i < 3; i++) {
+        if (integral[i] > limit) integral[i] = limit;
+        if (integral[i] < -limit) integral[i] = -limit;
+    }
+    gyro += integral + scale(half_error, S(MAHONY_TWO_KP));
+}
+
+/// integrates the (corrected) gyro rate into quat
+template <class S>
+static void integrate_gyro(const linalg::vec<S, 3> &gyro, QuaternionT<S> &quat, S dt)
+{
+    quat += scale(gyro_rate(quat, gyro), dt);
+    // normalize
+    try_normalize(quat);
+}
+
+/// sets the initial error state covariance (attitude & bias uncorrelated)
+template <class S>
+static void eskf_init(linalg::kernels::sym6_blocks<S> &cov)
+{
+    cov.a = linalg::mat<S, 3, 3>(linalg::identity) * S(ESKF_INIT_ATTITUDE_VAR);
+    cov.b = linalg::mat<S, 3, 3>();
+    cov.c = linalg::mat<S, 3, 3>(linalg::identity) * S(ESKF_INIT_BIAS_VAR);
+}
+
+/// integrates the (bias corrected) gyro rate into quat & propagates the error covariance
+template <class S>
+static void eskf_propagate(const linalg::vec<S, 3> &gyro, S dt, QuaternionT<S> &quat,
+                           linalg::kernels::sym6_blocks<S> &cov)
+{
+    integrate_gyro(gyro, quat, dt);
+
+    // attitude error transition is I - [gyro x] dt, driven by -bias error dt
+    const linalg::mat<S, 3, 3> rot_error =
+        linalg::mat<S, 3, 3>(linalg::identity) - linalg::kernels::skew(gyro) * dt;
+    linalg::kernels::propagate_rotation_bias(cov, rot_error, dt);
+    linalg::kernels::add_diagonal(
+        cov, linalg::vec<S, 3>(S(ESKF_GYRO_NOISE * ESKF_GYRO_NOISE) * dt * dt),
+        linalg::vec<S, 3>(S(ESKF_GYRO_BIAS_WALK * ESKF_GYRO_BIAS_WALK) * dt));
+}
+
+/// normalizes accel; returns false if nan occurs or while accelerating away from 1 g
+template <class S>
+static bool eskf_accel_valid(linalg::vec<S, 3> &accel)
+{
+    S length = ScalarTraits<S>::length(accel);
+    if (std::abs(length - S(STANDARD_GRAVITY)) > S(ESKF_ACCEL_GATE * STANDARD_GRAVITY)) {
+        return false;
+    }
+    ScalarTraits<S>::normalize(accel, length);
     return true;
 }
 
+/// observes a measured direction against its prediction (body frame, both unit length); the
+/// jacobian wrt attitude error is [predicted x], each axis is a sequential scalar update
+template <class S>
+static void eskf_observe(const linalg::vec<S, 3> &measured, const linalg::vec<S, 3> &predicted,
+                         S variance, linalg::kernels::sym6_blocks<S> &cov,
+                         linalg::vec<S, 3> &dtheta, linalg::vec<S, 3> &dbias)
+{
+    const linalg::mat<S, 3, 3> jacobian = linalg::kernels::skew(predicted);
+    for (int i = 0; i < 3; i++) {
+        linalg::kernels::scalar_update(cov, jacobian.row(i), variance, measured[i] - predicted[i],
+                                       dtheta, dbias);
+    }
+}
+
+/// folds the error state into the nominal attitude & bias (error state is reset to zero)
+template <class S>
+static void eskf_inject(const linalg::vec<S, 3> &dtheta, const linalg::vec<S, 3> &dbias,
+                        QuaternionT<S> &quat, linalg::vec<S, 3> &bias)
+{
+    quat = linalg::qmul(quat, QuaternionT<S>(dtheta * S(0.5), S(1)));
+    try_normalize(quat);
+    bias += dbias;
+}
+
 // fusion implementations
-void MadgwickFusion6::update(MargDataFloat marg_data, Quaternion &quat, uint32_t time_diff_ms) const
+template <class S>
+void MadgwickFusion6T<S>::update(MargDataT<S> marg_data, QuaternionT<S> &quat,
+                                 uint32_t time_diff_us) const
 {
     // rate of change of quaternion from gyroscope
-    Quaternion q_dot(
-        quat.w * marg_data.gyro.x + quat.y * marg_data.gyro.z - quat.z * marg_data.gyro.y,
-        quat.w * marg_data.gyro.y - quat.x * marg_data.gyro.z + quat.z * marg_data.gyro.x,
-        quat.w * marg_data.gyro.z + quat.x * marg_data.gyro.y - quat.y * marg_data.gyro.x,
-        -quat.x * marg_data.gyro.x - quat.y * marg_data.gyro.y - quat.z * marg_data.gyro.z);
-    q_dot *= 0.5f;
+    QuaternionT<S> q_dot = gyro_rate(quat, marg_data.gyro);
 
     // normalize accel
     if (!try_normalize(marg_data.accel)) return; // skip iteration if nan occurs
 
     // pre-compute repeated operands
-    float qw_2 = 2.0f * quat.w;
-    float qx_2 = 2.0f * quat.x;
-    float qy_2 = 2.0f * quat.y;
-    float qz_2 = 2.0f * quat.z;
-    float qw_4 = 4.0f * quat.w;
-    float qx_4 = 4.0f * quat.x;
-    float qy_4 = 4.0f * quat.y;
-    float qx_8 = 8.0f * quat.x;
-    float qy_8 = 8.0f * quat.y;
-    float qw_qw = quat.w * quat.w;
-    float qx_qx = quat.x * quat.x;
-    float qy_qy = quat.y * quat.y;
-    float qz_qz = quat.z * quat.z;
+    S qw_2 = 2.0f * quat.w;
+    S qx_2 = 2.0f * quat.x;
+    S qy_2 = 2.0f * quat.y;
+    S qz_2 = 2.0f * quat.z;
+    S qw_4 = 4.0f * quat.w;
+    S qx_4 = 4.0f * quat.x;
+    S qy_4 = 4.0f * quat.y;
+    S qx_8 = 8.0f * quat.x;
+    S qy_8 = 8.0f * quat.y;
+    S qw_qw = quat.w * quat.w;
+    S qx_qx = quat.x * quat.x;
+    S qy_qy = quat.y * quat.y;
+    S qz_qz = quat.z * quat.z;
 
     // gradient decent algorithm corrective step
-    Quaternion step(
+    QuaternionT<S> step(
         qx_4 * qz_qz - qz_2 * marg_data.accel.x + 4.0f * qw_qw * quat.x - qw_2 * marg_data.accel.y -
             qx_4 + qx_8 * qx_qx + qx_8 * qy_qy + qx_4 * marg_data.accel.z,
         4.0f * qw_qw * quat.y + qw_2 * marg_data.accel.x + qy_4 * qz_qz - qz_2 * marg_data.accel.y -
@@ -73,114 +206,229 @@ void MadgwickFusion6::update(MargDataFloat marg_data, Quaternion &quat, uint32_t
             qy_2 * marg_data.accel.y,
         qw_4 * qy_qy + qy_2 * marg_data.accel.x + qw_4 * qx_qx - qx_2 * marg_data.accel.y);
     // normalize
-    float norm = 1.0f / linalg::length(step);
-    step *= norm;
+    try_normalize(step); // zero step (already converged) -- no correction
 
     // apply feedback step
-    q_dot -= BETA * step;
+    q_dot -= scale(step, S(BETA));
     // integrate rate of change of quaternion to yield quaternion
-    quat += q_dot * (time_diff_ms * 0.001f);
+    quat += scale(q_dot, ScalarTraits<S>::from_micros(time_diff_us));
     // normalize
-    norm = 1.0f / linalg::length(quat);
-    quat *= norm;
+    try_normalize(quat);
 }
 
-void MadgwickFusion9::update(MargDataFloat marg_data, Quaternion &quat, uint32_t time_diff_ms) const
+template <class S>
+void MadgwickFusion9T<S>::update(MargDataT<S> marg_data, QuaternionT<S> &quat,
+                                 uint32_t time_diff_us) const
 {
     // rate of change of quaternion from gyroscope
-    Quaternion q_dot(
-        quat.w * marg_data.gyro.x + quat.y * marg_data.gyro.z - quat.z * marg_data.gyro.y,
-        quat.w * marg_data.gyro.y - quat.x * marg_data.gyro.z + quat.z * marg_data.gyro.x,
-        quat.w * marg_data.gyro.z + quat.x * marg_data.gyro.y - quat.y * marg_data.gyro.x,
-        -quat.x * marg_data.gyro.x - quat.y * marg_data.gyro.y - quat.z * marg_data.gyro.z);
-    q_dot *= 0.5f;
+    QuaternionT<S> q_dot = gyro_rate(quat, marg_data.gyro);
 
     // normalize accel and mag
     if (!try_normalize(marg_data.accel)) return; // skip iteration if nan occurs
     if (!try_normalize(marg_data.magn)) return;  // skip iteration if nan occurs
 
     // pre-compute repeated operands
-    float qw_mx_2 = 2.0f * quat.w * marg_data.magn.x;
-    float qw_my_2 = 2.0f * quat.w * marg_data.magn.y;
-    float qw_mz_2 = 2.0f * quat.w * marg_data.magn.z;
-    float qx_mx_2 = 2.0f * quat.x * marg_data.magn.x;
-    float qw_2 = 2.0f * quat.w;
-    float qx_2 = 2.0f * quat.x;
-    float qy_2 = 2.0f * quat.y;
-    float qz_2 = 2.0f * quat.z;
-    float qw_qy_2 = 2.0f * quat.w * quat.y;
-    float qy_qz_2 = 2.0f * quat.y * quat.z;
-    float qw_qw = quat.w * quat.w;
-    float qw_qx = quat.w * quat.x;
-    float qw_qy = quat.w * quat.y;
-    float qw_qz = quat.w * quat.z;
-    float qx_qx = quat.x * quat.x;
-    float qx_qy = quat.x * quat.y;
-    float qx_qz = quat.x * quat.z;
-    float qy_qy = quat.y * quat.y;
-    float qy_qz = quat.y * quat.z;
-    float qz_qz = quat.z * quat.z;
+    const linalg::vec<S, 3> &a = marg_data.accel;
+    const linalg::vec<S, 3> &m = marg_data.magn;
+    S qw_mx_2 = 2.0f * quat.w * m.x;
+    S qw_my_2 = 2.0f * quat.w * m.y;
+    S qw_mz_2 = 2.0f * quat.w * m.z;
+    S qx_mx_2 = 2.0f * quat.x * m.x;
+    S qw_2 = 2.0f * quat.w;
+    S qx_2 = 2.0f * quat.x;
+    S qy_2 = 2.0f * quat.y;
+    S qz_2 = 2.0f * quat.z;
+    S qw_qy_2 = 2.0f * quat.w * quat.y;
+    S qy_qz_2 = 2.0f * quat.y * quat.z;
+    S qw_qw = quat.w * quat.w;
+    S qw_qx = quat.w * quat.x;
+    S qw_qy = quat.w * quat.y;
+    S qw_qz = quat.w * quat.z;
+    S qx_qx = quat.x * quat.x;
+    S qx_qy = quat.x * quat.y;
+    S qx_qz = quat.x * quat.z;
+    S qy_qy = quat.y * quat.y;
+    S qy_qz = quat.y * quat.z;
+    S qz_qz = quat.z * quat.z;
 
     // reference direction of Earth's magnetic field
-    float hx = marg_data.magn.x * qw_qw - qw_my_2 * quat.z + qw_mz_2 * quat.y +
-               marg_data.magn.x * qx_qx + qx_2 * marg_data.magn.y * quat.y +
-               qx_2 * marg_data.magn.z * quat.z - marg_data.magn.x * qy_qy -
-               marg_data.magn.x * qz_qz;
-    float hy = qw_mx_2 * quat.z + marg_data.magn.y * qw_qw - qw_mz_2 * quat.x + qx_mx_2 * quat.y -
-               marg_data.magn.y * qx_qx + marg_data.magn.y * qy_qy +
-               qy_2 * marg_data.magn.z * quat.z - marg_data.magn.y * qz_qz;
-    float bx_2 = sqrt(hx * hx + hy * hy);
-    float bz_2 = -qw_mx_2 * quat.y + qw_my_2 * quat.x + marg_data.magn.z * qw_qw +
-                 qx_mx_2 * quat.z - marg_data.magn.z * qx_qx + qy_2 * marg_data.magn.y * quat.z -
-                 marg_data.magn.z * qy_qy + marg_data.magn.z * qz_qz;
-    float bx_4 = 2.0f * bx_2;
-    float bz_4 = 2.0f * bz_2;
+    S hx = m.x * qw_qw - qw_my_2 * quat.z + qw_mz_2 * quat.y + m.x * qx_qx +
+           qx_2 * m.y * quat.y + qx_2 * m.z * quat.z - m.x * qy_qy - m.x * qz_qz;
+    S hy = qw_mx_2 * quat.z + m.y * qw_qw - qw_mz_2 * quat.x + qx_mx_2 * quat.y - m.y * qx_qx +
+           m.y * qy_qy + qy_2 * m.z * quat.z - m.y * qz_qz;
+    S bx_2 = ScalarTraits<S>::sqrt(hx * hx + hy * hy);
+    S bz_2 = -qw_mx_2 * quat.y + qw_my_2 * quat.x + m.z * qw_qw + qx_mx_2 * quat.z -
+             m.z * qx_qx + qy_2 * m.y * quat.z - m.z * qy_qy + m.z * qz_qz;
+    S bx_4 = 2.0f * bx_2;
+    S bz_4 = 2.0f * bz_2;
 
-    // gradient decent algorithm corrective step
-    float sw =
-        -qy_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
-        qx_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) -
-        bz_2 * quat.y *
-            (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
-        (-bx_2 * quat.z + bz_2 * quat.x) *
-            (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
-        bx_2 * quat.y * (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
-    float sx = qz_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
-               qw_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) -
-               4.0f * quat.x * (1 - 2.0f * qx_qx - 2.0f * qy_qy - marg_data.accel.z) +
-               bz_2 * quat.z *
-                   (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
-               (bx_2 * quat.y + bz_2 * quat.w) *
-                   (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
-               (bx_2 * quat.z - bz_4 * quat.x) *
-                   (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
-    float sy = -qw_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
-               qz_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) -
-               4.0f * quat.y * (1 - 2.0f * qx_qx - 2.0f * qy_qy - marg_data.accel.z) +
-               (-bx_4 * quat.y - bz_2 * quat.w) *
-                   (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
-               (bx_2 * quat.x + bz_2 * quat.z) *
-                   (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
-               (bx_2 * quat.w - bz_4 * quat.y) *
-                   (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
-    float sz =
-        qx_2 * (2.0f * qx_qz - qw_qy_2 - marg_data.accel.x) +
-        qy_2 * (2.0f * qw_qx + qy_qz_2 - marg_data.accel.y) +
-        (-bx_4 * quat.z + bz_2 * quat.x) *
-            (bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - marg_data.magn.x) +
-        (-bx_2 * quat.w + bz_2 * quat.y) *
-            (bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - marg_data.magn.y) +
-        bx_2 * quat.x * (bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - marg_data.magn.z);
+    // objective function: estimated minus measured direction of gravity (f_g) and of Earth's
+    // magnetic field (f_b), each residual computed once
+    const linalg::vec<S, 3> f_g(2.0f * qx_qz - qw_qy_2 - a.x, 2.0f * qw_qx + qy_qz_2 - a.y,
+                                1 - 2.0f * qx_qx - 2.0f * qy_qy - a.z);
+    const linalg::vec<S, 3> f_b(bx_2 * (0.5f - qy_qy - qz_qz) + bz_2 * (qx_qz - qw_qy) - m.x,
+                                bx_2 * (qx_qy - qw_qz) + bz_2 * (qw_qx + qy_qz) - m.y,
+                                bx_2 * (qw_qy + qx_qz) + bz_2 * (0.5f - qx_qx - qy_qy) - m.z);
+
+    // gradient decent algorithm corrective step: J_g^T * f_g + J_b^T * f_b, one row of the
+    // jacobian transpose per quaternion component (structural zeros of J_g skipped)
+    S sw = -qy_2 * f_g.x + qx_2 * f_g.y - bz_2 * quat.y * f_b.x +
+           (-bx_2 * quat.z + bz_2 * quat.x) * f_b.y + bx_2 * quat.y * f_b.z;
+    S sx = qz_2 * f_g.x + qw_2 * f_g.y - 4.0f * quat.x * f_g.z + bz_2 * quat.z * f_b.x +
+           (bx_2 * quat.y + bz_2 * quat.w) * f_b.y + (bx_2 * quat.z - bz_4 * quat.x) * f_b.z;
+    S sy = -qw_2 * f_g.x + qz_2 * f_g.y - 4.0f * quat.y * f_g.z +
+           (-bx_4 * quat.y - bz_2 * quat.w) * f_b.x + (bx_2 * quat.x + bz_2 * quat.z) * f_b.y +
+           (bx_2 * quat.w - bz_4 * quat.y) * f_b.z;
+    S sz = qx_2 * f_g.x + qy_2 * f_g.y + (-bx_4 * quat.z + bz_2 * quat.x) * f_b.x +
+           (-bx_2 * quat.w + bz_2 * quat.y) * f_b.y + bx_2 * quat.x * f_b.z;
     // normalize
-    Quaternion step(sx, sy, sz, sw);
-    float norm = 1.0f / linalg::length(step);
-    step *= norm;
+    QuaternionT<S> step(sx, sy, sz, sw);
+    try_normalize(step); // zero step (already converged) -- no correction
 
     // apply feedback step
-    q_dot -= BETA * step;
+    q_dot -= scale(step, S(BETA));
     // integrate rate of change of quaternion to yield quaternion
-    quat += q_dot * (time_diff_ms * 0.001f);
+    quat += scale(q_dot, ScalarTraits<S>::from_micros(time_diff_us));
     // normalize
-    norm = 1.0f / linalg::length(quat);
-    quat *= norm;
+    try_normalize(quat);
+}
+
+template <class S>
+void MahonyFusion6T<S>::update(MargDataT<S> marg_data, QuaternionT<S> &quat,
+                               uint32_t time_diff_us)
+{
+    const S dt = ScalarTraits<S>::from_micros(time_diff_us);
+
+    // normalize accel; gyro only if nan occurs
+    if (try_normalize(marg_data.accel)) {
+        // estimated direction of gravity (halved)
+        linalg::vec<S, 3> half_v(quat.x * quat.z - quat.w * quat.y,
+                                 quat.w * quat.x + quat.y * quat.z,
+                                 quat.w * quat.w - 0.5f + quat.z * quat.z);
+        // error is the cross product between estimated and measured direction of gravity
+        mahony_feedback(marg_data.gyro, linalg::cross(marg_data.accel, half_v), dt, m_integral);
+    }
+
+    integrate_gyro(marg_data.gyro, quat, dt);
+}
+
+template <class S>
+void MahonyFusion9T<S>::update(MargDataT<S> marg_data, QuaternionT<S> &quat,
+                               uint32_t time_diff_us)
+{
+    const S dt = ScalarTraits<S>::from_micros(time_diff_us);
+
+    // normalize accel and mag; gyro only if nan occurs
+    if (try_normalize(marg_data.accel) && try_normalize(marg_data.magn)) {
+        // pre-compute repeated operands
+        S qw_qx = quat.w * quat.x;
+        S qw_qy = quat.w * quat.y;
+        S qw_qz = quat.w * quat.z;
+        S qx_qx = quat.x * quat.x;
+        S qx_qy = quat.x * quat.y;
+        S qx_qz = quat.x * quat.z;
+        S qy_qy = quat.y * quat.y;
+        S qy_qz = quat.y * quat.z;
+        S qz_qz = quat.z * quat.z;
+        const linalg::vec<S, 3> &m = marg_data.magn;
+
+        // reference direction of Earth's magnetic field
+        S hx = 2.0f *
+               (m.x * (0.5f - qy_qy - qz_qz) + m.y * (qx_qy - qw_qz) + m.z * (qx_qz + qw_qy));
+        S hy = 2.0f *
+               (m.x * (qx_qy + qw_qz) + m.y * (0.5f - qx_qx - qz_qz) + m.z * (qy_qz - qw_qx));
+        S bx = ScalarTraits<S>::sqrt(hx * hx + hy * hy);
+        S bz = 2.0f *
+               (m.x * (qx_qz - qw_qy) + m.y * (qy_qz + qw_qx) + m.z * (0.5f - qx_qx - qy_qy));
+
+        // estimated direction of gravity and magnetic field (halved)
+        linalg::vec<S, 3> half_v(qx_qz - qw_qy, qw_qx + qy_qz, 0.5f - qx_qx - qy_qy);
+        linalg::vec<S, 3> half_w(bx * (0.5f - qy_qy - qz_qz) + bz * (qx_qz - qw_qy),
+                                 bx * (qx_qy - qw_qz) + bz * (qw_qx + qy_qz),
+                                 bx * (qw_qy + qx_qz) + bz * (0.5f - qx_qx - qy_qy));
+        // error is the sum of cross products between estimated and measured directions
+        mahony_feedback(marg_data.gyro,
+                        linalg::cross(marg_data.accel, half_v) + linalg::cross(m, half_w), dt,
+                        m_integral);
+    }
+
+    integrate_gyro(marg_data.gyro, quat, dt);
+}
+
+template <class S>
+EskfFusion6T<S>::EskfFusion6T() : m_bias(S(0))
+{
+    eskf_init(m_cov);
 }
+
+template <class S>
+void EskfFusion6T<S>::update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us)
+{
+    const S dt = ScalarTraits<S>::from_micros(time_diff_us);
+
+    // predict from the bias corrected rate
+    eskf_propagate(marg_data.gyro - m_bias, dt, quat, m_cov);
+
+    // correct attitude & bias from the direction of gravity
+    if (eskf_accel_valid(marg_data.accel)) {
+        const linalg::mat<S, 3, 3> rot = linalg::qmat(quat); // body -> earth
+        linalg::vec<S, 3> dtheta(S(0));
+        linalg::vec<S, 3> dbias(S(0));
+        eskf_observe(marg_data.accel, rot.row(2), S(ESKF_ACCEL_VAR), m_cov, dtheta, dbias);
+        eskf_inject(dtheta, dbias, quat, m_bias);
+    }
+}
+
+template <class S>
+EskfFusion9T<S>::EskfFusion9T() : m_bias(S(0))
+{
+    eskf_init(m_cov);
+}
+
+template <class S>
+void EskfFusion9T<S>::update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us)
+{
+    const S dt = ScalarTraits<S>::from_micros(time_diff_us);
+
+    // predict from the bias corrected rate
+    eskf_propagate(marg_data.gyro - m_bias, dt, quat, m_cov);
+
+    // correct attitude & bias from the directions of gravity and Earth's magnetic field
+    const bool accel_valid = eskf_accel_valid(marg_data.accel);
+    const bool magn_valid = try_normalize(marg_data.magn);
+    if (!accel_valid && !magn_valid) return;
+
+    const linalg::mat<S, 3, 3> rot = linalg::qmat(quat); // body -> earth
+    linalg::vec<S, 3> dtheta(S(0));
+    linalg::vec<S, 3> dbias(S(0));
+    if (accel_valid) {
+        eskf_observe(marg_data.accel, rot.row(2), S(ESKF_ACCEL_VAR), m_cov, dtheta, dbias);
+    }
+    if (magn_valid) {
+        // reference direction of Earth's magnetic field (measured inclination, north along x) --
+        // only the heading is observed
+        const linalg::vec<S, 3> h = linalg::mul(rot, marg_data.magn);
+        const linalg::vec<S, 3> b(ScalarTraits<S>::sqrt(h.x * h.x + h.y * h.y), S(0), h.z);
+        eskf_observe(marg_data.magn, linalg::mul(linalg::transpose(rot), b), S(ESKF_MAGN_VAR),
+                     m_cov, dtheta, dbias);
+    }
+    eskf_inject(dtheta, dbias, quat, m_bias);
+}
+
+// explicit instantiations
+template struct z_quad_rotor::MadgwickFusion6T<float>;
+template struct z_quad_rotor::MadgwickFusion9T<float>;
+template struct z_quad_rotor::MadgwickFusion6T<double>;
+template struct z_quad_rotor::MadgwickFusion9T<double>;
+template struct z_quad_rotor::MadgwickFusion6T<Q24>;
+template struct z_quad_rotor::MadgwickFusion9T<Q24>;
+template struct z_quad_rotor::MahonyFusion6T<float>;
+template struct z_quad_rotor::MahonyFusion9T<float>;
+template struct z_quad_rotor::MahonyFusion6T<double>;
+template struct z_quad_rotor::MahonyFusion9T<double>;
+template struct z_quad_rotor::MahonyFusion6T<Q24>;
+template struct z_quad_rotor::MahonyFusion9T<Q24>;
+template struct z_quad_rotor::EskfFusion6T<float>;
+template struct z_quad_rotor::EskfFusion9T<float>;
+template struct z_quad_rotor::EskfFusion6T<double>;
+template struct z_quad_rotor::EskfFusion9T<double>;
@@ -13,27 +13,108 @@
 
 #include <cstdint>
 
+#include "linalg.h"
+#include "linalg_kernels.h"
+
+#include "fixed_point.hpp"
 #include "marg_sensor.hpp"
 #include "orientation_defs.hpp"
 
 namespace z_quad_rotor {
 
-template <class T>
+/// Fusion algorithm interface
+/// @tparam S Scalar type (float, double for host reference runs, or Q24 fixed point)
+/// @note time_diff_us is the measured interval since the previous update (microseconds).
+/// Implementations may keep state between updates (e.g. integral feedback), so update is non-const.
+template <class T, class S = float>
 struct FusionImpl {
-    void update(MargDataFloat marg_data, Quaternion &quat, uint32_t time_diff_ms) const
+    using Scalar = S;
+
+    void update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us)
     {
-        static_cast<const T *>(this)->update(marg_data, quat, time_diff_ms);
+        static_cast<T *>(this)->update(marg_data, quat, time_diff_us);
     }
 };
 
-struct MadgwickFusion6 : FusionImpl<MadgwickFusion6> {
-    void update(MargDataFloat marg_data, Quaternion &quat, uint32_t time_diff_ms) const;
+template <class S>
+struct MadgwickFusion6T : FusionImpl<MadgwickFusion6T<S>, S> {
+    void update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us) const;
+};
+
+template <class S>
+struct MadgwickFusion9T : FusionImpl<MadgwickFusion9T<S>, S> {
+    void update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us) const;
 };
 
-struct MadgwickFusion9 : FusionImpl<MadgwickFusion9> {
-    void update(MargDataFloat marg_data, Quaternion &quat, uint32_t time_diff_ms) const;
+/// Mahony complementary filter (IMU): proportional-integral feedback of the accel error, the
+/// integral term is the gyro bias estimate
+template <class S>
+struct MahonyFusion6T : FusionImpl<MahonyFusion6T<S>, S> {
+    void update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us);
+    /// Returns the estimated gyro bias (rad/s)
+    linalg::vec<S, 3> get_gyro_bias() const { return -m_integral; }
+
+  private:
+    linalg::vec<S, 3> m_integral = linalg::vec<S, 3>(S(0));
+};
+
+/// Mahony complementary filter (MARG): as MahonyFusion6T, with magn error feedback
+template <class S>
+struct MahonyFusion9T : FusionImpl<MahonyFusion9T<S>, S> {
+    void update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us);
+    /// Returns the estimated gyro bias (rad/s)
+    linalg::vec<S, 3> get_gyro_bias() const { return -m_integral; }
+
+  private:
+    linalg::vec<S, 3> m_integral = linalg::vec<S, 3>(S(0));
 };
 
+/// Multiplicative error-state EKF (IMU): attitude error & gyro bias states, gravity direction
+/// measured by the accel (skipped while accelerating away from 1 g)
+/// @note Floating point only (float, double): covariances span too many decades for Q24
+template <class S>
+struct EskfFusion6T : FusionImpl<EskfFusion6T<S>, S> {
+    EskfFusion6T();
+    void update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us);
+    /// Returns the estimated gyro bias (rad/s)
+    linalg::vec<S, 3> get_gyro_bias() const { return m_bias; }
+
+  private:
+    linalg::vec<S, 3> m_bias;
+    linalg::kernels::sym6_blocks<S> m_cov; // [attitude error, gyro bias]
+};
+
+/// Multiplicative error-state EKF (MARG): as EskfFusion6T, with magn direction measurements
+template <class S>
+struct EskfFusion9T : FusionImpl<EskfFusion9T<S>, S> {
+    EskfFusion9T();
+    void update(MargDataT<S> marg_data, QuaternionT<S> &quat, uint32_t time_diff_us);
+    /// Returns the estimated gyro bias (rad/s)
+    linalg::vec<S, 3> get_gyro_bias() const { return m_bias; }
+
+  private:
+    linalg::vec<S, 3> m_bias;
+    linalg::kernels::sym6_blocks<S> m_cov; // [attitude error, gyro bias]
+};
+
+// instantiated in fusion.cpp for float, double, and Q24 (ESKF float & double only)
+using MadgwickFusion6 = MadgwickFusion6T<float>;
+using MadgwickFusion9 = MadgwickFusion9T<float>;
+using MadgwickFusion6Double = MadgwickFusion6T<double>;
+using MadgwickFusion9Double = MadgwickFusion9T<double>;
+using MadgwickFusion6Fixed = MadgwickFusion6T<Q24>;
+using MadgwickFusion9Fixed = MadgwickFusion9T<Q24>;
+using MahonyFusion6 = MahonyFusion6T<float>;
+using MahonyFusion9 = MahonyFusion9T<float>;
+using MahonyFusion6Double = MahonyFusion6T<double>;
+using MahonyFusion9Double = MahonyFusion9T<double>;
+using MahonyFusion6Fixed = MahonyFusion6T<Q24>;
+using MahonyFusion9Fixed = MahonyFusion9T<Q24>;
+using EskfFusion6 = EskfFusion6T<float>;
+using EskfFusion9 = EskfFusion9T<float>;
+using EskfFusion6Double = EskfFusion6T<double>;
+using EskfFusion9Double = EskfFusion9T<double>;
+
 } // namespace z_quad_rotor
 
 #endif // __FUSION_H
\ No newline at end of file
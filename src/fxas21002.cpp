@@ -8,37 +8,247 @@
 #include "fxas21002.hpp"
 
 #include <device.h>
+#include <drivers/gpio.h>
+#include <drivers/i2c.h>
 #include <drivers/sensor.h>
 #include <logging/log.h>
+#include <zephyr.h>
+
+#include "perf.hpp"
+#include "trace.hpp"
 
 using namespace z_quad_rotor;
 
 LOG_MODULE_REGISTER(fxas21002, LOG_LEVEL_DBG);
 
+// constants
+#define FXAS21002_NODE DT_INST(0, nxp_fxas21002)
+// fifo interrupt is routed to whichever pin the zephyr driver is not using for data ready
+#ifdef CONFIG_FXAS21002_DRDY_INT1
+#define FXAS21002_FIFO_INT_GPIOS int2_gpios
+#else
+#define FXAS21002_FIFO_INT_GPIOS int1_gpios
+#endif
+
+static constexpr size_t FIFO_STACK_SIZE = 1024;
+static constexpr int FIFO_THREAD_PRIO = CONFIG_FXAS21002_THREAD_PRIORITY;
+static constexpr uint8_t FIFO_SIZE = 32;
+static constexpr size_t SAMPLE_SIZE = 6; // x, y, z; msb first
+static constexpr uint32_t SAMPLE_PERIOD_US = 1250 << CONFIG_FXAS21002_DR; // 800 Hz >> DR
+
+// registers & bits
+static constexpr uint8_t REG_STATUS = 0x00;    // mirrors F_STATUS while the fifo is enabled
+static constexpr uint8_t REG_OUT_X_MSB = 0x01; // pops the fifo while it is enabled
+static constexpr uint8_t REG_F_SETUP = 0x09;
+static constexpr uint8_t REG_CTRL_REG0 = 0x0D;
+static constexpr uint8_t REG_CTRL_REG1 = 0x13;
+static constexpr uint8_t REG_CTRL_REG2 = 0x14;
+
+static constexpr uint8_t F_STATUS_OVF = BIT(7);
+static constexpr uint8_t F_STATUS_CNT_MASK = 0x3F;
+static constexpr uint8_t F_SETUP_MODE_CIRCULAR = 0x40;
+static constexpr uint8_t CTRL_REG0_FS_MASK = 0x03;
+static constexpr uint8_t CTRL_REG1_MODE_MASK = 0x03;
+static constexpr uint8_t CTRL_REG1_READY = BIT(0);
+static constexpr uint8_t CTRL_REG1_ACTIVE = BIT(1);
+static constexpr uint8_t CTRL_REG2_INT_CFG_FIFO = BIT(7); // 1: INT1, 0: INT2
+static constexpr uint8_t CTRL_REG2_INT_EN_FIFO = BIT(6);
+static constexpr uint8_t CTRL_REG2_INT_EN_DRDY = BIT(2);
+
+static constexpr float GYRO_RAD_PER_LSB_2000DPS = 1091e-6f; // 62.5 mdps, in rad/s as zephyr reports
+
 // private variables
 static MargSensor *s_output_sink;
+static const struct device *s_i2c;
+
+// fifo mode
+static const struct device *s_int_gpio;
+static struct gpio_callback s_int_cb;
+static k_thread s_fifo_thread;
+K_THREAD_STACK_DEFINE(s_fifo_stack, FIFO_STACK_SIZE);
+K_SEM_DEFINE(s_fifo_sem, 0, 1);
+static uint8_t s_watermark;
+static uint32_t s_sample_period_cyc;
+static volatile uint32_t s_int_timestamp;
+static uint8_t s_raw[FIFO_SIZE * SAMPLE_SIZE];
+static GyroData s_batch[FIFO_SIZE];
 
 // private function definitions
+static int16_t raw_to_int16(const uint8_t *raw) { return (int16_t)((raw[0] << 8) | raw[1]); }
+
+/// decodes one sample from the output registers
+static void decode_gyro(const uint8_t *raw, GyroData &sample)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        sample.gyro[axis] = raw_to_int16(&raw[axis * 2]);
+    }
+}
+
 static void trig_handler(const struct device *dev, struct sensor_trigger *trigger)
 {
+    ARG_UNUSED(dev);
     ARG_UNUSED(trigger);
+    PERF_SCOPE(GYRO_READ);
+    trace::handler_enter(trace::SOURCE_GYRO);
 
-    // fetch data
-    int err = sensor_sample_fetch(dev);
-    // store
-    WriteLock<MargData> write_lock = s_output_sink->get_write_lock();
+    // timestamp as close to data ready as possible (fusion integrates between these), then read
+    // raw counts into our private slot (not visible to the reader until published)
+    GyroData &slot = s_output_sink->get_gyro_slot();
+    slot.timestamp = k_cycle_get_32();
+    uint8_t raw[1 + SAMPLE_SIZE];
+    int err = i2c_burst_read(s_i2c, DT_REG_ADDR(FXAS21002_NODE), REG_STATUS, raw, sizeof(raw));
+    // publish
     if (!err) {
-        err = sensor_channel_get(dev, SENSOR_CHAN_GYRO_XYZ, write_lock.get_ref().gyro);
+        decode_gyro(&raw[1], slot);
+        s_output_sink->publish_gyro();
     }
 
     // log errors
     if (err) {
         LOG_ERR("FXAS21002 trigger handler err: %d.", err);
     }
+    trace::handler_exit(trace::SOURCE_GYRO, err);
+}
+
+static void fifo_int_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(cb);
+    ARG_UNUSED(pins);
+
+    s_int_timestamp = k_cycle_get_32();
+    k_sem_give(&s_fifo_sem);
+}
+
+/// Reads the fifo in bursts of up to watermark samples (as f_status counts them) until it is below
+/// watermark; delivers each burst as a timestamped batch (the watermark sample is stamped at the
+/// interrupt).
+static int drain_fifo()
+{
+    int err = 0;
+    uint32_t anchor = s_int_timestamp;
+    int32_t sample_idx = 1 - s_watermark; // relative to the sample that triggered the interrupt
+    uint8_t fifo_count;
+    do {
+        // f_status first, so that a burst only pops the samples it publishes (ones arriving
+        // during the burst wait for the next pass)
+        uint8_t f_status = 0;
+        err = i2c_reg_read_byte(s_i2c, DT_REG_ADDR(FXAS21002_NODE), REG_STATUS, &f_status);
+        if (err) break;
+        fifo_count = f_status & F_STATUS_CNT_MASK;
+        uint8_t batch_count = MIN(fifo_count, s_watermark);
+        if (!batch_count) break;
+        // one burst of batch_count samples (fifo reads wrap at the out regs)
+        err = i2c_burst_read(s_i2c, DT_REG_ADDR(FXAS21002_NODE), REG_OUT_X_MSB, s_raw,
+                             batch_count * SAMPLE_SIZE);
+        if (err) break;
+
+        if (f_status & F_STATUS_OVF) {
+            LOG_WRN("FXAS21002 FIFO overflow.");
+        }
+        for (uint8_t i = 0; i < batch_count; i++, sample_idx++) {
+            GyroData &sample = s_batch[i];
+            sample.timestamp = anchor + (sample_idx * (int32_t)s_sample_period_cyc);
+            decode_gyro(&s_raw[i * SAMPLE_SIZE], sample);
+        }
+        s_output_sink->publish_gyro_batch(s_batch, batch_count);
+    } while (fifo_count > s_watermark);
+
+    return err;
+}
+
+static void fifo_thread_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        k_sem_take(&s_fifo_sem, K_FOREVER);
+        trace::handler_enter(trace::SOURCE_GYRO);
+        PERF_BEGIN(GYRO_READ);
+        int err = drain_fifo();
+        PERF_END(GYRO_READ);
+        trace::handler_exit(trace::SOURCE_GYRO, err);
+        if (err) {
+            LOG_ERR("FXAS21002 FIFO read err: %d.", err);
+        }
+    }
+}
+
+/// Configures fifo & interrupt routing; publishes scale factor to the sink
+/// @param watermark Fifo watermark, or 0 to disable the fifo (data ready mode)
+static int configure(uint8_t watermark)
+{
+    int err = 0;
+    uint16_t addr = DT_REG_ADDR(FXAS21002_NODE);
+    // configure in ready mode (fifo & interrupt config can't change while active)
+    uint8_t ctrl_reg0 = 0;
+    err = i2c_reg_update_byte(s_i2c, addr, REG_CTRL_REG1, CTRL_REG1_MODE_MASK, CTRL_REG1_READY);
+    if (!err) err = i2c_reg_read_byte(s_i2c, addr, REG_CTRL_REG0, &ctrl_reg0);
+    if (!err && watermark) {
+        err = i2c_reg_write_byte(s_i2c, addr, REG_F_SETUP, F_SETUP_MODE_CIRCULAR | watermark);
+    }
+    if (!err && watermark) {
+        uint8_t int_cfg = IS_ENABLED(CONFIG_FXAS21002_DRDY_INT1) ? 0 : CTRL_REG2_INT_CFG_FIFO;
+        err = i2c_reg_update_byte(
+            s_i2c, addr, REG_CTRL_REG2,
+            CTRL_REG2_INT_CFG_FIFO | CTRL_REG2_INT_EN_FIFO | CTRL_REG2_INT_EN_DRDY,
+            int_cfg | CTRL_REG2_INT_EN_FIFO);
+    }
+    if (!err) {
+        err = i2c_reg_update_byte(s_i2c, addr, REG_CTRL_REG1, CTRL_REG1_MODE_MASK,
+                                  CTRL_REG1_ACTIVE);
+    }
+    if (err) {
+        LOG_ERR("Unable to configure FXAS21002; err: %d.", err);
+    }
+    // store conversion & timing params
+    if (!err) {
+        uint8_t range = ctrl_reg0 & CTRL_REG0_FS_MASK;
+        s_output_sink->set_gyro_scale(GYRO_RAD_PER_LSB_2000DPS / (1 << range));
+        s_watermark = watermark;
+        s_sample_period_cyc = k_us_to_cyc_near32(SAMPLE_PERIOD_US);
+    }
+
+    return err;
+}
+
+static int setup_fifo_int()
+{
+    int err = 0;
+    s_int_gpio = device_get_binding(DT_GPIO_LABEL(FXAS21002_NODE, FXAS21002_FIFO_INT_GPIOS));
+    if (!s_int_gpio) {
+        LOG_ERR("FXAS21002 FIFO gpio binding failed.");
+        err = ENXIO;
+    }
+    // start fifo thread & enable interrupt
+    if (!err) {
+        k_tid_t tid = k_thread_create(&s_fifo_thread, s_fifo_stack,
+                                      K_THREAD_STACK_SIZEOF(s_fifo_stack), fifo_thread_func, NULL,
+                                      NULL, NULL, FIFO_THREAD_PRIO, 0, K_NO_WAIT);
+        k_thread_name_set(tid, "fxas21002 fifo");
+
+        gpio_pin_t pin = DT_GPIO_PIN(FXAS21002_NODE, FXAS21002_FIFO_INT_GPIOS);
+        err = gpio_pin_configure(
+            s_int_gpio, pin, GPIO_INPUT | DT_GPIO_FLAGS(FXAS21002_NODE, FXAS21002_FIFO_INT_GPIOS));
+        if (!err) {
+            gpio_init_callback(&s_int_cb, fifo_int_handler, BIT(pin));
+            err = gpio_add_callback(s_int_gpio, &s_int_cb);
+        }
+        if (!err) {
+            err = gpio_pin_interrupt_configure(s_int_gpio, pin, GPIO_INT_EDGE_TO_ACTIVE);
+        }
+        if (err) {
+            LOG_ERR("Unable to set FXAS21002 FIFO interrupt; err: %d.", err);
+        }
+    }
+
+    return err;
 }
 
 // public function definitions
-int fxas21002::setup(const char *dev_name, MargSensor *output_sink)
+int fxas21002::setup(const char *dev_name, MargSensor *output_sink, uint8_t fifo_watermark)
 {
     int err = 0;
     // input validation
@@ -46,16 +256,29 @@ int fxas21002::setup(const char *dev_name, MargSensor *output_sink)
         LOG_ERR("FXAS21002 nullptr error at line: %d.", __LINE__);
         err = EINVAL;
     }
-    // get device from name
+    if (fifo_watermark >= FIFO_SIZE) {
+        LOG_ERR("FXAS21002 FIFO watermark out of range: %d.", fifo_watermark);
+        err = EINVAL;
+    }
+    // get device from name (& its bus for raw reads)
     const struct device *dev;
     if (!err) {
         dev = device_get_binding(dev_name);
-        if (!dev) {
+        s_i2c = device_get_binding(DT_BUS_LABEL(FXAS21002_NODE));
+        if (!dev || !s_i2c) {
             LOG_ERR("FXAS21002 binding failed.");
             err = ENXIO;
         }
     }
+    s_output_sink = output_sink;
     if (!err) {
+        err = configure(fifo_watermark);
+    }
+    // either batch through the hw fifo, or read each sample on data ready
+    if (!err && fifo_watermark) {
+        err = setup_fifo_int();
+    }
+    else if (!err) {
         struct sensor_trigger trig = {
             .type = SENSOR_TRIG_DATA_READY,
             .chan = SENSOR_CHAN_GYRO_XYZ,
@@ -66,6 +289,5 @@ int fxas21002::setup(const char *dev_name, MargSensor *output_sink)
         }
     }
 
-    s_output_sink = output_sink;
     return err;
 }
@@ -11,6 +11,8 @@
 #ifndef __FXAS21002_H
 #define __FXAS21002_H
 
+#include <cstdint>
+
 #include "marg_sensor.hpp"
 
 namespace z_quad_rotor {
@@ -19,7 +21,10 @@ namespace fxas21002 {
 
 /// Initializes the sensor; samples will be fetched on data ready interrupt and data will be written
 /// to output sink.
-int setup(const char *dev_name, MargSensor *output_sink);
+/// @param fifo_watermark If non-zero (1-31), samples are buffered in the sensor's FIFO instead and
+/// drained in a single burst per watermark interrupt, then written to output sink as a timestamped
+/// batch.
+int setup(const char *dev_name, MargSensor *output_sink, uint8_t fifo_watermark = 0);
 
 } // namespace fxas21002
 
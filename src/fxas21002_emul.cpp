@@ -0,0 +1,366 @@
+/**
+ * @file	fxas21002_emul.cpp
+ * @author	Andrew Loebs
+ * @brief	I2C emulator of the FXAS21002 gyroscope (see sensor_emul.hpp)
+ *
+ * Models the registers the zephyr driver & fxas21002.cpp use: reset, who am i, standby/ready/
+ * active modes, output data rate, full scale, data ready & the 32 sample circular fifo, with
+ * their interrupts routed to INT1/INT2.
+ *
+ */
+
+#include <cstring>
+
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <logging/log.h>
+#include <zephyr.h>
+
+#include "orientation_defs.hpp"
+#include "sensor_emul.hpp"
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(fxas21002_emul, LOG_LEVEL_DBG);
+
+#define FXAS21002_NODE DT_INST(0, nxp_fxas21002)
+
+#if DT_NODE_HAS_STATUS(FXAS21002_NODE, okay)
+
+// constants
+static constexpr size_t REG_COUNT = 0x16;
+static constexpr uint8_t FIFO_SIZE = 32;
+static constexpr uint8_t WHOAMI = 0xD7;
+/// sample period by CTRL_REG1 data rate (us)
+static constexpr uint32_t PERIOD_US[8] = {1250, 2500, 5000, 10000, 20000, 40000, 80000, 80000};
+
+// registers & bits
+static constexpr uint8_t REG_STATUS = 0x00; // mirrors DR_STATUS, or F_STATUS while the fifo is on
+static constexpr uint8_t REG_OUT_X_MSB = 0x01;
+static constexpr uint8_t REG_OUT_Z_LSB = 0x06;
+static constexpr uint8_t REG_DR_STATUS = 0x07;
+static constexpr uint8_t REG_F_STATUS = 0x08;
+static constexpr uint8_t REG_F_SETUP = 0x09;
+static constexpr uint8_t REG_INT_SRC_FLAG = 0x0B;
+static constexpr uint8_t REG_WHOAMI = 0x0C;
+static constexpr uint8_t REG_CTRL_REG0 = 0x0D;
+static constexpr uint8_t REG_CTRL_REG1 = 0x13;
+static constexpr uint8_t REG_CTRL_REG2 = 0x14;
+static constexpr uint8_t REG_CTRL_REG3 = 0x15;
+
+static constexpr uint8_t DR_STATUS_ZYXOW = 0xF0;
+static constexpr uint8_t DR_STATUS_ZYXDR = 0x0F;
+static constexpr uint8_t F_STATUS_OVF = BIT(7);
+static constexpr uint8_t F_STATUS_WMRK = BIT(6);
+static constexpr uint8_t F_SETUP_MODE_SHIFT = 6;
+static constexpr uint8_t F_SETUP_WMRK_MASK = 0x3F;
+static constexpr uint8_t SRC_DRDY = BIT(0);
+static constexpr uint8_t SRC_FIFO = BIT(2);
+static constexpr uint8_t CTRL_REG0_FS_MASK = 0x03;
+static constexpr uint8_t CTRL_REG1_RST = BIT(6);
+static constexpr uint8_t CTRL_REG1_DR_SHIFT = 2;
+static constexpr uint8_t CTRL_REG1_DR_MASK = 0x07;
+static constexpr uint8_t CTRL_REG1_ACTIVE = BIT(1);
+static constexpr uint8_t CTRL_REG2_INT_CFG_FIFO = BIT(7); // 1: INT1, 0: INT2
+static constexpr uint8_t CTRL_REG2_INT_EN_FIFO = BIT(6);
+static constexpr uint8_t CTRL_REG2_INT_CFG_DRDY = BIT(3);
+static constexpr uint8_t CTRL_REG2_INT_EN_DRDY = BIT(2);
+static constexpr uint8_t CTRL_REG2_IPOL = BIT(1);
+static constexpr uint8_t CTRL_REG3_WRAPTOONE = BIT(3);
+
+static constexpr float DPS_PER_LSB_2000DPS = 0.0625f; // halves per full scale step
+static constexpr float GYRO_NOISE = 0.35f * DEG_TO_RAD; // 25 mdps/rtHz at 200 Hz
+
+// types
+struct FifoEntry {
+    int16_t gyro[3];
+    uint64_t sample_us;
+};
+
+/// register file & sample state (under s_lock)
+struct Device {
+    uint8_t regs[REG_COUNT];
+    int16_t gyro[3];
+    uint64_t sample_us;
+    bool is_unread;
+    uint8_t dr_status; // ZYXDR & ZYXOW
+    uint8_t int_source;
+    FifoEntry fifo[FIFO_SIZE];
+    uint8_t fifo_head;
+    uint8_t fifo_count;
+    uint8_t f_status_flags; // OVF & WMRK
+    FifoEntry fifo_out;     // popped entry, as the output registers
+
+    void reset();
+    uint8_t read(uint8_t reg);
+    void write(uint8_t reg, uint8_t val);
+    uint8_t next(uint8_t reg) const;
+    bool is_fifo_enabled() const { return regs[REG_F_SETUP] >> F_SETUP_MODE_SHIFT; }
+};
+
+struct IntPin {
+    const struct device *gpio;
+    gpio_pin_t pin;
+};
+
+// private variables
+static struct k_spinlock s_lock;
+static Device s_device;
+static struct i2c_emul s_i2c_emul;
+static IntPin s_int_pins[2]; // INT1, INT2
+
+static void sample_timer_handler(struct k_timer *timer);
+K_TIMER_DEFINE(s_sample_timer, sample_timer_handler, NULL);
+
+// private function definitions
+static void put_int16(uint8_t *raw, int16_t val)
+{
+    raw[0] = (uint8_t)(val >> 8);
+    raw[1] = (uint8_t)val;
+}
+
+static int16_t saturate_int16(float val)
+{
+    return (int16_t)MAX(MIN(val, (float)INT16_MAX), (float)INT16_MIN);
+}
+
+/// restarts sampling at the configured rate, or stops it in standby & ready modes
+static void update_sample_timer(const Device &device)
+{
+    uint8_t ctrl_reg1 = device.regs[REG_CTRL_REG1];
+    if (ctrl_reg1 & CTRL_REG1_ACTIVE) {
+        uint32_t period_us = PERIOD_US[(ctrl_reg1 >> CTRL_REG1_DR_SHIFT) & CTRL_REG1_DR_MASK];
+        k_timer_start(&s_sample_timer, K_USEC(period_us), K_USEC(period_us));
+    }
+    else {
+        k_timer_stop(&s_sample_timer);
+    }
+}
+
+/// pin levels for the pending interrupts (IPOL clear: active low)
+static void get_int_levels(const Device &device, int levels[2])
+{
+    uint8_t ctrl_reg2 = device.regs[REG_CTRL_REG2];
+    bool drdy = (device.int_source & SRC_DRDY) && (ctrl_reg2 & CTRL_REG2_INT_EN_DRDY);
+    bool fifo = (device.int_source & SRC_FIFO) && (ctrl_reg2 & CTRL_REG2_INT_EN_FIFO);
+    bool drdy_on_int1 = ctrl_reg2 & CTRL_REG2_INT_CFG_DRDY;
+    bool fifo_on_int1 = ctrl_reg2 & CTRL_REG2_INT_CFG_FIFO;
+    bool asserted[2] = {(drdy && drdy_on_int1) || (fifo && fifo_on_int1),
+                        (drdy && !drdy_on_int1) || (fifo && !fifo_on_int1)};
+    bool is_active_high = ctrl_reg2 & CTRL_REG2_IPOL;
+    for (int i = 0; i < 2; i++) {
+        levels[i] = (asserted[i] == is_active_high) ? 1 : 0;
+    }
+}
+
+/// drives the pins outside of s_lock (gpio callbacks run synchronously); unchanged levels raise
+/// no edge, and pins not configured as inputs yet are refused
+static void drive_int_pins(const int levels[2])
+{
+    for (int i = 0; i < 2; i++) {
+        if (s_int_pins[i].gpio) {
+            gpio_emul_input_set(s_int_pins[i].gpio, s_int_pins[i].pin, levels[i]);
+        }
+    }
+}
+
+void Device::reset()
+{
+    memset(this, 0, sizeof(*this));
+    regs[REG_WHOAMI] = WHOAMI;
+}
+
+uint8_t Device::read(uint8_t reg)
+{
+    if (REG_STATUS == reg) reg = is_fifo_enabled() ? REG_F_STATUS : REG_DR_STATUS;
+
+    if (REG_DR_STATUS == reg) return dr_status;
+    if (REG_F_STATUS == reg) {
+        // reading f_status clears its flags & the fifo interrupt
+        uint8_t f_status = f_status_flags | fifo_count;
+        f_status_flags = 0;
+        int_source &= ~SRC_FIFO;
+        return f_status;
+    }
+    if (reg >= REG_OUT_X_MSB && reg <= REG_OUT_Z_LSB) {
+        int offset = reg - REG_OUT_X_MSB;
+        uint8_t raw[2];
+        if (is_fifo_enabled()) {
+            // each pass through the output registers pops one sample
+            if (0 == offset) {
+                if (fifo_count) {
+                    fifo_out = fifo[fifo_head];
+                    fifo_head = (fifo_head + 1) % FIFO_SIZE;
+                    fifo_count--;
+                    sensor_emul::record_read(sensor_emul::SENSOR_FXAS21002, fifo_out.sample_us);
+                }
+                else {
+                    memset(&fifo_out, 0, sizeof(fifo_out));
+                }
+            }
+            put_int16(raw, fifo_out.gyro[offset / 2]);
+            return raw[offset % 2];
+        }
+        // reading the data clears data ready
+        if (0 == offset && is_unread) {
+            is_unread = false;
+            dr_status = 0;
+            int_source &= ~SRC_DRDY;
+            sensor_emul::record_read(sensor_emul::SENSOR_FXAS21002, sample_us);
+        }
+        put_int16(raw, gyro[offset / 2]);
+        return raw[offset % 2];
+    }
+    if (REG_INT_SRC_FLAG == reg) return int_source;
+    return (reg < REG_COUNT) ? regs[reg] : 0;
+}
+
+void Device::write(uint8_t reg, uint8_t val)
+{
+    switch (reg) {
+    case REG_CTRL_REG1:
+        if (val & CTRL_REG1_RST) {
+            // self clearing; the driver polls it
+            reset();
+        }
+        else {
+            regs[reg] = val;
+        }
+        update_sample_timer(*this);
+        break;
+    case REG_F_SETUP:
+        regs[reg] = val;
+        if (!is_fifo_enabled()) {
+            fifo_count = 0;
+            f_status_flags = 0;
+        }
+        break;
+    case REG_CTRL_REG0:
+    case REG_CTRL_REG2:
+    case REG_CTRL_REG3:
+        regs[reg] = val;
+        break;
+    default:
+        break; // read only, or not modeled
+    }
+}
+
+uint8_t Device::next(uint8_t reg) const
+{
+    // fifo reads wrap through the output registers (as do all reads, with wraptoone)
+    if (REG_OUT_Z_LSB == reg &&
+        (is_fifo_enabled() || (regs[REG_CTRL_REG3] & CTRL_REG3_WRAPTOONE))) {
+        return REG_OUT_X_MSB;
+    }
+    return (reg + 1) % REG_COUNT;
+}
+
+/// takes one sample of the trajectory, into the output registers or the fifo
+static void sample_timer_handler(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    sensor_emul::Truth truth = sensor_emul::get_truth();
+    uint64_t sample_us = sensor_emul::now_us();
+
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    Device &device = s_device;
+    uint8_t fs = device.regs[REG_CTRL_REG0] & CTRL_REG0_FS_MASK;
+    float dps_per_lsb = DPS_PER_LSB_2000DPS / (1 << fs);
+    int16_t gyro[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float rate = truth.rate[axis] + sensor_emul::noise(GYRO_NOISE);
+        gyro[axis] = saturate_int16((rate * RAD_TO_DEG) / dps_per_lsb);
+    }
+    sensor_emul::record_produced(sensor_emul::SENSOR_FXAS21002);
+
+    if (device.is_fifo_enabled()) {
+        // circular mode: a full fifo drops its oldest sample
+        if (FIFO_SIZE == device.fifo_count) {
+            device.fifo_head = (device.fifo_head + 1) % FIFO_SIZE;
+            device.fifo_count--;
+            device.f_status_flags |= F_STATUS_OVF;
+            sensor_emul::record_dropped(sensor_emul::SENSOR_FXAS21002);
+        }
+        FifoEntry &entry = device.fifo[(device.fifo_head + device.fifo_count) % FIFO_SIZE];
+        memcpy(entry.gyro, gyro, sizeof(entry.gyro));
+        entry.sample_us = sample_us;
+        device.fifo_count++;
+        uint8_t watermark = device.regs[REG_F_SETUP] & F_SETUP_WMRK_MASK;
+        if (watermark && device.fifo_count >= watermark) {
+            device.f_status_flags |= F_STATUS_WMRK;
+            device.int_source |= SRC_FIFO;
+        }
+    }
+    else {
+        if (device.is_unread) {
+            device.dr_status |= DR_STATUS_ZYXOW;
+            sensor_emul::record_dropped(sensor_emul::SENSOR_FXAS21002);
+        }
+        memcpy(device.gyro, gyro, sizeof(device.gyro));
+        device.sample_us = sample_us;
+        device.is_unread = true;
+        device.dr_status |= DR_STATUS_ZYXDR;
+        device.int_source |= SRC_DRDY;
+    }
+    int levels[2];
+    get_int_levels(device, levels);
+    k_spin_unlock(&s_lock, key);
+
+    drive_int_pins(levels);
+}
+
+static int transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr)
+{
+    ARG_UNUSED(emul);
+    ARG_UNUSED(addr);
+
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    int err = sensor_emul::transfer_registers(s_device, msgs, num_msgs);
+    int levels[2];
+    get_int_levels(s_device, levels);
+    k_spin_unlock(&s_lock, key);
+
+    // reads clear interrupts
+    drive_int_pins(levels);
+    return err;
+}
+
+static const struct i2c_emul_api s_i2c_emul_api = {
+    .transfer = transfer,
+};
+
+/// binds an interrupt pin's gpio
+static void bind_int_pin(IntPin &int_pin, const char *label, gpio_pin_t pin)
+{
+    int_pin.gpio = device_get_binding(label);
+    int_pin.pin = pin;
+    if (!int_pin.gpio) {
+        LOG_ERR("FXAS21002 emulator gpio binding failed.");
+    }
+}
+
+static int emul_init(const struct emul *emul, const struct device *parent)
+{
+    s_device.reset();
+#if DT_NODE_HAS_PROP(FXAS21002_NODE, int1_gpios)
+    bind_int_pin(s_int_pins[0], DT_GPIO_LABEL(FXAS21002_NODE, int1_gpios),
+                 DT_GPIO_PIN(FXAS21002_NODE, int1_gpios));
+#endif
+#if DT_NODE_HAS_PROP(FXAS21002_NODE, int2_gpios)
+    bind_int_pin(s_int_pins[1], DT_GPIO_LABEL(FXAS21002_NODE, int2_gpios),
+                 DT_GPIO_PIN(FXAS21002_NODE, int2_gpios));
+#endif
+
+    s_i2c_emul.api = &s_i2c_emul_api;
+    s_i2c_emul.addr = DT_REG_ADDR(FXAS21002_NODE);
+    return i2c_emul_register(parent, emul->dev_label, &s_i2c_emul);
+}
+
+EMUL_DEFINE(emul_init, FXAS21002_NODE, NULL)
+
+#endif // DT_NODE_HAS_STATUS(FXAS21002_NODE, okay)
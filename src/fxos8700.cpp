@@ -8,8 +8,14 @@
 #include "fxos8700.hpp"
 
 #include <device.h>
+#include <drivers/gpio.h>
+#include <drivers/i2c.h>
 #include <drivers/sensor.h>
 #include <logging/log.h>
+#include <zephyr.h>
+
+#include "perf.hpp"
+#include "trace.hpp"
 
 using namespace z_quad_rotor;
 
@@ -18,33 +24,260 @@ LOG_MODULE_REGISTER(fxos8700, LOG_LEVEL_DBG);
 // constants
 static const struct sensor_value data_rate = {.val1 = 200, .val2 = 0}; // Hz
 
+#define FXOS8700_NODE DT_INST(0, nxp_fxos8700)
+// fifo interrupt is routed to whichever pin the zephyr driver is not using for data ready
+#ifdef CONFIG_FXOS8700_DRDY_INT1
+#define FXOS8700_FIFO_INT_GPIOS int2_gpios
+#else
+#define FXOS8700_FIFO_INT_GPIOS int1_gpios
+#endif
+
+static constexpr size_t FIFO_STACK_SIZE = 1024;
+static constexpr int FIFO_THREAD_PRIO = CONFIG_FXOS8700_THREAD_PRIORITY;
+static constexpr uint8_t FIFO_SIZE = 32;
+static constexpr size_t SAMPLE_SIZE = 6; // x, y, z; msb first
+
+// registers & bits
+static constexpr uint8_t REG_STATUS = 0x00;    // F_STATUS while the fifo is enabled
+static constexpr uint8_t REG_OUT_X_MSB = 0x01; // pops the fifo while it is enabled
+static constexpr uint8_t REG_F_SETUP = 0x09;
+static constexpr uint8_t REG_XYZ_DATA_CFG = 0x0E;
+static constexpr uint8_t REG_CTRL_REG1 = 0x2A;
+static constexpr uint8_t REG_CTRL_REG4 = 0x2D;
+static constexpr uint8_t REG_CTRL_REG5 = 0x2E;
+static constexpr uint8_t REG_M_OUT_X_MSB = 0x33;
+static constexpr uint8_t REG_M_CTRL_REG2 = 0x5C;
+
+static constexpr uint8_t F_STATUS_OVF = BIT(7);
+static constexpr uint8_t F_STATUS_CNT_MASK = 0x3F;
+static constexpr uint8_t F_SETUP_MODE_CIRCULAR = 0x40;
+static constexpr uint8_t XYZ_DATA_CFG_FS_MASK = 0x03;
+static constexpr uint8_t CTRL_REG1_ACTIVE = BIT(0);
+static constexpr uint8_t CTRL_REG4_INT_EN_FIFO = BIT(6);
+static constexpr uint8_t CTRL_REG4_INT_EN_DRDY = BIT(0);
+static constexpr uint8_t CTRL_REG5_INT_CFG_FIFO = BIT(6); // 1: INT1, 0: INT2
+static constexpr uint8_t M_CTRL_REG2_HYB_AUTOINC = BIT(5);
+
+static constexpr float ACCEL_LSB_PER_G_2G = 4096.0f; // 14-bit, halves per full scale step
+static constexpr float MAGN_GAUSS_PER_LSB = 0.001f;   // 0.1 uT
+static constexpr float STANDARD_GRAVITY = 9.80665f;   // m/s^2
+
 // private variables
 static MargSensor *s_output_sink;
+static const struct device *s_i2c;
+
+// fifo mode
+static const struct device *s_int_gpio;
+static struct gpio_callback s_int_cb;
+static k_thread s_fifo_thread;
+K_THREAD_STACK_DEFINE(s_fifo_stack, FIFO_STACK_SIZE);
+K_SEM_DEFINE(s_fifo_sem, 0, 1);
+static uint8_t s_watermark;
+static uint32_t s_sample_period_cyc;
+static volatile uint32_t s_int_timestamp;
+static uint8_t s_raw[FIFO_SIZE * SAMPLE_SIZE];
+static AccelMagnData s_batch[FIFO_SIZE];
 
 // private function definitions
+static int16_t raw_to_int16(const uint8_t *raw) { return (int16_t)((raw[0] << 8) | raw[1]); }
+
+/// decodes one sample from the output registers (accel is 14-bit, left justified)
+static void decode_accel(const uint8_t *raw, AccelMagnData &sample)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        sample.accel[axis] = raw_to_int16(&raw[axis * 2]) >> 2;
+    }
+}
+
+static void decode_magn(const uint8_t *raw, AccelMagnData &sample)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        sample.magn[axis] = raw_to_int16(&raw[axis * 2]);
+    }
+}
+
 static void trig_handler(const struct device *dev, struct sensor_trigger *trigger)
 {
+    ARG_UNUSED(dev);
     ARG_UNUSED(trigger);
+    PERF_SCOPE(ACCEL_MAGN_READ);
+    trace::handler_enter(trace::SOURCE_ACCEL_MAGN);
 
-    // fetch data
-    int err = sensor_sample_fetch(dev);
-    // store
-    WriteLock<MargData> write_lock = s_output_sink->get_write_lock();
-    if (!err) {
-        err = sensor_channel_get(dev, SENSOR_CHAN_ACCEL_XYZ, write_lock.get_ref().accel);
-    }
+    // timestamp as close to data ready as possible (fusion integrates between these), then read
+    // raw counts into our private slot (not visible to the reader until published). hybrid
+    // auto-increment lets status, accel & magn be read in one burst.
+    AccelMagnData &slot = s_output_sink->get_accel_magn_slot();
+    slot.timestamp = k_cycle_get_32();
+    uint8_t raw[1 + (2 * SAMPLE_SIZE)];
+    int err = i2c_burst_read(s_i2c, DT_REG_ADDR(FXOS8700_NODE), REG_STATUS, raw, sizeof(raw));
+    // publish
     if (!err) {
-        err = sensor_channel_get(dev, SENSOR_CHAN_MAGN_XYZ, write_lock.get_ref().magn);
+        decode_accel(&raw[1], slot);
+        decode_magn(&raw[1 + SAMPLE_SIZE], slot);
+        s_output_sink->publish_accel_magn();
     }
 
     // log errors
     if (err) {
         LOG_ERR("FXOS8700 trigger handler err: %d.", err);
     }
+    trace::handler_exit(trace::SOURCE_ACCEL_MAGN, err);
+}
+
+static void fifo_int_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(cb);
+    ARG_UNUSED(pins);
+
+    s_int_timestamp = k_cycle_get_32();
+    k_sem_give(&s_fifo_sem);
+}
+
+/// Reads the fifo in bursts of up to watermark samples (as f_status counts them) until it is below
+/// watermark; delivers each burst as a timestamped batch (the watermark sample is stamped at the
+/// interrupt).
+static int drain_fifo()
+{
+    int err = 0;
+    uint32_t anchor = s_int_timestamp;
+    int32_t sample_idx = 1 - s_watermark; // relative to the sample that triggered the interrupt
+    uint8_t fifo_count;
+    do {
+        // f_status first, so that a burst only pops the samples it publishes (ones arriving
+        // during the burst wait for the next pass)
+        uint8_t f_status = 0;
+        err = i2c_reg_read_byte(s_i2c, DT_REG_ADDR(FXOS8700_NODE), REG_STATUS, &f_status);
+        if (err) break;
+        fifo_count = f_status & F_STATUS_CNT_MASK;
+        uint8_t batch_count = MIN(fifo_count, s_watermark);
+        if (!batch_count) break;
+        // one burst of batch_count samples (fifo reads wrap at the out regs)
+        err = i2c_burst_read(s_i2c, DT_REG_ADDR(FXOS8700_NODE), REG_OUT_X_MSB, s_raw,
+                             batch_count * SAMPLE_SIZE);
+        // magn isn't buffered by the fifo -- one reading is shared by the whole batch
+        uint8_t magn_raw[SAMPLE_SIZE];
+        if (!err) {
+            err = i2c_burst_read(s_i2c, DT_REG_ADDR(FXOS8700_NODE), REG_M_OUT_X_MSB, magn_raw,
+                                 sizeof(magn_raw));
+        }
+        if (err) break;
+
+        if (f_status & F_STATUS_OVF) {
+            LOG_WRN("FXOS8700 FIFO overflow.");
+        }
+        for (uint8_t i = 0; i < batch_count; i++, sample_idx++) {
+            AccelMagnData &sample = s_batch[i];
+            sample.timestamp = anchor + (sample_idx * (int32_t)s_sample_period_cyc);
+            decode_accel(&s_raw[i * SAMPLE_SIZE], sample);
+            decode_magn(magn_raw, sample);
+        }
+        s_output_sink->publish_accel_magn_batch(s_batch, batch_count);
+    } while (fifo_count > s_watermark);
+
+    return err;
+}
+
+static void fifo_thread_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        k_sem_take(&s_fifo_sem, K_FOREVER);
+        trace::handler_enter(trace::SOURCE_ACCEL_MAGN);
+        PERF_BEGIN(ACCEL_MAGN_READ);
+        int err = drain_fifo();
+        PERF_END(ACCEL_MAGN_READ);
+        trace::handler_exit(trace::SOURCE_ACCEL_MAGN, err);
+        if (err) {
+            LOG_ERR("FXOS8700 FIFO read err: %d.", err);
+        }
+    }
+}
+
+/// Configures output format, fifo & interrupt routing; publishes scale factors to the sink
+/// @param watermark Fifo watermark, or 0 to disable the fifo (data ready mode)
+static int configure(uint8_t watermark)
+{
+    int err = 0;
+    uint16_t addr = DT_REG_ADDR(FXOS8700_NODE);
+    // configure in standby
+    uint8_t data_cfg = 0;
+    err = i2c_reg_update_byte(s_i2c, addr, REG_CTRL_REG1, CTRL_REG1_ACTIVE, 0);
+    if (!err) err = i2c_reg_read_byte(s_i2c, addr, REG_XYZ_DATA_CFG, &data_cfg);
+    // hybrid auto-increment (accel -> magn) for single-burst data ready reads; off in fifo mode so
+    // that bursts wrap through the fifo instead
+    if (!err) {
+        err = i2c_reg_update_byte(s_i2c, addr, REG_M_CTRL_REG2, M_CTRL_REG2_HYB_AUTOINC,
+                                  watermark ? 0 : M_CTRL_REG2_HYB_AUTOINC);
+    }
+    if (!err && watermark) {
+        err = i2c_reg_write_byte(s_i2c, addr, REG_F_SETUP, F_SETUP_MODE_CIRCULAR | watermark);
+    }
+    if (!err && watermark) {
+        err = i2c_reg_update_byte(s_i2c, addr, REG_CTRL_REG4,
+                                  CTRL_REG4_INT_EN_FIFO | CTRL_REG4_INT_EN_DRDY,
+                                  CTRL_REG4_INT_EN_FIFO);
+    }
+    if (!err && watermark) {
+        uint8_t int_cfg = IS_ENABLED(CONFIG_FXOS8700_DRDY_INT1) ? 0 : CTRL_REG5_INT_CFG_FIFO;
+        err = i2c_reg_update_byte(s_i2c, addr, REG_CTRL_REG5, CTRL_REG5_INT_CFG_FIFO, int_cfg);
+    }
+    if (!err) {
+        err = i2c_reg_update_byte(s_i2c, addr, REG_CTRL_REG1, CTRL_REG1_ACTIVE, CTRL_REG1_ACTIVE);
+    }
+    if (err) {
+        LOG_ERR("Unable to configure FXOS8700; err: %d.", err);
+    }
+    // store conversion & timing params
+    if (!err) {
+        float accel_lsb_per_g = ACCEL_LSB_PER_G_2G / (1 << (data_cfg & XYZ_DATA_CFG_FS_MASK));
+        s_output_sink->set_accel_magn_scale(STANDARD_GRAVITY / accel_lsb_per_g,
+                                            MAGN_GAUSS_PER_LSB);
+        s_watermark = watermark;
+        s_sample_period_cyc = k_us_to_cyc_near32(1000000 / data_rate.val1);
+    }
+
+    return err;
+}
+
+static int setup_fifo_int()
+{
+    int err = 0;
+    s_int_gpio = device_get_binding(DT_GPIO_LABEL(FXOS8700_NODE, FXOS8700_FIFO_INT_GPIOS));
+    if (!s_int_gpio) {
+        LOG_ERR("FXOS8700 FIFO gpio binding failed.");
+        err = ENXIO;
+    }
+    // start fifo thread & enable interrupt
+    if (!err) {
+        k_tid_t tid = k_thread_create(&s_fifo_thread, s_fifo_stack,
+                                      K_THREAD_STACK_SIZEOF(s_fifo_stack), fifo_thread_func, NULL,
+                                      NULL, NULL, FIFO_THREAD_PRIO, 0, K_NO_WAIT);
+        k_thread_name_set(tid, "fxos8700 fifo");
+
+        gpio_pin_t pin = DT_GPIO_PIN(FXOS8700_NODE, FXOS8700_FIFO_INT_GPIOS);
+        err = gpio_pin_configure(
+            s_int_gpio, pin, GPIO_INPUT | DT_GPIO_FLAGS(FXOS8700_NODE, FXOS8700_FIFO_INT_GPIOS));
+        if (!err) {
+            gpio_init_callback(&s_int_cb, fifo_int_handler, BIT(pin));
+            err = gpio_add_callback(s_int_gpio, &s_int_cb);
+        }
+        if (!err) {
+            err = gpio_pin_interrupt_configure(s_int_gpio, pin, GPIO_INT_EDGE_TO_ACTIVE);
+        }
+        if (err) {
+            LOG_ERR("Unable to set FXOS8700 FIFO interrupt; err: %d.", err);
+        }
+    }
+
+    return err;
 }
 
 // public function definitions
-int fxos8700::setup(const char *dev_name, MargSensor *output_sink)
+int fxos8700::setup(const char *dev_name, MargSensor *output_sink, uint8_t fifo_watermark)
 {
     int err = 0;
     // input validation
@@ -52,11 +285,16 @@ int fxos8700::setup(const char *dev_name, MargSensor *output_sink)
         LOG_ERR("FXOS8700 nullptr error at line: %d.", __LINE__);
         err = EINVAL;
     }
-    // get device from name
+    if (fifo_watermark >= FIFO_SIZE) {
+        LOG_ERR("FXOS8700 FIFO watermark out of range: %d.", fifo_watermark);
+        err = EINVAL;
+    }
+    // get device from name (& its bus for raw reads)
     const struct device *dev;
     if (!err) {
         dev = device_get_binding(dev_name);
-        if (!dev) {
+        s_i2c = device_get_binding(DT_BUS_LABEL(FXOS8700_NODE));
+        if (!dev || !s_i2c) {
             LOG_ERR("FXOS8700 binding failed.");
             err = ENXIO;
         }
@@ -68,7 +306,15 @@ int fxos8700::setup(const char *dev_name, MargSensor *output_sink)
             LOG_ERR("Unable to set FXOS8700 sample rate; err: %d.", err);
         }
     }
+    s_output_sink = output_sink;
     if (!err) {
+        err = configure(fifo_watermark);
+    }
+    // either batch through the hw fifo, or read each sample on data ready
+    if (!err && fifo_watermark) {
+        err = setup_fifo_int();
+    }
+    else if (!err) {
         struct sensor_trigger trig = {
             .type = SENSOR_TRIG_DATA_READY,
             .chan = SENSOR_CHAN_ACCEL_XYZ,
@@ -79,6 +325,5 @@ int fxos8700::setup(const char *dev_name, MargSensor *output_sink)
         }
     }
 
-    s_output_sink = output_sink;
     return err;
 }
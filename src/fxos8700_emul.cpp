@@ -0,0 +1,396 @@
+/**
+ * @file	fxos8700_emul.cpp
+ * @author	Andrew Loebs
+ * @brief	I2C emulator of the FXOS8700 accelerometer/magnetometer (see sensor_emul.hpp)
+ *
+ * Models the registers the zephyr driver & fxos8700.cpp use: reset, who am i, output data rate
+ * (halved in hybrid mode), full scale, hybrid auto-increment, data ready & the 32 sample
+ * circular accel fifo, with their interrupts routed to INT1/INT2.
+ *
+ */
+
+#include <cstring>
+
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <logging/log.h>
+#include <zephyr.h>
+
+#include "sensor_emul.hpp"
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(fxos8700_emul, LOG_LEVEL_DBG);
+
+#define FXOS8700_NODE DT_INST(0, nxp_fxos8700)
+
+#if DT_NODE_HAS_STATUS(FXOS8700_NODE, okay)
+
+// constants
+static constexpr size_t REG_COUNT = 0x80;
+static constexpr uint8_t FIFO_SIZE = 32;
+static constexpr uint8_t WHOAMI = 0xC7;
+/// sample period by CTRL_REG1 data rate, single sensor mode (us)
+static constexpr uint32_t PERIOD_US[8] = {1250, 2500, 5000, 10000, 20000, 80000, 160000, 640000};
+
+// registers & bits
+static constexpr uint8_t REG_STATUS = 0x00; // F_STATUS while the fifo is enabled
+static constexpr uint8_t REG_OUT_X_MSB = 0x01;
+static constexpr uint8_t REG_OUT_Z_LSB = 0x06;
+static constexpr uint8_t REG_F_SETUP = 0x09;
+static constexpr uint8_t REG_INT_SOURCE = 0x0C;
+static constexpr uint8_t REG_WHOAMI = 0x0D;
+static constexpr uint8_t REG_XYZ_DATA_CFG = 0x0E;
+static constexpr uint8_t REG_CTRL_REG1 = 0x2A;
+static constexpr uint8_t REG_CTRL_REG2 = 0x2B;
+static constexpr uint8_t REG_CTRL_REG3 = 0x2C;
+static constexpr uint8_t REG_CTRL_REG4 = 0x2D;
+static constexpr uint8_t REG_CTRL_REG5 = 0x2E;
+static constexpr uint8_t REG_M_DR_STATUS = 0x32;
+static constexpr uint8_t REG_M_OUT_X_MSB = 0x33;
+static constexpr uint8_t REG_M_OUT_Z_LSB = 0x38;
+static constexpr uint8_t REG_M_CTRL_REG1 = 0x5B;
+static constexpr uint8_t REG_M_CTRL_REG2 = 0x5C;
+
+static constexpr uint8_t STATUS_ZYXOW = 0xF0;
+static constexpr uint8_t STATUS_ZYXDR = 0x0F;
+static constexpr uint8_t F_STATUS_OVF = BIT(7);
+static constexpr uint8_t F_STATUS_WMRK = BIT(6);
+static constexpr uint8_t F_SETUP_MODE_SHIFT = 6;
+static constexpr uint8_t F_SETUP_WMRK_MASK = 0x3F;
+static constexpr uint8_t INT_DRDY = BIT(0); // INT_SOURCE, CTRL_REG4 & CTRL_REG5 bits alike
+static constexpr uint8_t INT_FIFO = BIT(6);
+static constexpr uint8_t XYZ_DATA_CFG_FS_MASK = 0x03;
+static constexpr uint8_t CTRL_REG1_ACTIVE = BIT(0);
+static constexpr uint8_t CTRL_REG1_DR_SHIFT = 3;
+static constexpr uint8_t CTRL_REG1_DR_MASK = 0x07;
+static constexpr uint8_t CTRL_REG2_RST = BIT(6);
+static constexpr uint8_t CTRL_REG3_IPOL = BIT(1);
+static constexpr uint8_t M_CTRL_REG1_HMS_MASK = 0x03;
+static constexpr uint8_t M_CTRL_REG1_HYBRID = 0x03;
+static constexpr uint8_t M_CTRL_REG2_HYB_AUTOINC = BIT(5);
+
+static constexpr float ACCEL_LSB_PER_G_2G = 4096.0f; // 14-bit, halves per full scale step
+static constexpr float MAGN_LSB_PER_GAUSS = 1000.0f; // 0.1 uT
+static constexpr float STANDARD_GRAVITY = 9.80665f;  // m/s^2
+static constexpr float ACCEL_NOISE = 0.0018f * STANDARD_GRAVITY; // 126 ug/rtHz at 200 Hz
+static constexpr float MAGN_NOISE = 0.005f;
+
+// types
+struct FifoEntry {
+    int16_t accel[3]; // left justified
+    uint64_t sample_us;
+};
+
+/// register file & sample state (under s_lock)
+struct Device {
+    uint8_t regs[REG_COUNT];
+    int16_t accel[3]; // left justified, as the output registers
+    int16_t magn[3];
+    uint64_t sample_us;
+    bool is_accel_unread;
+    bool is_magn_unread;
+    uint8_t status; // ZYXDR & ZYXOW
+    uint8_t int_source;
+    FifoEntry fifo[FIFO_SIZE];
+    uint8_t fifo_head;
+    uint8_t fifo_count;
+    uint8_t f_status_flags; // OVF & WMRK
+    FifoEntry fifo_out;     // popped entry, as the output registers
+
+    void reset();
+    uint8_t read(uint8_t reg);
+    void write(uint8_t reg, uint8_t val);
+    uint8_t next(uint8_t reg) const;
+    bool is_fifo_enabled() const { return regs[REG_F_SETUP] >> F_SETUP_MODE_SHIFT; }
+    bool is_hybrid() const
+    {
+        return M_CTRL_REG1_HYBRID == (regs[REG_M_CTRL_REG1] & M_CTRL_REG1_HMS_MASK);
+    }
+};
+
+struct IntPin {
+    const struct device *gpio;
+    gpio_pin_t pin;
+};
+
+// private variables
+static struct k_spinlock s_lock;
+static Device s_device;
+static struct i2c_emul s_i2c_emul;
+static IntPin s_int_pins[2]; // INT1, INT2
+
+static void sample_timer_handler(struct k_timer *timer);
+K_TIMER_DEFINE(s_sample_timer, sample_timer_handler, NULL);
+
+// private function definitions
+static void put_int16(uint8_t *raw, int16_t val)
+{
+    raw[0] = (uint8_t)(val >> 8);
+    raw[1] = (uint8_t)val;
+}
+
+static int16_t saturate_int16(float val)
+{
+    return (int16_t)MAX(MIN(val, (float)INT16_MAX), (float)INT16_MIN);
+}
+
+/// restarts sampling at the configured rate, or stops it in standby
+static void update_sample_timer(const Device &device)
+{
+    uint8_t ctrl_reg1 = device.regs[REG_CTRL_REG1];
+    if (ctrl_reg1 & CTRL_REG1_ACTIVE) {
+        uint32_t period_us = PERIOD_US[(ctrl_reg1 >> CTRL_REG1_DR_SHIFT) & CTRL_REG1_DR_MASK];
+        if (device.is_hybrid()) period_us *= 2;
+        k_timer_start(&s_sample_timer, K_USEC(period_us), K_USEC(period_us));
+    }
+    else {
+        k_timer_stop(&s_sample_timer);
+    }
+}
+
+/// pin levels for the pending interrupts (IPOL clear: active low)
+static void get_int_levels(const Device &device, int levels[2])
+{
+    uint8_t pending = device.int_source & device.regs[REG_CTRL_REG4];
+    uint8_t on_int1 = device.regs[REG_CTRL_REG5]; // routing: 1 is INT1
+    bool is_active_high = device.regs[REG_CTRL_REG3] & CTRL_REG3_IPOL;
+    bool asserted[2] = {(pending & on_int1) != 0, (pending & ~on_int1) != 0};
+    for (int i = 0; i < 2; i++) {
+        levels[i] = (asserted[i] == is_active_high) ? 1 : 0;
+    }
+}
+
+/// drives the pins outside of s_lock (gpio callbacks run synchronously); unchanged levels raise
+/// no edge, and pins not configured as inputs yet are refused
+static void drive_int_pins(const int levels[2])
+{
+    for (int i = 0; i < 2; i++) {
+        if (s_int_pins[i].gpio) {
+            gpio_emul_input_set(s_int_pins[i].gpio, s_int_pins[i].pin, levels[i]);
+        }
+    }
+}
+
+void Device::reset()
+{
+    memset(this, 0, sizeof(*this));
+    regs[REG_WHOAMI] = WHOAMI;
+}
+
+uint8_t Device::read(uint8_t reg)
+{
+    if (REG_STATUS == reg) {
+        if (!is_fifo_enabled()) return status;
+        // reading f_status clears its flags & the fifo interrupt
+        uint8_t f_status = f_status_flags | fifo_count;
+        f_status_flags = 0;
+        int_source &= ~INT_FIFO;
+        return f_status;
+    }
+    if (reg >= REG_OUT_X_MSB && reg <= REG_OUT_Z_LSB) {
+        int offset = reg - REG_OUT_X_MSB;
+        if (is_fifo_enabled()) {
+            // each pass through the output registers pops one sample
+            if (0 == offset) {
+                if (fifo_count) {
+                    fifo_out = fifo[fifo_head];
+                    fifo_head = (fifo_head + 1) % FIFO_SIZE;
+                    fifo_count--;
+                    sensor_emul::record_read(sensor_emul::SENSOR_FXOS8700, fifo_out.sample_us);
+                }
+                else {
+                    memset(&fifo_out, 0, sizeof(fifo_out));
+                }
+            }
+            uint8_t raw[2];
+            put_int16(raw, fifo_out.accel[offset / 2]);
+            return raw[offset % 2];
+        }
+        // reading the data clears data ready
+        if (0 == offset && is_accel_unread) {
+            is_accel_unread = false;
+            status = 0;
+            int_source &= ~INT_DRDY;
+            sensor_emul::record_read(sensor_emul::SENSOR_FXOS8700, sample_us);
+        }
+        uint8_t raw[2];
+        put_int16(raw, accel[offset / 2]);
+        return raw[offset % 2];
+    }
+    if (REG_INT_SOURCE == reg) return int_source & regs[REG_CTRL_REG4];
+    if (REG_M_DR_STATUS == reg) return is_magn_unread ? STATUS_ZYXDR : 0;
+    if (reg >= REG_M_OUT_X_MSB && reg <= REG_M_OUT_Z_LSB) {
+        int offset = reg - REG_M_OUT_X_MSB;
+        if (0 == offset) is_magn_unread = false;
+        uint8_t raw[2];
+        put_int16(raw, magn[offset / 2]);
+        return raw[offset % 2];
+    }
+    return (reg < REG_COUNT) ? regs[reg] : 0;
+}
+
+void Device::write(uint8_t reg, uint8_t val)
+{
+    if (reg >= REG_COUNT) return;
+    switch (reg) {
+    case REG_CTRL_REG2:
+        if (val & CTRL_REG2_RST) {
+            // the real part doesn't ack this write; the driver ignores the error either way
+            reset();
+            update_sample_timer(*this);
+            return;
+        }
+        regs[reg] = val;
+        break;
+    case REG_CTRL_REG1:
+    case REG_M_CTRL_REG1:
+        regs[reg] = val;
+        update_sample_timer(*this);
+        break;
+    case REG_F_SETUP:
+        regs[reg] = val;
+        if (!is_fifo_enabled()) {
+            fifo_count = 0;
+            f_status_flags = 0;
+        }
+        break;
+    case REG_STATUS:
+    case REG_INT_SOURCE:
+    case REG_WHOAMI:
+    case REG_M_DR_STATUS:
+        break; // read only
+    default:
+        if ((reg < REG_OUT_X_MSB || reg > REG_OUT_Z_LSB) &&
+            (reg < REG_M_OUT_X_MSB || reg > REG_M_OUT_Z_LSB)) {
+            regs[reg] = val;
+        }
+        break;
+    }
+}
+
+uint8_t Device::next(uint8_t reg) const
+{
+    // fifo reads wrap through the accel output registers
+    if (REG_OUT_Z_LSB == reg && is_fifo_enabled()) return REG_OUT_X_MSB;
+    // hybrid auto-increment: status, accel, magn in one burst
+    if ((regs[REG_M_CTRL_REG2] & M_CTRL_REG2_HYB_AUTOINC) && is_hybrid()) {
+        if (REG_OUT_Z_LSB == reg) return REG_M_OUT_X_MSB;
+        if (REG_M_OUT_Z_LSB == reg) return REG_STATUS;
+    }
+    return (reg + 1) % REG_COUNT;
+}
+
+/// takes one sample of the trajectory, into the output registers or the fifo
+static void sample_timer_handler(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    sensor_emul::Truth truth = sensor_emul::get_truth();
+    uint64_t sample_us = sensor_emul::now_us();
+
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    Device &device = s_device;
+    float lsb_per_g = ACCEL_LSB_PER_G_2G /
+                      (1 << (device.regs[REG_XYZ_DATA_CFG] & XYZ_DATA_CFG_FS_MASK));
+    int16_t accel[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float g = (truth.accel[axis] + sensor_emul::noise(ACCEL_NOISE)) / STANDARD_GRAVITY;
+        // 14-bit, left justified
+        accel[axis] = (int16_t)(MAX(MIN(g * lsb_per_g, 8191.0f), -8192.0f)) * 4;
+        float gauss = truth.magn[axis] + sensor_emul::noise(MAGN_NOISE);
+        device.magn[axis] = saturate_int16(gauss * MAGN_LSB_PER_GAUSS);
+    }
+    device.is_magn_unread = true;
+    sensor_emul::record_produced(sensor_emul::SENSOR_FXOS8700);
+
+    if (device.is_fifo_enabled()) {
+        // circular mode: a full fifo drops its oldest sample
+        if (FIFO_SIZE == device.fifo_count) {
+            device.fifo_head = (device.fifo_head + 1) % FIFO_SIZE;
+            device.fifo_count--;
+            device.f_status_flags |= F_STATUS_OVF;
+            sensor_emul::record_dropped(sensor_emul::SENSOR_FXOS8700);
+        }
+        FifoEntry &entry = device.fifo[(device.fifo_head + device.fifo_count) % FIFO_SIZE];
+        memcpy(entry.accel, accel, sizeof(entry.accel));
+        entry.sample_us = sample_us;
+        device.fifo_count++;
+        uint8_t watermark = device.regs[REG_F_SETUP] & F_SETUP_WMRK_MASK;
+        if (watermark && device.fifo_count >= watermark) {
+            device.f_status_flags |= F_STATUS_WMRK;
+            device.int_source |= INT_FIFO;
+        }
+    }
+    else {
+        if (device.is_accel_unread) {
+            device.status |= STATUS_ZYXOW;
+            sensor_emul::record_dropped(sensor_emul::SENSOR_FXOS8700);
+        }
+        memcpy(device.accel, accel, sizeof(device.accel));
+        device.sample_us = sample_us;
+        device.is_accel_unread = true;
+        device.status |= STATUS_ZYXDR;
+        device.int_source |= INT_DRDY;
+    }
+    int levels[2];
+    get_int_levels(device, levels);
+    k_spin_unlock(&s_lock, key);
+
+    drive_int_pins(levels);
+}
+
+static int transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr)
+{
+    ARG_UNUSED(emul);
+    ARG_UNUSED(addr);
+
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    int err = sensor_emul::transfer_registers(s_device, msgs, num_msgs);
+    int levels[2];
+    get_int_levels(s_device, levels);
+    k_spin_unlock(&s_lock, key);
+
+    // reads clear interrupts
+    drive_int_pins(levels);
+    return err;
+}
+
+static const struct i2c_emul_api s_i2c_emul_api = {
+    .transfer = transfer,
+};
+
+/// binds an interrupt pin's gpio
+static void bind_int_pin(IntPin &int_pin, const char *label, gpio_pin_t pin)
+{
+    int_pin.gpio = device_get_binding(label);
+    int_pin.pin = pin;
+    if (!int_pin.gpio) {
+        LOG_ERR("FXOS8700 emulator gpio binding failed.");
+    }
+}
+
+static int emul_init(const struct emul *emul, const struct device *parent)
+{
+    s_device.reset();
+#if DT_NODE_HAS_PROP(FXOS8700_NODE, int1_gpios)
+    bind_int_pin(s_int_pins[0], DT_GPIO_LABEL(FXOS8700_NODE, int1_gpios),
+                 DT_GPIO_PIN(FXOS8700_NODE, int1_gpios));
+#endif
+#if DT_NODE_HAS_PROP(FXOS8700_NODE, int2_gpios)
+    bind_int_pin(s_int_pins[1], DT_GPIO_LABEL(FXOS8700_NODE, int2_gpios),
+                 DT_GPIO_PIN(FXOS8700_NODE, int2_gpios));
+#endif
+
+    s_i2c_emul.api = &s_i2c_emul_api;
+    s_i2c_emul.addr = DT_REG_ADDR(FXOS8700_NODE);
+    return i2c_emul_register(parent, emul->dev_label, &s_i2c_emul);
+}
+
+EMUL_DEFINE(emul_init, FXOS8700_NODE, NULL)
+
+#endif // DT_NODE_HAS_STATUS(FXOS8700_NODE, okay)
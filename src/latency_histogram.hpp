@@ -0,0 +1,74 @@
+/**
+ * @file		latency_histogram.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only template for a fixed-bucket latency histogram
+ *
+ * Constant time, allocation-free recording for hot paths; percentiles are resolved to a bucket's
+ * upper bound (or the exact max, if lower) when queried. Latencies past the last bucket are
+ * counted in it.
+ *
+ *
+ */
+
+#ifndef __LATENCY_HISTOGRAM_H
+#define __LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace z_quad_rotor {
+
+/// Histogram of latencies in microseconds
+/// @tparam N Number of buckets
+/// @tparam BUCKET_US Width of each bucket
+/// @note Not synchronized -- intended for one recording thread; readers get a best-effort view
+template <size_t N, uint32_t BUCKET_US>
+class LatencyHistogram {
+    static_assert(N >= 2 && BUCKET_US > 0, "Invalid histogram dimensions");
+
+  public:
+    LatencyHistogram() { reset(); }
+    /// Records one latency
+    void add(uint32_t latency_us)
+    {
+        size_t bucket = latency_us / BUCKET_US;
+        m_buckets[(bucket < N) ? bucket : (N - 1)]++;
+        m_count++;
+        if (latency_us > m_max_us) m_max_us = latency_us;
+    }
+    void reset()
+    {
+        for (size_t i = 0; i < N; i++) {
+            m_buckets[i] = 0;
+        }
+        m_count = 0;
+        m_max_us = 0;
+    }
+    uint32_t get_count() const { return m_count; }
+    uint32_t get_max() const { return m_max_us; }
+    /// Returns the latency (bucket upper bound) at or below which pct percent of samples fall
+    uint32_t get_percentile(uint32_t pct) const
+    {
+        // rank of the sample at pct, rounded up
+        uint64_t rank = (((uint64_t)m_count * pct) + 99) / 100;
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i < N; i++) {
+            cumulative += m_buckets[i];
+            if (rank && cumulative >= rank) {
+                // the max is exact, and the only bound on the overflow bucket
+                uint32_t bound = (i + 1) * BUCKET_US;
+                return ((i < N - 1) && (bound < m_max_us)) ? bound : m_max_us;
+            }
+        }
+        return 0;
+    }
+
+  private:
+    uint32_t m_buckets[N];
+    uint32_t m_count;
+    uint32_t m_max_us;
+};
+
+} // namespace z_quad_rotor
+
+#endif // __LATENCY_HISTOGRAM_H
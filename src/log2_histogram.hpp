@@ -0,0 +1,87 @@
+/**
+ * @file		log2_histogram.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only template for a power of two bucket histogram
+ *
+ * Bucket i counts values in [2^i, 2^(i+1)) (bucket 0 also counts 0), so a fixed, small bucket
+ * count spans the whole uint32_t range at a constant relative resolution -- suited to durations
+ * that span orders of magnitude. Recording is a count-leading-zeros & an increment. Percentiles
+ * resolve to a bucket's upper bound, clamped to the exact min & max.
+ *
+ *
+ */
+
+#ifndef __LOG2_HISTOGRAM_H
+#define __LOG2_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace z_quad_rotor {
+
+/// Histogram of uint32_t values in power of two buckets
+/// @tparam N Number of buckets; values of 2^(N-1) & up are counted in the last
+/// @note Not synchronized -- intended for one recording thread; readers get a best-effort view
+template <size_t N = 32>
+class Log2Histogram {
+    static_assert(N >= 2 && N <= 32, "Invalid histogram dimensions");
+
+  public:
+    static constexpr size_t BUCKET_COUNT = N;
+
+    Log2Histogram() { reset(); }
+    /// Records one value
+    void add(uint32_t val)
+    {
+        size_t bucket = bucket_of(val);
+        m_buckets[(bucket < N) ? bucket : (N - 1)]++;
+        m_count++;
+        if (val < m_min) m_min = val;
+        if (val > m_max) m_max = val;
+    }
+    void reset()
+    {
+        for (size_t i = 0; i < N; i++) {
+            m_buckets[i] = 0;
+        }
+        m_count = 0;
+        m_min = UINT32_MAX;
+        m_max = 0;
+    }
+    uint32_t get_count() const { return m_count; }
+    /// Returns the smallest value recorded (0 if none)
+    uint32_t get_min() const { return m_count ? m_min : 0; }
+    uint32_t get_max() const { return m_max; }
+    uint32_t get_bucket_count(size_t bucket) const { return m_buckets[bucket]; }
+    /// Returns the smallest value counted in a bucket
+    static uint32_t get_bucket_floor(size_t bucket) { return bucket ? (1u << bucket) : 0; }
+    /// Returns the value (bucket upper bound) at or below which pct percent of values fall
+    uint32_t get_percentile(uint32_t pct) const
+    {
+        // rank of the value at pct, rounded up
+        uint64_t rank = (((uint64_t)m_count * pct) + 99) / 100;
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i < N; i++) {
+            cumulative += m_buckets[i];
+            if (rank && cumulative >= rank) {
+                // the min & max are exact, and the max is the only bound on the last bucket
+                uint32_t bound = (i < N - 1) ? (get_bucket_floor(i + 1) - 1) : m_max;
+                if (bound > m_max) bound = m_max;
+                return (bound < m_min) ? m_min : bound;
+            }
+        }
+        return 0;
+    }
+
+  private:
+    uint32_t m_buckets[N];
+    uint32_t m_count;
+    uint32_t m_min;
+    uint32_t m_max;
+
+    static size_t bucket_of(uint32_t val) { return val ? (31 - __builtin_clz(val)) : 0; }
+};
+
+} // namespace z_quad_rotor
+
+#endif // __LOG2_HISTOGRAM_H
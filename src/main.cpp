@@ -7,46 +7,93 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <utility>
 
 #include <device.h>
-#include <drivers/adc.h>   // TODO: Delete -- for testing
-#include <hal/nrf_saadc.h> // TODO: Delete -- for testing
 #include <logging/log.h>
-#include <usb/usb_device.h>
+#include <shell/shell.h>
+#include <sys/atomic.h>
 #include <zephyr.h>
+#ifndef CONFIG_ARCH_POSIX
+#include <drivers/adc.h>
+#include <hal/nrf_saadc.h>
+#include <usb/usb_device.h>
+#endif
 
 #include "altitude.hpp"
+#include "bench.hpp"
+#include "blackbox.hpp"
+#include "controller.hpp"
 #include "dps310.hpp"
 #include "fxas21002.hpp"
 #include "fxos8700.hpp"
+#include "latency_histogram.hpp"
 #include "marg_sensor.hpp"
+#include "mixer.hpp"
+#include "motors.hpp"
 #include "orientation.hpp"
+#include "perf.hpp"
 #include "pressure_sensor.hpp"
+#include "replay.hpp"
+#include "sensor_emul.hpp"
+#include "sim_sensors.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 
 using namespace z_quad_rotor;
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 
 // constants
-static constexpr size_t DPS310_SAMPLING_STACK_SIZE = 1024;
-static constexpr int DPS310_SAMPLING_THREAD_PRIO = 10;
+// 32 Hz pressure at 16x (0.35 Pa precision), 1 Hz temperature at 1x -- 887 ms of measurement/s
+static constexpr dps310::Config DPS310_CONFIG = {5, 4, 0, 0};
+// samples per hw fifo batch; 0 fetches each sample on its data ready interrupt instead
+static constexpr uint8_t FXOS8700_FIFO_WATERMARK = 0;
+static constexpr uint8_t FXAS21002_FIFO_WATERMARK = 0;
+static constexpr size_t LATENCY_BUCKETS = 512;
+static constexpr uint32_t LATENCY_BUCKET_US = 25; // 12.8 ms range
+static constexpr uint32_t LOG_PERIOD_MS = 1000;
+// 1S LiPo, measured through the feather's 1:2 divider (VDIV on AIN5)
+static constexpr float VBATT_REFERENCE_MV = 3700.0f;
+static constexpr int32_t VBATT_DIVIDER = 2;
+static constexpr uint32_t BATTERY_PERIOD_MS = 100;
+static constexpr size_t BATTERY_STACK_SIZE = 1024;
+static constexpr int BATTERY_THREAD_PRIO = K_LOWEST_APPLICATION_THREAD_PRIO;
+// telemetry on the second cdc acm port (the first is the shell), one frame every 2 control loops
+static constexpr const char *TELEMETRY_DEV_NAME = "CDC_ACM_1";
+static constexpr uint32_t TELEMETRY_DIVIDER = 2;
+static constexpr size_t DUMP_BYTES_PER_LINE = 32;
+
+// types
+/// what wakes the control loop
+enum LoopMode {
+    LOOP_MODE_TIMER,      // free running k_timer (FUSION_UPDATE_RATE)
+    LOOP_MODE_DATA_READY, // each gyro sample publish
+    LOOP_MODE_COUNT,
+};
 
 // static objects
 static MargSensor marg_sensor;
 static PressureSensor pressure_sensor;
 
-static const RotationMatrix remap({1.0f, 0.0f, 0.0f}, // Identity matrix (TODO: create actual remap)
-                                  {0.0f, 1.0f, 0.0f}, // -
-                                  {0.0f, 0.0f, 1.0f});
-static Orientation<MadgwickFusion6> orientation(remap);
+static Orientation<MadgwickFusion6, IdentityRemap> orientation; // TODO: create actual remap
 static Altitude altitude;
+static AttitudeController controller;
+static Mixer motor_mixer(mixer::QUAD_X_MIX, VBATT_REFERENCE_MV);
 
-// threads
-static k_thread dps310_sampling_thread;
-K_THREAD_STACK_DEFINE(dps310_sampling_stack, DPS310_SAMPLING_STACK_SIZE);
+// motors only spin while armed; throttle (percent) is set along with arming, from the shell
+static atomic_t armed = ATOMIC_INIT(0);
+static atomic_t throttle_pct = ATOMIC_INIT(0);
 
-// TODO: delete -- for testing
-// timer to initiate orientation updates
+// control loop scheduling & sample (gyro data ready) to attitude latency, per loop mode; the
+// histograms are only written by the main thread (reset is requested through the flag)
+static atomic_t loop_mode = ATOMIC_INIT(LOOP_MODE_DATA_READY);
+static atomic_t latency_reset = ATOMIC_INIT(0);
+static LatencyHistogram<LATENCY_BUCKETS, LATENCY_BUCKET_US> loop_latency[LOOP_MODE_COUNT];
+static const char *const LOOP_MODE_NAMES[LOOP_MODE_COUNT] = {"timer", "drdy"};
+
+// timer to initiate orientation updates (timer loop mode)
 K_TIMER_DEFINE(orientation_update_timer, NULL, NULL);
 static const uint32_t FUSION_UPDATE_RATE = 10; // ms
 
@@ -56,28 +103,29 @@ static struct sensor_value float_to_sensor_value(float f)
     return {(int)f, (int)((f - floorf(f)) * 1000000)};
 }
 
-// dps310 sampling thread
-void dps310_sampling_thread_func(void *p1, void *p2, void *p3)
-{
-    ARG_UNUSED(p1);
-    ARG_UNUSED(p2);
-    ARG_UNUSED(p3);
+static uint16_t saturate_u16(uint32_t val) { return (val < UINT16_MAX) ? val : UINT16_MAX; }
 
-    for (;;) {
-        // sample at max rate (limited by conversion time)
-        dps310::read_pressure(&pressure_sensor);
-    }
+// battery voltage (mV), measured on a low priority thread -- an adc read blocks for the whole
+// conversion -- & read by the control loop; 0 until the first measurement
+static atomic_t battery_mv = ATOMIC_INIT(0);
+#ifdef CONFIG_ARCH_POSIX
+// native_posix: no adc, a battery at the reference voltage
+static bool setup_battery()
+{
+    atomic_set(&battery_mv, (atomic_val_t)VBATT_REFERENCE_MV);
+    return true;
 }
-
+#else
+static const struct device *battery_adc;
 static const struct adc_channel_cfg ccfg = {
-    .gain = ADC_GAIN_2,
+    .gain = ADC_GAIN_1_6, // 3.6 V full scale
     .reference = ADC_REF_INTERNAL,
     .acquisition_time = ADC_ACQ_TIME_DEFAULT,
     .channel_id = 0,
     .input_positive = NRF_SAADC_INPUT_AIN5,
 };
 static int16_t raw;
-static const struct adc_sequence seq = {
+static struct adc_sequence seq = { // calibrates on the first read only
     .channels = BIT(0),
     .buffer = &raw,
     .buffer_size = sizeof(raw),
@@ -85,74 +133,462 @@ static const struct adc_sequence seq = {
     .oversampling = 4,
     .calibrate = true,
 };
+static k_thread battery_thread;
+K_THREAD_STACK_DEFINE(battery_stack, BATTERY_STACK_SIZE);
 
-// main thread
-void main(void)
+/// reads the battery voltage (mV)
+static int read_battery_mv(int32_t &mv)
 {
-    // enable USB for shell backend
-    usb_enable(NULL);
+    int err = adc_read(battery_adc, &seq);
+    if (err) {
+        LOG_ERR("Error reading ADC: %d", err);
+    }
+    if (!err) {
+        seq.calibrate = false;
+        mv = raw;
+        err = adc_raw_to_millivolts(adc_ref_internal(battery_adc), ccfg.gain, seq.resolution, &mv);
+        if (err) {
+            LOG_ERR("Error converting ADC measurement: %d", err);
+        }
+    }
+    if (!err) mv *= VBATT_DIVIDER;
+    return err;
+}
+
+/// publishes a measurement every BATTERY_PERIOD_MS
+static void battery_thread_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        int32_t mv;
+        if (!read_battery_mv(mv)) {
+            atomic_set(&battery_mv, mv);
+        }
+        k_msleep(BATTERY_PERIOD_MS);
+    }
+}
 
-    // setup adc
-    const struct device *adc = device_get_binding(DT_LABEL(DT_INST(0, nordic_nrf_saadc)));
-    if (!adc) {
+/// binds & configures the adc, & starts measuring; returns false if the battery can't be measured
+static bool setup_battery()
+{
+    battery_adc = device_get_binding(DT_LABEL(DT_INST(0, nordic_nrf_saadc)));
+    if (!battery_adc) {
         LOG_ERR("ADC binding failed.");
+        return false;
+    }
+    int err = adc_channel_setup(battery_adc, &ccfg);
+    if (err) {
+        LOG_ERR("ADC channel setup error: %d", err);
+    }
+    if (!err) {
+        k_tid_t tid = k_thread_create(&battery_thread, battery_stack,
+                                      K_THREAD_STACK_SIZEOF(battery_stack), battery_thread_func,
+                                      NULL, NULL, NULL, BATTERY_THREAD_PRIO, 0, K_NO_WAIT);
+        k_thread_name_set(tid, "battery");
+    }
+    return !err;
+}
+#endif
+
+/// prints a blackbox chunk as hex lines, after a "chunk <index> <length>" line (tools/blackbox.py)
+static void dump_chunk(const uint8_t *data, size_t len, void *arg)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    auto &context = *static_cast<std::pair<const struct shell *, uint32_t> *>(arg);
+    shell_print(context.first, "chunk %u %u", context.second++, len);
+    char line[(2 * DUMP_BYTES_PER_LINE) + 1];
+    for (size_t offset = 0; offset < len; offset += DUMP_BYTES_PER_LINE) {
+        size_t count = MIN(DUMP_BYTES_PER_LINE, len - offset);
+        for (size_t i = 0; i < count; i++) {
+            line[2 * i] = HEX_DIGITS[data[offset + i] >> 4];
+            line[(2 * i) + 1] = HEX_DIGITS[data[offset + i] & 0x0F];
+        }
+        line[2 * count] = '\0';
+        shell_print(context.first, "%s", line);
+    }
+}
+
+// shell commands
+static int cmd_queues(const struct shell *shell, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    shell_print(shell, "FXOS8700 queue overflows:  %u", marg_sensor.get_accel_magn_overflows());
+    shell_print(shell, "FXAS21002 queue overflows: %u", marg_sensor.get_gyro_overflows());
+    shell_print(shell, "Fusion queue underflows:   %u", orientation.get_underflow_count());
+    return 0;
+}
+
+static int cmd_motors(const struct shell *shell, size_t argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "disarm")) {
+        atomic_set(&armed, 0);
+        atomic_set(&throttle_pct, 0);
     }
-    else {
-        int temp = adc_channel_setup(adc, &ccfg);
-        if (temp) {
-            LOG_ERR("ADC channel setup error: %d", temp);
+    else if (argc > 2 && !strcmp(argv[1], "arm")) {
+        int pct = atoi(argv[2]);
+        if (pct < 0 || pct > 100) {
+            shell_error(shell, "Throttle out of range: %d (0 - 100)", pct);
+            return -EINVAL;
         }
+        atomic_set(&throttle_pct, pct);
+        atomic_set(&armed, 1);
+    }
+    else if (argc > 1) {
+        shell_error(shell, "Usage: motors [arm <throttle %%>|disarm]");
+        return -EINVAL;
     }
+    shell_print(shell, "Motors %s, throttle %d%%", atomic_get(&armed) ? "armed" : "disarmed",
+                (int)atomic_get(&throttle_pct));
+    return 0;
+}
 
-    // setup sensors
-    int err = fxos8700::setup(DT_LABEL(DT_INST(0, nxp_fxos8700)), &marg_sensor);
+static int cmd_telemetry(const struct shell *shell, size_t argc, char **argv)
+{
+    if (argc > 1) {
+        int divider = atoi(argv[1]);
+        if (divider < 0) {
+            shell_error(shell, "Invalid divider: %d", divider);
+            return -EINVAL;
+        }
+        telemetry::set_divider(divider);
+    }
+    shell_print(shell, "Telemetry divider %u (0 is off), %u frames sent, %u dropped",
+                telemetry::get_divider(), telemetry::get_sent_count(),
+                telemetry::get_drop_count());
+    return 0;
+}
+
+static int cmd_perf(const struct shell *shell, size_t argc, char **argv)
+{
+    // one stage's buckets
+    if (argc > 1 && strcmp(argv[1], "reset")) {
+        int stage = 0;
+        while (stage < perf::STAGE_COUNT && strcmp(argv[1], perf::get_name((perf::Stage)stage))) {
+            stage++;
+        }
+        if (perf::STAGE_COUNT == stage) {
+            shell_error(shell, "Unknown stage: %s", argv[1]);
+            return -EINVAL;
+        }
+        const perf::Histogram &hist = perf::get_histogram((perf::Stage)stage);
+        shell_print(shell, "%s: cycles (ns) -- count", argv[1]);
+        for (size_t i = 0; i < perf::Histogram::BUCKET_COUNT; i++) {
+            if (!hist.get_bucket_count(i)) continue;
+            uint32_t floor = perf::Histogram::get_bucket_floor(i);
+            shell_print(shell, "  >= %10u (%10u) -- %u", floor, perf::cycles_to_ns(floor),
+                        hist.get_bucket_count(i));
+        }
+        return 0;
+    }
+
+    // every stage (then reset, if requested)
+    shell_print(shell, "%-11s %9s %10s %10s %10s %10s (us)", "stage", "n", "min", "p50", "p99",
+                "max");
+    for (int stage = 0; stage < perf::STAGE_COUNT; stage++) {
+        const perf::Histogram &hist = perf::get_histogram((perf::Stage)stage);
+        const uint32_t values[] = {hist.get_min(), hist.get_percentile(50),
+                                   hist.get_percentile(99), hist.get_max()};
+        uint32_t ns[ARRAY_SIZE(values)];
+        for (size_t i = 0; i < ARRAY_SIZE(values); i++) {
+            ns[i] = perf::cycles_to_ns(values[i]);
+        }
+        shell_print(shell, "%-11s %9u %6u.%03u %6u.%03u %6u.%03u %6u.%03u",
+                    perf::get_name((perf::Stage)stage), hist.get_count(), ns[0] / 1000,
+                    ns[0] % 1000, ns[1] / 1000, ns[1] % 1000, ns[2] / 1000, ns[2] % 1000,
+                    ns[3] / 1000, ns[3] % 1000);
+    }
+    if (argc > 1) {
+        perf::reset();
+        shell_print(shell, "Perf stats reset");
+    }
+    return 0;
+}
+
+static int cmd_blackbox(const struct shell *shell, size_t argc, char **argv)
+{
+    int err = 0;
+    if (argc > 1 && !strcmp(argv[1], "start")) {
+        blackbox::start();
+    }
+    else if (argc > 1 && !strcmp(argv[1], "stop")) {
+        blackbox::stop();
+    }
+    else if (argc > 1 && !strcmp(argv[1], "erase")) {
+        err = blackbox::erase();
+    }
+    else if (argc > 1 && !strcmp(argv[1], "dump")) {
+        std::pair<const struct shell *, uint32_t> context(shell, 0);
+        err = blackbox::for_each_chunk(dump_chunk, &context);
+    }
+    else if (argc > 1) {
+        shell_error(shell, "Usage: blackbox [start|stop|erase|dump]");
+        return -EINVAL;
+    }
+    if (err) {
+        shell_error(shell, "Blackbox err: %d%s", err, (EBUSY == err) ? " (stop it first)" : "");
+        return -EIO;
+    }
+
+    blackbox::Stats stats = blackbox::get_stats();
+    uint32_t ratio_x10 = stats.written_bytes ? (stats.raw_bytes * 10) / stats.written_bytes : 0;
+    shell_print(shell, "Blackbox %s: %u samples (%u dropped), %u -> %u bytes (%u.%ux), %u errors",
+                blackbox::is_running() ? "running" : "stopped", stats.samples, stats.dropped,
+                stats.raw_bytes, stats.written_bytes, ratio_x10 / 10, ratio_x10 % 10,
+                stats.write_errors);
+    return 0;
+}
+
+static int cmd_loop(const struct shell *shell, size_t argc, char **argv)
+{
+    if (argc > 1) {
+        int mode = LOOP_MODE_COUNT;
+        for (int i = 0; i < LOOP_MODE_COUNT; i++) {
+            if (!strcmp(argv[1], LOOP_MODE_NAMES[i])) mode = i;
+        }
+        if (LOOP_MODE_COUNT == mode) {
+            shell_error(shell, "Unknown loop mode: %s (timer, drdy)", argv[1]);
+            return -EINVAL;
+        }
+        atomic_set(&loop_mode, mode);
+    }
+    shell_print(shell, "Control loop mode: %s", LOOP_MODE_NAMES[atomic_get(&loop_mode)]);
+    return 0;
+}
+
+static int cmd_latency(const struct shell *shell, size_t argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "reset")) {
+        atomic_set(&latency_reset, 1);
+        shell_print(shell, "Latency stats reset");
+        return 0;
+    }
+
+    shell_print(shell, "Gyro data ready to attitude latency (us), by control loop mode:");
+    for (int i = 0; i < LOOP_MODE_COUNT; i++) {
+        const auto &hist = loop_latency[i];
+        shell_print(shell, "%-6s n %8u  p50 %6u  p90 %6u  p99 %6u  max %6u", LOOP_MODE_NAMES[i],
+                    hist.get_count(), hist.get_percentile(50), hist.get_percentile(90),
+                    hist.get_percentile(99), hist.get_max());
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_bench,
+    SHELL_CMD(altitude, NULL, "Table altitude error vs tolerance, cycles vs powf", bench::altitude),
+    SHELL_CMD(controller, NULL, "Attitude/rate controller cycles vs 1 kHz budget",
+              bench::controller),
+    SHELL_CMD(convert, NULL, "Raw count vs sensor_value MARG conversion cost", bench::convert),
+    SHELL_CMD(eskf, NULL, "ESKF cycles vs 1 kHz budget, sparse vs dense propagation", bench::eskf),
+    SHELL_CMD(fastmath, NULL, "fastmath max error vs bounds, cycles vs newlib", bench::fastmath),
+    SHELL_CMD(fusion, NULL, "Madgwick/Mahony cycles & accuracy (float, Q24, double)",
+              bench::fusion),
+    SHELL_CMD(madgwick9, NULL, "Restructured Madgwick9 vs golden reference (ulp, cycles)",
+              bench::madgwick9),
+    SHELL_CMD(mixer, NULL, "Thrust table error vs tolerance, cycles per mix", bench::mix),
+    SHELL_CMD(orientation, NULL, "Orientation drain cycles/step & steps/s", bench::orientation),
+    SHELL_CMD(seqlock, NULL, "SyncedVar vs SeqLockVar reader latency under contention",
+              bench::seqlock),
+    SHELL_SUBCMD_SET_END);
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_zqr, SHELL_CMD(bench, &sub_bench, "Run benchmarks", NULL),
+    SHELL_CMD(blackbox, NULL, "Blackbox log status/control ([start|stop|erase|dump])",
+              cmd_blackbox),
+    SHELL_COND_CMD(CONFIG_EMUL, emul, NULL,
+                   "Sensor emulator stats & trajectory (see sensor_emul.hpp)", sensor_emul::cmd),
+    SHELL_CMD(latency, NULL, "Print sample to attitude latency percentiles ([reset])",
+              cmd_latency),
+    SHELL_CMD(loop, NULL, "Get/set control loop wakeup ([timer|drdy])", cmd_loop),
+    SHELL_CMD(motors, NULL, "Get/set motor arming ([arm <throttle %>|disarm])", cmd_motors),
+    SHELL_CMD(perf, NULL, "Print per stage timing, then optionally reset ([reset|<stage>])",
+              cmd_perf),
+    SHELL_CMD(queues, NULL, "Print sample queue overflow/underflow counts", cmd_queues),
+    SHELL_COND_CMD(CONFIG_ARCH_POSIX, replay, NULL,
+                   "Replay a recording through the estimators (see tools/replay.py)", replay::cmd),
+    SHELL_CMD(telemetry, NULL, "Get/set telemetry decimation ([divider], 0 is off)",
+              cmd_telemetry),
+    SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(zqr, &sub_zqr, "z_quad_rotor commands", NULL);
+
+// main thread
+void main(void)
+{
+    // stage timing runs from before the first sensor trigger
+    perf::setup();
+
+#ifndef CONFIG_ARCH_POSIX
+    // enable USB for shell backend (native_posix: the shell is on stdin/stdout, no telemetry port)
+    usb_enable(NULL);
+    if (!telemetry::setup(TELEMETRY_DEV_NAME)) {
+        telemetry::set_divider(TELEMETRY_DIVIDER);
+    }
+#endif
+
+    bool has_battery = setup_battery();
+
+    // setup sensors & motors (native_posix: simulated or emulated sensors, commands go nowhere)
+#if defined(CONFIG_ARCH_POSIX) && !defined(CONFIG_EMUL)
+    sim_sensors::setup(&marg_sensor, &pressure_sensor);
+#else
+    int err = fxos8700::setup(DT_LABEL(DT_INST(0, nxp_fxos8700)), &marg_sensor,
+                              FXOS8700_FIFO_WATERMARK);
     if (!err) {
-        err = fxas21002::setup(DT_LABEL(DT_INST(0, nxp_fxas21002)), &marg_sensor);
+        err = fxas21002::setup(DT_LABEL(DT_INST(0, nxp_fxas21002)), &marg_sensor,
+                               FXAS21002_FIFO_WATERMARK);
     }
     if (!err) {
-        err = dps310::setup(DT_LABEL(DT_INST(0, infineon_dps310)));
+        err = dps310::setup(DT_LABEL(DT_INST(0, infineon_dps310)), &pressure_sensor,
+                            DPS310_CONFIG);
     }
-
-    // startup threads
+#ifndef CONFIG_ARCH_POSIX
     if (!err) {
-        k_tid_t dps310_sampling_tid = k_thread_create(
-            &dps310_sampling_thread, dps310_sampling_stack,
-            K_THREAD_STACK_SIZEOF(dps310_sampling_stack), dps310_sampling_thread_func, NULL, NULL,
-            NULL, DPS310_SAMPLING_THREAD_PRIO, 0, K_NO_WAIT);
-        err = k_thread_name_set(dps310_sampling_tid, "dps310 sampling");
-        if (err) {
-            LOG_ERR("Failed to set dps310 sampling thread name.");
-        }
+        err = motors::setup(DT_LABEL(DT_NODELABEL(pwm0)));
     }
+#endif
+#endif
 
-    uint32_t count = 0;
-    // start timer and perform fusion updates on sync
+    // the flight log is optional (errors are logged)
+    blackbox::setup();
+
+    uint32_t log_time_ms = k_uptime_get_32();
+    uint32_t battery_time_ms = log_time_ms;
+    uint32_t pressure_sequence = 0;
+    bool was_armed = false;
+    uint32_t last_wakeup = k_cycle_get_32();
+    uint32_t last_wakeup_cycles = perf::now();
+    uint32_t last_period_cycles = 0;
+    // start timer and perform fusion updates on sync (timer mode) or on each gyro sample
     k_timer_start(&orientation_update_timer, K_MSEC(FUSION_UPDATE_RATE),
                   K_MSEC(FUSION_UPDATE_RATE));
     for (;;) {
-        k_timer_status_sync(&orientation_update_timer);
-        // update orientation
-        MargData marg_data = marg_sensor.get_marg();
-        orientation.update(marg_data, FUSION_UPDATE_RATE);
-        // update altitude
-        struct sensor_value pressure = pressure_sensor.get_pressure();
-        altitude.update(pressure);
-        // use count to log values every 1 second
-        if (100 == count) {
-            // LOG_INF("AX:%3d.%06d AY:%3d.%06d AZ:%3d.%06d", marg_data.accel[0].val1,
-            //         abs(marg_data.accel[0].val2), marg_data.accel[1].val1,
-            //         abs(marg_data.accel[1].val2), marg_data.accel[2].val1,
-            //         abs(marg_data.accel[2].val2));
-
-            // LOG_INF("GX:%3d.%06d GY:%3d.%06d GZ:%3d.%06d", marg_data.gyro[0].val1,
-            //         abs(marg_data.gyro[0].val2), marg_data.gyro[1].val1,
-            //         abs(marg_data.gyro[1].val2), marg_data.gyro[2].val1,
-            //         abs(marg_data.gyro[2].val2));
-
-            // LOG_INF("MX:%3d.%06d MY:%3d.%06d MZ:%3d.%06d", marg_data.magn[0].val1,
-            //         abs(marg_data.magn[0].val2), marg_data.magn[1].val1,
-            //         abs(marg_data.magn[1].val2), marg_data.magn[2].val1,
-            //         abs(marg_data.magn[2].val2));
+        int mode = atomic_get(&loop_mode);
+        if (LOOP_MODE_DATA_READY == mode) {
+            // times out (counted as an underflow by drain) rather than stalling without samples
+            marg_sensor.wait_gyro(K_MSEC(FUSION_UPDATE_RATE));
+        }
+        else {
+            k_timer_status_sync(&orientation_update_timer);
+        }
+        uint32_t wakeup = k_cycle_get_32();
+        // period & jitter at timing counter resolution (k_cycle_get_32 is a 32 kHz rtc on target)
+        uint32_t wakeup_cycles = perf::now();
+        uint32_t period_cycles = wakeup_cycles - last_wakeup_cycles;
+        perf::record(perf::STAGE_LOOP_PERIOD, period_cycles);
+        if (last_period_cycles) {
+            int32_t jitter_cycles = (int32_t)(period_cycles - last_period_cycles);
+            perf::record(perf::STAGE_LOOP_JITTER, (uint32_t)abs(jitter_cycles));
+        }
+        last_wakeup_cycles = wakeup_cycles;
+        last_period_cycles = period_cycles;
+        // update orientation from every sample queued since the last update, propagating altitude,
+        // running the controller (at the gyro rate) & logging over each fusion step
+        uint32_t timestamps[MargSensor::QUEUE_DEPTH];
+        size_t step_count = 0;
+        trace::fusion_start();
+        PERF_BEGIN(DRAIN);
+        size_t drained = orientation.drain(marg_sensor, [&](const FusionStep &step) {
+            PERF_BEGIN(ALTITUDE_PREDICT);
+            altitude.predict(step.accel_up, step.time_diff_us);
+            PERF_END(ALTITUDE_PREDICT);
+            PERF_BEGIN(CONTROLLER);
+            linalg::vec<float, 3> torque =
+                controller.update(step.quat, step.gyro, step.time_diff_us);
+            PERF_END(CONTROLLER);
+            if (blackbox::is_running()) {
+                blackbox::Sample sample = {step.timestamp, step.marg_data, step.quat,
+                                           controller.get_rate_setpoint(), torque};
+                blackbox::log(sample);
+            }
+            if (step_count < ARRAY_SIZE(timestamps)) timestamps[step_count++] = step.timestamp;
+        });
+        PERF_END(DRAIN);
+        trace::fusion_end(drained);
+        // every step's sample is reflected in the attitude from here
+        uint32_t now = k_cycle_get_32();
+        if (atomic_cas(&latency_reset, 1, 0)) {
+            for (auto &hist : loop_latency) {
+                hist.reset();
+            }
+        }
+        for (size_t i = 0; i < step_count; i++) {
+            loop_latency[mode].add(k_cyc_to_us_near32(now - timestamps[i]));
+        }
+        // mix the newest torque command for the motors (stopped while disarmed or at idle
+        // throttle); the controller is held reset until the throttle is past idle, as the frame
+        // can't rotate on the ground & the integral would wind up. The blackbox logs while armed.
+        bool is_armed = atomic_get(&armed);
+        float throttle = is_armed ? atomic_get(&throttle_pct) * 0.01f : 0.0f;
+        if (is_armed && !was_armed) {
+            blackbox::start();
+        }
+        else if (!is_armed && was_armed) {
+            blackbox::stop();
+        }
+        was_armed = is_armed;
+        if (throttle < Mixer::IDLE_THROTTLE) {
+            controller.reset();
+        }
+        PERF_BEGIN(MIX);
+        MotorCommands commands = motor_mixer.mix(controller.get_output(), throttle);
+#ifndef CONFIG_ARCH_POSIX
+        motors::set(commands);
+#else
+        ARG_UNUSED(commands);
+#endif
+        PERF_END(MIX);
+        // compensate motor commands for battery sag (the filter runs at the measurement rate)
+        if (has_battery && (k_uptime_get_32() - battery_time_ms) >= BATTERY_PERIOD_MS) {
+            motor_mixer.set_battery_voltage(atomic_get(&battery_mv));
+            battery_time_ms += BATTERY_PERIOD_MS;
+        }
+        // queue a telemetry frame (decimated); framing & crc run on the telemetry thread
+        if (telemetry::is_due()) {
+            telemetry::Frame frame = {};
+            frame.timestamp_us = k_cyc_to_us_floor32(wakeup);
+            Quaternion quat = orientation.get_quaternion();
+            memcpy(frame.quat, &quat, sizeof(frame.quat));
+            frame.altitude = altitude.get_altitude();
+            frame.climb_rate = altitude.get_velocity();
+            PERF_BEGIN(GET_MARG);
+            MargData marg_data = marg_sensor.get_marg();
+            PERF_END(GET_MARG);
+            memcpy(frame.accel, marg_data.accel, sizeof(frame.accel));
+            memcpy(frame.gyro, marg_data.gyro, sizeof(frame.gyro));
+            memcpy(frame.magn, marg_data.magn, sizeof(frame.magn));
+            frame.loop_period_us = saturate_u16(k_cyc_to_us_near32(wakeup - last_wakeup));
+            if (step_count) {
+                uint32_t newest = timestamps[step_count - 1];
+                frame.latency_us = saturate_u16(k_cyc_to_us_near32(now - newest));
+            }
+            frame.step_count = (uint8_t)step_count; // at most MargSensor::QUEUE_DEPTH
+            frame.flags = is_armed ? telemetry::FLAG_ARMED : 0;
+            telemetry::publish(frame);
+        }
+        last_wakeup = wakeup;
+        // correct altitude with each new pressure sample
+        struct sensor_value pressure;
+        if (pressure_sensor.get_new_pressure(pressure, pressure_sequence)) {
+            PERF_BEGIN(ALTITUDE_UPDATE);
+            altitude.update(pressure);
+            PERF_END(ALTITUDE_UPDATE);
+            blackbox::log_pressure(pressure);
+        }
+        // log values every second
+        if ((k_uptime_get_32() - log_time_ms) >= LOG_PERIOD_MS) {
+            // MargData marg_data = marg_sensor.get_marg();
+            // LOG_INF("AX:%6d AY:%6d AZ:%6d (counts)", marg_data.accel[0], marg_data.accel[1],
+            //         marg_data.accel[2]);
+
+            // LOG_INF("GX:%6d GY:%6d GZ:%6d (counts)", marg_data.gyro[0], marg_data.gyro[1],
+            //         marg_data.gyro[2]);
+
+            // LOG_INF("MX:%6d MY:%6d MZ:%6d (counts)", marg_data.magn[0], marg_data.magn[1],
+            //         marg_data.magn[2]);
             // EulerAngle euler_angle = orientation.get_euler_angle() * RAD_TO_DEG;
             // struct sensor_value roll = float_to_sensor_value(euler_angle.x);
             // struct sensor_value pitch = float_to_sensor_value(euler_angle.y);
@@ -164,26 +600,11 @@ void main(void)
             // struct sensor_value height = float_to_sensor_value(height_f);
             // LOG_INF("Altitude:%3d.%06d", height.val1, height.val2);
 
-            if (adc) {
-                err = adc_read(adc, &seq);
-                if (err) {
-                    LOG_ERR("Error reading ADC: %d", err);
-                }
-                else {
-                    int32_t val = raw;
-                    err = adc_raw_to_millivolts(adc_ref_internal(adc), ccfg.gain, seq.resolution,
-                                                &val);
-                    if (err) {
-                        LOG_ERR("Error converting ADC measurement: %d", err);
-                    }
-                    else {
-                        LOG_INF("V Batt: %d", val);
-                    }
-                }
+            if (has_battery) {
+                LOG_INF("V Batt: %d", (int)atomic_get(&battery_mv));
             }
 
-            count = 0; // reset
+            log_time_ms += LOG_PERIOD_MS;
         }
-        count++;
     }
 }
\ No newline at end of file
@@ -11,47 +11,189 @@
 #ifndef __MARG_SENSOR_H
 #define __MARG_SENSOR_H
 
-#include <drivers/sensor.h>
+#include <cstdint>
+
+#include <zephyr.h>
 
 #include "linalg.h"
 
-#include "synced_var.hpp"
+#include "scalar_traits.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
 
 namespace z_quad_rotor {
 
-/// Structure for 9DOF data
-struct MargData {
-    struct sensor_value accel[3];
-    struct sensor_value gyro[3];
-    struct sensor_value magn[3];
+/// Structure for accel/magn data (sampled together by the FXOS8700); raw counts
+struct __packed AccelMagnData {
+    uint32_t timestamp; // hw cycles (k_cycle_get_32) at data ready
+    int16_t accel[3];
+    int16_t magn[3];
+};
+
+/// Structure for gyro data (sampled by the FXAS21002); raw counts
+struct __packed GyroData {
+    uint32_t timestamp; // hw cycles (k_cycle_get_32) at data ready
+    int16_t gyro[3];
+};
+
+/// Structure for 9DOF data; raw counts
+struct __packed MargData {
+    int16_t accel[3];
+    int16_t gyro[3];
+    int16_t magn[3];
 };
 
-struct MargDataFloat {
-    linalg::vec<float, 3> accel;
-    linalg::vec<float, 3> gyro;
-    linalg::vec<float, 3> magn;
-    MargDataFloat(MargData &in)
-        : accel(sensor_value_to_double(&in.accel[0]), sensor_value_to_double(&in.accel[1]),
-                sensor_value_to_double(&in.accel[2])),
-          gyro(sensor_value_to_double(&in.gyro[0]), sensor_value_to_double(&in.gyro[1]),
-               sensor_value_to_double(&in.gyro[2])),
-          magn(sensor_value_to_double(&in.magn[0]), sensor_value_to_double(&in.magn[1]),
-               sensor_value_to_double(&in.magn[2]))
+/// Per-sensor scale factors, raw count -> unit
+template <class S>
+struct MargScaleT {
+    S accel; // (m/s^2) / count
+    S gyro;  // (rad/s) / count
+    S magn;  // gauss / count
+};
+
+using MargScale = MargScaleT<float>;
+
+/// Converts scale factors to the scale type used by scalar type S
+template <class S>
+static inline MargScaleT<typename ScalarTraits<S>::Scale> scale_cast(const MargScale &scale)
+{
+    using Scale = typename ScalarTraits<S>::Scale;
+    return {Scale(scale.accel), Scale(scale.gyro), Scale(scale.magn)};
+}
+
+/// Combines a sample from each sensor into 9DOF data
+static inline MargData make_marg_data(const AccelMagnData &accel_magn, const GyroData &gyro)
+{
+    MargData marg_data;
+    for (int i = 0; i < 3; i++) {
+        marg_data.accel[i] = accel_magn.accel[i];
+        marg_data.gyro[i] = gyro.gyro[i];
+        marg_data.magn[i] = accel_magn.magn[i];
+    }
+    return marg_data;
+}
+
+/// 9DOF data in units, with scalar type S
+template <class S>
+struct MargDataT {
+    using Vec = linalg::vec<S, 3>;
+    using Scale = MargScaleT<typename ScalarTraits<S>::Scale>;
+
+    Vec accel;
+    Vec gyro;
+    Vec magn;
+    MargDataT(const Vec &accel_in, const Vec &gyro_in, const Vec &magn_in)
+        : accel(accel_in), gyro(gyro_in), magn(magn_in)
+    {
+    }
+    /// Converts raw counts to units; one multiply per axis
+    MargDataT(const MargData &in, const Scale &scale)
+        : accel(from_counts(in.accel[0], in.accel[1], in.accel[2], scale.accel)),
+          gyro(from_counts(in.gyro[0], in.gyro[1], in.gyro[2], scale.gyro)),
+          magn(from_counts(in.magn[0], in.magn[1], in.magn[2], scale.magn))
+    {
+    }
+
+  private:
+    static Vec from_counts(int16_t x, int16_t y, int16_t z, typename ScalarTraits<S>::Scale scale)
     {
+        return {ScalarTraits<S>::from_counts(x, scale), ScalarTraits<S>::from_counts(y, scale),
+                ScalarTraits<S>::from_counts(z, scale)};
     }
 };
 
+using MargDataFloat = MargDataT<float>;
+
 /// Manages read/write access to MARG sensor data
+/// @note Each sensor publishes through its own triple buffer (newest sample) and SPSC queue (every
+/// sample), so writers never wait on each other or on the reader. Each read side must only be used
+/// from a single consumer thread.
 class MargSensor {
   public:
-    /// Returns the current MARG sensor data.
-    /// @note Will block until data lock is available
-    MargData get_marg() { return m_marg_data.get_read_lock().get_var(); }
-    /// Returns a write lock to the MARG sensor data
-    WriteLock<MargData> get_write_lock() { return m_marg_data.get_write_lock(); }
+    /// Number of samples each sensor queue can hold
+    static constexpr size_t QUEUE_DEPTH = 64; // > two full hw FIFO batches
+
+    MargSensor() { k_sem_init(&m_gyro_ready, 0, 1); }
+
+    /// Returns the newest complete MARG sensor data.
+    /// @note Never blocks; accel and magn are always from the same sample
+    MargData get_marg()
+    {
+        return make_marg_data(m_accel_magn.get_read_slot(), m_gyro.get_read_slot());
+    }
+    /// Returns the scale factors for converting raw counts to units
+    const MargScale &get_scale() const { return m_scale; }
+    /// Pops the oldest queued accel/magn sample; returns false if none are queued
+    bool pop_accel_magn(AccelMagnData &data) { return m_accel_magn_queue.pop(data); }
+    /// Copies the oldest queued accel/magn sample without popping; returns false if none are queued
+    bool peek_accel_magn(AccelMagnData &data) const { return m_accel_magn_queue.peek(data); }
+    /// Pops the oldest queued gyro sample; returns false if none are queued
+    bool pop_gyro(GyroData &data) { return m_gyro_queue.pop(data); }
+    /// Blocks until gyro data has been published since the last wait (single consumer)
+    /// @return 0 on data ready, -EAGAIN on timeout
+    int wait_gyro(k_timeout_t timeout) { return k_sem_take(&m_gyro_ready, timeout); }
+    /// Returns the number of accel/magn samples dropped on a full queue
+    uint32_t get_accel_magn_overflows() const { return m_accel_magn_queue.get_overflow_count(); }
+    /// Returns the number of gyro samples dropped on a full queue
+    uint32_t get_gyro_overflows() const { return m_gyro_queue.get_overflow_count(); }
+
+    /// Sets the accel/magn scale factors (set once by the producer during setup)
+    void set_accel_magn_scale(float accel, float magn)
+    {
+        m_scale.accel = accel;
+        m_scale.magn = magn;
+    }
+    /// Sets the gyro scale factor (set once by the producer during setup)
+    void set_gyro_scale(float gyro) { m_scale.gyro = gyro; }
+
+    /// Returns the accel/magn producer's private slot to be filled (single writer)
+    AccelMagnData &get_accel_magn_slot() { return m_accel_magn.get_write_slot(); }
+    /// Publishes the filled accel/magn slot as newest sample and queues a copy
+    void publish_accel_magn()
+    {
+        m_accel_magn_queue.push(m_accel_magn.get_write_slot());
+        m_accel_magn.publish();
+    }
+    /// Publishes a batch of accel/magn samples (oldest first): every sample is queued and the last
+    /// becomes the newest sample
+    void publish_accel_magn_batch(const AccelMagnData *batch, size_t count)
+    {
+        if (count == 0) return;
+        for (size_t i = 0; i < count; i++) {
+            m_accel_magn_queue.push(batch[i]);
+        }
+        m_accel_magn.get_write_slot() = batch[count - 1];
+        m_accel_magn.publish();
+    }
+    /// Returns the gyro producer's private slot to be filled (single writer)
+    GyroData &get_gyro_slot() { return m_gyro.get_write_slot(); }
+    /// Publishes the filled gyro slot as newest sample and queues a copy
+    void publish_gyro()
+    {
+        m_gyro_queue.push(m_gyro.get_write_slot());
+        m_gyro.publish();
+        k_sem_give(&m_gyro_ready);
+    }
+    /// Publishes a batch of gyro samples (oldest first): every sample is queued and the last
+    /// becomes the newest sample
+    void publish_gyro_batch(const GyroData *batch, size_t count)
+    {
+        if (count == 0) return;
+        for (size_t i = 0; i < count; i++) {
+            m_gyro_queue.push(batch[i]);
+        }
+        m_gyro.get_write_slot() = batch[count - 1];
+        m_gyro.publish();
+        k_sem_give(&m_gyro_ready);
+    }
 
   protected:
-    SyncedVar<MargData> m_marg_data;
+    MargScale m_scale = {};
+    TripleBuffer<AccelMagnData> m_accel_magn;
+    TripleBuffer<GyroData> m_gyro;
+    SpscQueue<AccelMagnData, QUEUE_DEPTH> m_accel_magn_queue;
+    SpscQueue<GyroData, QUEUE_DEPTH> m_gyro_queue;
+    struct k_sem m_gyro_ready; // binary; given on every gyro publish
 };
 
 } // namespace z_quad_rotor
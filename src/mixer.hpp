@@ -0,0 +1,233 @@
+/**
+ * @file		mixer.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only motor mixing module
+ *
+ * Maps roll/pitch/yaw torque & throttle demands to motor commands: a mixing matrix generated at
+ * compile time from the frame layout, a compile time thrust curve linearization table, and battery
+ * voltage compensation.
+ *
+ *
+ */
+
+#ifndef __MIXER_H
+#define __MIXER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "linalg.h"
+
+namespace z_quad_rotor {
+
+constexpr size_t MOTOR_COUNT = 4;
+
+/// Normalized motor commands (0 - 1), in motor order
+using MotorCommands = linalg::vec<float, MOTOR_COUNT>;
+
+namespace mixer {
+
+/// Motor position in the body frame (x forward, y left; arm length is irrelevant) & prop spin
+struct MotorGeometry {
+    float x;
+    float y;
+    float spin; // +1 clockwise seen from above (reaction torque is +z yaw), -1 counterclockwise
+};
+
+/// Quad-X: front right, rear left (counterclockwise), front left, rear right (clockwise)
+constexpr MotorGeometry QUAD_X_MOTORS[MOTOR_COUNT] = {
+    {1.0f, -1.0f, -1.0f}, {-1.0f, 1.0f, -1.0f}, {1.0f, 1.0f, 1.0f}, {-1.0f, -1.0f, 1.0f}};
+/// Quad-+: right, left (counterclockwise), front, rear (clockwise)
+constexpr MotorGeometry QUAD_PLUS_MOTORS[MOTOR_COUNT] = {
+    {0.0f, -1.0f, -1.0f}, {0.0f, 1.0f, -1.0f}, {1.0f, 0.0f, 1.0f}, {-1.0f, 0.0f, 1.0f}};
+
+/// Per motor thrust factors for unit roll, pitch & yaw torque demands
+struct MixMatrix {
+    float factors[MOTOR_COUNT][3];
+};
+
+constexpr float const_abs(float x) { return (x < 0.0f) ? -x : x; }
+
+/// Roll (+x) is lifted by motors on the left (+y), pitch (+y, nose down) by motors at the rear
+/// (-x), yaw by the reaction torque of clockwise props; each axis is normalized to a peak factor
+/// of 1, so a unit demand spans the full command range
+constexpr MixMatrix make_mix_matrix(const MotorGeometry (&motors)[MOTOR_COUNT])
+{
+    MixMatrix matrix = {};
+    float peak[3] = {};
+    for (size_t i = 0; i < MOTOR_COUNT; i++) {
+        const float factors[3] = {motors[i].y, -motors[i].x, motors[i].spin};
+        for (size_t axis = 0; axis < 3; axis++) {
+            matrix.factors[i][axis] = factors[axis];
+            if (const_abs(factors[axis]) > peak[axis]) peak[axis] = const_abs(factors[axis]);
+        }
+    }
+    for (size_t i = 0; i < MOTOR_COUNT; i++) {
+        for (size_t axis = 0; axis < 3; axis++) {
+            matrix.factors[i][axis] /= peak[axis];
+        }
+    }
+    return matrix;
+}
+
+constexpr MixMatrix QUAD_X_MIX = make_mix_matrix(QUAD_X_MOTORS);
+constexpr MixMatrix QUAD_PLUS_MIX = make_mix_matrix(QUAD_PLUS_MOTORS);
+
+} // namespace mixer
+
+/// Thrust curve linearization. Static thrust follows T = (1 - EXPO) c + EXPO c^2 of the normalized
+/// command c (close to quadratic for fixed pitch props); the table holds the inverse, tabulated at
+/// compile time.
+namespace thrust {
+
+constexpr double EXPO = 0.5; // airframe dependent -- 0 is linear, 1 is pure quadratic
+constexpr size_t TABLE_SIZE = 65;
+constexpr double STEP = 1.0 / (TABLE_SIZE - 1);
+/// Max command error, & the share of it reserved for float rounding at run time
+constexpr double TOLERANCE = 0.001;
+constexpr double ROUNDING = 0.0001;
+
+/// sqrt(x) for x >= 0 by Newton's method; compile time only
+constexpr double const_sqrt(double x)
+{
+    double root = (x > 1.0) ? x : 1.0;
+    for (int i = 0; i < 64; i++) {
+        root = 0.5 * (root + x / root);
+    }
+    return root;
+}
+
+/// Normalized thrust at a command (0 - 1) -- the thrust curve itself
+static inline float thrust_at(float command)
+{
+    return ((float)(1.0 - EXPO) * command) + ((float)EXPO * command * command);
+}
+
+/// Command giving a normalized thrust -- the positive root of the thrust curve
+constexpr double command(double thrust)
+{
+    const double linear = 1.0 - EXPO;
+    if (EXPO == 0.0) return thrust;
+    return (const_sqrt(linear * linear + 4.0 * EXPO * thrust) - linear) / (2.0 * EXPO);
+}
+
+/// Linear interpolation error is at most max|c''| step^2 / 8; c'' = -2 EXPO / (linear^2 + 4 EXPO
+/// thrust)^(3/2) is largest at zero thrust
+constexpr double interpolation_error()
+{
+    const double linear = 1.0 - EXPO;
+    return (2.0 * EXPO / (linear * linear * linear)) * STEP * STEP / 8.0;
+}
+static_assert(interpolation_error() + ROUNDING <= TOLERANCE,
+              "Thrust table too coarse for tolerance");
+
+struct CommandTable {
+    float commands[TABLE_SIZE];
+};
+
+constexpr CommandTable make_command_table()
+{
+    CommandTable table = {};
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        table.commands[i] = (float)command(i * STEP);
+    }
+    return table;
+}
+
+constexpr CommandTable COMMAND_TABLE = make_command_table();
+
+/// Command giving a normalized thrust (0 - 1, clamped); a table lookup & linear interpolation
+static inline float linearize(float thrust)
+{
+    if (thrust <= 0.0f) return 0.0f;
+    if (thrust >= 1.0f) return 1.0f;
+    float position = thrust * (float)(TABLE_SIZE - 1);
+    int32_t index = (int32_t)position;
+    if (index > (int32_t)TABLE_SIZE - 2) index = TABLE_SIZE - 2;
+    float fraction = position - index;
+    float low = COMMAND_TABLE.commands[index];
+    return low + fraction * (COMMAND_TABLE.commands[index + 1] - low);
+}
+
+} // namespace thrust
+
+/// Mixes torque & throttle demands into linearized, battery compensated motor commands
+/// @note Not synchronized -- mix & set_battery_voltage must be called from the control thread
+class Mixer {
+  public:
+    /// Throttle below which the motors are stopped, whatever the torque demand (on the ground)
+    constexpr static float IDLE_THROTTLE = 0.05f;
+
+    /// Constructor
+    /// @param matrix Mixing matrix of the frame layout (e.g. mixer::QUAD_X_MIX)
+    /// @param reference_mv Battery voltage the thrust curve (& controller gains) are tuned at
+    Mixer(const mixer::MixMatrix &matrix, float reference_mv)
+        : m_matrix(matrix), m_reference_mv(reference_mv), m_battery_gain(1.0f),
+          m_max_thrust(1.0f)
+    {
+    }
+    /// Returns motor commands for normalized torque (roll, pitch, yaw) & throttle (0 - 1) demands.
+    /// Torque takes priority: it is scaled down if its spread exceeds the thrust range left by the
+    /// battery compensation, then throttle is shifted so that no motor saturates. Below
+    /// IDLE_THROTTLE, every command is zero.
+    MotorCommands mix(const linalg::vec<float, 3> &torque, float throttle) const
+    {
+        if (throttle < IDLE_THROTTLE) return MotorCommands(0.0f);
+
+        MotorCommands differential;
+        for (size_t i = 0; i < MOTOR_COUNT; i++) {
+            const float(&factors)[3] = m_matrix.factors[i];
+            differential[i] =
+                (factors[0] * torque.x) + (factors[1] * torque.y) + (factors[2] * torque.z);
+        }
+        const float low = linalg::minelem(differential);
+        const float high = linalg::maxelem(differential);
+        if ((high - low) > m_max_thrust) {
+            const float scale = m_max_thrust / (high - low);
+            differential *= scale;
+            throttle = -low * scale;
+        }
+        else if (throttle < -low) {
+            throttle = -low;
+        }
+        else if (throttle > m_max_thrust - high) {
+            throttle = m_max_thrust - high;
+        }
+
+        MotorCommands commands;
+        for (size_t i = 0; i < MOTOR_COUNT; i++) {
+            // within the table tolerance of 1 at m_max_thrust
+            const float command = thrust::linearize(throttle + differential[i]) * m_battery_gain;
+            commands[i] = (command < 1.0f) ? command : 1.0f;
+        }
+        return commands;
+    }
+    /// Updates the battery voltage compensation. Prop speed (& so the linearized command) scales
+    /// with the voltage across the motor, so commands are scaled by reference / battery voltage;
+    /// a sagging battery then can't reach full thrust, which limits the range mix works in.
+    /// @param battery_mv Battery voltage, low-pass filtered here (sag follows within ~1 s)
+    void set_battery_voltage(float battery_mv)
+    {
+        if (battery_mv <= 0.0f) return;
+        float gain = m_reference_mv / battery_mv;
+        if (gain > MAX_BATTERY_GAIN) gain = MAX_BATTERY_GAIN;
+        if (gain < MIN_BATTERY_GAIN) gain = MIN_BATTERY_GAIN;
+        m_battery_gain += (gain - m_battery_gain) * BATTERY_FILTER_ALPHA;
+        m_max_thrust = (m_battery_gain > 1.0f) ? thrust::thrust_at(1.0f / m_battery_gain) : 1.0f;
+    }
+    float get_battery_gain() const { return m_battery_gain; }
+
+  private:
+    const mixer::MixMatrix m_matrix;
+    const float m_reference_mv;
+    float m_battery_gain;
+    float m_max_thrust; // thrust at a compensated command of 1
+
+    constexpr static float MAX_BATTERY_GAIN = 1.3f; // no compensation below 1/1.3 of reference
+    constexpr static float MIN_BATTERY_GAIN = 0.8f;
+    constexpr static float BATTERY_FILTER_ALPHA = 0.3f; // per sample, at 10 Hz
+};
+
+} // namespace z_quad_rotor
+
+#endif // __MIXER_H
@@ -0,0 +1,80 @@
+/**
+ * @file	motors.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the motors module
+ *
+ */
+
+#include "motors.hpp"
+
+#include <device.h>
+#include <drivers/pwm.h>
+#include <logging/log.h>
+#include <zephyr.h>
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(motors, LOG_LEVEL_DBG);
+
+// constants
+#define PWM_NODE DT_NODELABEL(pwm0)
+
+static constexpr uint32_t PERIOD_US = 2500; // 400 Hz
+static constexpr uint32_t MIN_PULSE_US = 1000;
+static constexpr uint32_t PULSE_RANGE_US = 1000;
+static constexpr uint32_t CHANNEL_PINS[MOTOR_COUNT] = {
+    DT_PROP(PWM_NODE, ch0_pin), DT_PROP(PWM_NODE, ch1_pin), DT_PROP(PWM_NODE, ch2_pin),
+    DT_PROP(PWM_NODE, ch3_pin)};
+
+// private variables
+static const struct device *s_pwm;
+
+// private function definitions
+static int write_pulses(const MotorCommands &commands)
+{
+    int err = 0;
+    for (size_t i = 0; i < MOTOR_COUNT && !err; i++) {
+        float command = commands[i];
+        if (command < 0.0f) command = 0.0f;
+        if (command > 1.0f) command = 1.0f;
+        uint32_t pulse_us = MIN_PULSE_US + (uint32_t)(command * PULSE_RANGE_US + 0.5f);
+        err = pwm_pin_set_usec(s_pwm, CHANNEL_PINS[i], PERIOD_US, pulse_us, 0);
+    }
+    return err;
+}
+
+// public function definitions
+int motors::setup(const char *dev_name)
+{
+    int err = 0;
+    // input validation
+    if (dev_name == nullptr) {
+        LOG_ERR("Motors nullptr error at line: %d.", __LINE__);
+        err = EINVAL;
+    }
+    // get device from name
+    if (!err) {
+        s_pwm = device_get_binding(dev_name);
+        if (!s_pwm) {
+            LOG_ERR("Motor PWM binding failed.");
+            err = ENXIO;
+        }
+    }
+    if (!err) {
+        err = write_pulses(MotorCommands(0.0f));
+        if (err) {
+            LOG_ERR("Unable to set motor PWM; err: %d.", err);
+        }
+    }
+
+    return err;
+}
+
+void motors::set(const MotorCommands &commands)
+{
+    if (!s_pwm) return;
+    int err = write_pulses(commands);
+    if (err) {
+        LOG_ERR("Motor PWM update err: %d.", err);
+    }
+}
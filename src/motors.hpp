@@ -0,0 +1,33 @@
+/**
+ * @file	motors.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the motors module
+ *
+ * Drives the ESCs with standard servo PWM (1000 - 2000 us pulses). Commands are written straight
+ * to the PWM peripheral from the control thread (register writes on the nRF PWM driver), so they
+ * never wait behind other work.
+ *
+ *
+ */
+
+#ifndef __MOTORS_H
+#define __MOTORS_H
+
+#include "mixer.hpp"
+
+namespace z_quad_rotor {
+
+namespace motors {
+
+/// Binds the PWM device and outputs minimum pulses (ESCs arm on a steady minimum throttle)
+int setup(const char *dev_name);
+
+/// Sets normalized commands (0 - 1, clamped), applied from the next PWM period; never blocks
+/// @note Must be called from a single thread
+void set(const MotorCommands &commands);
+
+} // namespace motors
+
+} // namespace z_quad_rotor
+
+#endif // __MOTORS_H
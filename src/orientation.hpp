@@ -13,74 +13,164 @@
 
 #include <cstdint>
 
+#include <sys/atomic.h>
 #include <zephyr.h>
 
 #include "linalg.h"
 
+#include "axis_remap.hpp"
+#include "fastmath.hpp"
 #include "fusion.hpp"
 #include "marg_sensor.hpp"
 #include "orientation_defs.hpp"
-#include "synced_var.hpp"
+#include "perf.hpp"
+#include "seqlock_var.hpp"
 
 namespace z_quad_rotor {
 
+/// One fusion step, as passed on by Orientation::drain
+struct FusionStep {
+    Quaternion quat;            // attitude after the step (get_quaternion once drain publishes)
+    linalg::vec<float, 3> gyro; // remapped body rates (rad/s)
+    float accel_up;             // vertical specific force in the earth frame (m/s^2, +g at rest)
+    uint32_t time_diff_us;      // time since the previous step
+    uint32_t timestamp;         // gyro sample data ready (hw cycles)
+    MargData marg_data;         // the step's input, raw counts
+};
+
 /// Stores orientation in 3D space; updates based on raw MARG inputs
-/// @tparam Fusion implementation to be used for updates
-template <class T>
+/// @tparam T Fusion implementation to be used for updates (its scalar type is used throughout)
+/// @tparam R Remap from sensor axes to right-hand coordinate system (AxisRemap for sign/permutation
+/// mounts, MatrixRemap for arbitrary mounts)
+/// @tparam P Whether drain records perf's FUSION stage; false for instances drained off the
+/// control loop's thread (perf stages are recorded from one thread only)
+template <class T, class R = MatrixRemap, bool P = true>
 class Orientation {
   public:
+    using Scalar = typename T::Scalar;
+
     /// Constructor
-    /// @param remap_matrix Matrix for remapping raw sensor values to right-hand coordinate system
-    /// (e.g. [-1, 0, 0, 0, 0, 1, 0, 1, 0])
-    Orientation(const RotationMatrix &remap_matrix)
-        : m_quat(Quaternion(0.0f, 0.0f, 0.0f, 1.0f)), m_fusion_impl(), m_remap_matrix(remap_matrix)
+    /// @param remap Remap for raw sensor values (a RotationMatrix converts to MatrixRemap)
+    Orientation(const R &remap = R())
+        : m_quat(QuaternionT<Scalar>(Scalar(0), Scalar(0), Scalar(0), Scalar(1))),
+          m_fusion_impl(), m_remap(remap), m_accel_magn(), m_last_timestamp(0),
+          m_has_timestamp(false), m_underflows(ATOMIC_INIT(0))
     {
     }
     /// Updates orientation based on new raw sensor values
-    void update(MargData &marg_data, uint32_t time_diff_ms)
+    /// @param scale Scale factors for converting raw counts to units
+    /// @param time_diff_us Time since the previous update (microseconds)
+    void update(const MargData &marg_data, const MargScale &scale, uint32_t time_diff_us)
     {
-        MargDataFloat remapped = remap_marg_data(marg_data, m_remap_matrix);
-        // We should not need to scale the gyro measurements (zephyr claims gyro outputs should be
-        // rad/s), so this is a "temporary" fix.
-        remapped.gyro *= DEG_TO_RAD;
-        m_fusion_impl.update(remapped, m_quat.get_write_lock().get_ref(), time_diff_ms);
+        // update is the only writer, so the working copy cannot go stale
+        QuaternionT<Scalar> quat = m_quat.get_var();
+        integrate(marg_data, scale_cast<Scalar>(scale), quat, time_diff_us);
+        m_quat.set_var(quat);
     }
+    /// Updates orientation from every sample queued by the MARG sensor, each with its own time
+    /// step (measured between data ready timestamps). Every gyro sample drives one fusion step,
+    /// paired with the newest accel/magn sample taken at or before it.
+    /// @note Must only be called from a single thread (the MARG sensor queue consumer)
+    /// @return Number of gyro samples integrated
+    size_t drain(MargSensor &marg_sensor)
+    {
+        return drain(marg_sensor, [](const FusionStep &step) { ARG_UNUSED(step); });
+    }
+    /// As drain(marg_sensor), also passing each fusion step on to on_step(const FusionStep &)
+    template <class F>
+    size_t drain(MargSensor &marg_sensor, F on_step)
+    {
+        size_t count = 0;
+        const Scale scale = scale_cast<Scalar>(marg_sensor.get_scale());
+        QuaternionT<Scalar> quat = m_quat.get_var();
+        GyroData gyro;
+        while (marg_sensor.pop_gyro(gyro)) {
+            // catch accel/magn up to the gyro sample
+            AccelMagnData accel_magn;
+            while (marg_sensor.peek_accel_magn(accel_magn) &&
+                   (int32_t)(accel_magn.timestamp - gyro.timestamp) <= 0) {
+                marg_sensor.pop_accel_magn(m_accel_magn);
+            }
+            // the very first sample only establishes the time reference
+            if (m_has_timestamp) {
+                MargData marg_data = make_marg_data(m_accel_magn, gyro);
+                uint32_t time_diff_us = k_cyc_to_us_near32(gyro.timestamp - m_last_timestamp);
+                const uint32_t perf_start = P ? perf::now() : 0;
+                MargDataT<Scalar> remapped = integrate(marg_data, scale, quat, time_diff_us);
+                if (P) perf::record(perf::STAGE_FUSION, perf::now() - perf_start);
+                const FusionStep step = {Quaternion(quat),
+                                         linalg::vec<float, 3>(remapped.gyro),
+                                         vertical_accel(quat, remapped.accel),
+                                         time_diff_us,
+                                         gyro.timestamp,
+                                         marg_data};
+                on_step(step);
+            }
+            m_last_timestamp = gyro.timestamp;
+            m_has_timestamp = true;
+            count++;
+        }
+
+        if (count) {
+            m_quat.set_var(quat);
+        }
+        else {
+            atomic_inc(&m_underflows);
+        }
+        return count;
+    }
+    /// Returns the number of drain calls that found no new gyro sample
+    uint32_t get_underflow_count() const { return atomic_get(&m_underflows); }
     /// Returns the current orientation in quaternion representation.
-    /// @note Will block until quat mutex is available (locked by update)
-    Quaternion get_quaternion() { return m_quat.get_read_lock().get_var(); }
+    /// @note Never blocks
+    Quaternion get_quaternion() const { return Quaternion(m_quat.get_var()); }
     /// Returns the current orientation in euler angle representation (degrees).
-    /// @note Will block until quat mutex is available (locked by update)
-    EulerAngle get_euler_angle() { return quat_to_euler(m_quat.get_read_lock().get_var()); }
+    /// @note Never blocks
+    EulerAngle get_euler_angle() const { return quat_to_euler(get_quaternion()); }
 
   protected:
-    SyncedVar<Quaternion> m_quat;
+    SeqLockVar<QuaternionT<Scalar>> m_quat;
 
   private:
-    const FusionImpl<T> m_fusion_impl;
-    const RotationMatrix m_remap_matrix;
-    /// converts marg data from sensor value to float, remaps according to remap matrix
-    static const MargDataFloat remap_marg_data(MargData &marg_data,
-                                               const RotationMatrix &remap_matrix)
-    {
-        MargDataFloat remapped(marg_data);
-        remapped.accel = linalg::mul(remap_matrix, remapped.accel);
-        remapped.gyro = linalg::mul(remap_matrix, remapped.gyro);
-        remapped.magn = linalg::mul(remap_matrix, remapped.magn);
+    using Scale = MargScaleT<typename ScalarTraits<Scalar>::Scale>;
+
+    T m_fusion_impl;
+    const R m_remap;
+    AccelMagnData m_accel_magn; // newest accel/magn sample consumed by drain
+    uint32_t m_last_timestamp;  // hw cycle timestamp of the last gyro sample consumed by drain
+    bool m_has_timestamp;
+    atomic_t m_underflows;
 
+    /// converts & remaps raw sensor values and runs one fusion step on quat; returns the remapped
+    /// values
+    MargDataT<Scalar> integrate(const MargData &marg_data, const Scale &scale,
+                                     QuaternionT<Scalar> &quat, uint32_t time_diff_us)
+    {
+        MargDataT<Scalar> remapped = m_remap.template apply<Scalar>(marg_data, scale);
+        m_fusion_impl.update(remapped, quat, time_diff_us);
         return remapped;
     }
+    /// earth frame z of a body frame accel: the bottom row of quat's rotation matrix, dotted
+    static float vertical_accel(const QuaternionT<Scalar> &quat,
+                                const linalg::vec<Scalar, 3> &accel)
+    {
+        const Quaternion q(quat);
+        const linalg::vec<float, 3> up(2 * (q.x * q.z - q.w * q.y), 2 * (q.y * q.z + q.w * q.x),
+                                       1 - 2 * (q.x * q.x + q.y * q.y));
+        return linalg::dot(up, linalg::vec<float, 3>(accel));
+    }
     /// converts quaternion orientation to euler angles
     static EulerAngle quat_to_euler(const Quaternion &quat)
     {
-        float roll = atan2f(2 * (quat.w * quat.x + quat.y * quat.z),
-                            1 - 2 * (quat.x * quat.x + quat.y * quat.y));
+        float roll = fastmath::atan2(2 * (quat.w * quat.x + quat.y * quat.z),
+                                     1 - 2 * (quat.x * quat.x + quat.y * quat.y));
         // limit pitch to +/- 90
         float sin_pitch = 2 * (quat.w * quat.y - quat.z * quat.x);
         float pitch = copysign(PI_OVER_2, sin_pitch);
-        if (abs(sin_pitch) < 1) pitch = asinf(sin_pitch);
+        if (abs(sin_pitch) < 1) pitch = fastmath::asin(sin_pitch);
 
-        float yaw = atan2f(2 * (quat.w * quat.z + quat.x * quat.y),
-                           1 - 2 * (quat.y * quat.y + quat.z * quat.z));
+        float yaw = fastmath::atan2(2 * (quat.w * quat.z + quat.x * quat.y),
+                                    1 - 2 * (quat.y * quat.y + quat.z * quat.z));
 
         return EulerAngle(roll, pitch, yaw);
     }
@@ -16,7 +16,11 @@
 
 namespace z_quad_rotor {
 
-using Quaternion = linalg::vec<float, 4>;
+/// Quaternion with scalar type S (x, y, z, w)
+template <class S>
+using QuaternionT = linalg::vec<S, 4>;
+
+using Quaternion = QuaternionT<float>;
 using EulerAngle = linalg::vec<float, 3>;
 using RotationMatrix = linalg::mat<float, 3, 3>;
 
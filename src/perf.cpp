@@ -0,0 +1,56 @@
+/**
+ * @file	perf.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the perf module
+ *
+ */
+
+#include "perf.hpp"
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+using namespace z_quad_rotor;
+
+// constants
+static const char *const STAGE_NAMES[] = {"accel_magn", "gyro",       "pressure",   "period",
+                                          "jitter",     "drain",      "fusion",     "alt_predict",
+                                          "controller", "alt_update", "mix",        "get_marg"};
+static_assert(ARRAY_SIZE(STAGE_NAMES) == perf::STAGE_COUNT, "Missing stage names");
+
+// private variables
+static perf::Histogram s_histograms[perf::STAGE_COUNT];
+// stages with a pending reset; cleared by each stage's recording thread
+static atomic_t s_reset_pending = ATOMIC_INIT(0);
+static_assert(perf::STAGE_COUNT <= ATOMIC_BITS, "Too many stages for the reset mask");
+
+// public function definitions
+void perf::setup()
+{
+    cycle_counter::start(); // never stopped; benchmark start/stop pairs nest within it
+}
+
+void perf::record(Stage stage, uint32_t cycles)
+{
+    // a plain load in the common case
+    if (atomic_test_bit(&s_reset_pending, stage) &&
+        atomic_test_and_clear_bit(&s_reset_pending, stage)) {
+        s_histograms[stage].reset();
+    }
+    s_histograms[stage].add(cycles);
+}
+
+void perf::reset() { atomic_set(&s_reset_pending, BIT_MASK(STAGE_COUNT)); }
+
+const perf::Histogram &perf::get_histogram(Stage stage) { return s_histograms[stage]; }
+
+const char *perf::get_name(Stage stage)
+{
+    return ((unsigned)stage < STAGE_COUNT) ? STAGE_NAMES[stage] : nullptr;
+}
+
+uint32_t perf::cycles_to_ns(uint32_t cycles)
+{
+    uint64_t ns = cycle_counter::to_ns(cycles);
+    return (ns < UINT32_MAX) ? (uint32_t)ns : UINT32_MAX;
+}
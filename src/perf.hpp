@@ -0,0 +1,93 @@
+/**
+ * @file	perf.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the perf module
+ *
+ * Always-on timing of the sensor to motor pipeline. Each stage is bracketed by PERF_BEGIN/PERF_END
+ * (or PERF_SCOPE), which read the cycle counter (see cycle_counter.hpp) & record the elapsed cycles
+ * in the stage's log2 histogram, along with its exact min & max. Each stage must only be recorded
+ * from one thread. zqr perf prints & resets the stats.
+ *
+ *
+ */
+
+#ifndef __PERF_H
+#define __PERF_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cycle_counter.hpp"
+#include "log2_histogram.hpp"
+
+/// Starts timing stage (perf::STAGE_<stage>) at this point of the enclosing scope
+#define PERF_BEGIN(stage) const uint32_t _perf_start_##stage = z_quad_rotor::perf::now()
+/// Records the cycles since the same scope's PERF_BEGIN(stage)
+#define PERF_END(stage)                                                                            \
+    z_quad_rotor::perf::record(z_quad_rotor::perf::STAGE_##stage,                                  \
+                               z_quad_rotor::perf::now() - _perf_start_##stage)
+/// Times stage from this point to the end of the enclosing scope
+#define PERF_SCOPE(stage)                                                                          \
+    z_quad_rotor::perf::ScopedStage _perf_scope_##stage(z_quad_rotor::perf::STAGE_##stage)
+
+namespace z_quad_rotor {
+
+namespace perf {
+
+/// Pipeline stages, in data flow order
+enum Stage {
+    STAGE_ACCEL_MAGN_READ, // fxos8700 trigger handler / fifo drain
+    STAGE_GYRO_READ,       // fxas21002 trigger handler / fifo drain
+    STAGE_PRESSURE_READ,   // dps310 fifo drain
+    STAGE_LOOP_PERIOD,     // control loop wakeup to wakeup
+    STAGE_LOOP_JITTER,     // change in loop period from the previous loop
+    STAGE_DRAIN,           // all fusion steps of a loop, including the per step stages below
+    STAGE_FUSION,          // one orientation update
+    STAGE_ALTITUDE_PREDICT,
+    STAGE_CONTROLLER,
+    STAGE_ALTITUDE_UPDATE, // one pressure correction
+    STAGE_MIX,             // mixing & handing off motor commands
+    STAGE_GET_MARG,        // marg_sensor.get_marg (telemetry)
+    STAGE_COUNT,
+};
+
+using Histogram = Log2Histogram<32>;
+
+/// Starts the cycle counter (until then, stats are empty)
+void setup();
+
+/// Returns the cycle counter (differences are valid across wraparound)
+static inline uint32_t now() { return cycle_counter::now(); }
+
+/// Records one duration of stage; never blocks
+/// @note Each stage must only be recorded from a single thread
+void record(Stage stage, uint32_t cycles);
+
+/// Requests a reset of every stage, applied by each stage's recording thread on its next record
+void reset();
+
+/// Returns a stage's histogram (a best-effort view while it is being recorded)
+const Histogram &get_histogram(Stage stage);
+
+/// Returns a stage's name (as used by zqr perf), or nullptr if out of range
+const char *get_name(Stage stage);
+
+/// Converts cycles to nanoseconds (saturated)
+uint32_t cycles_to_ns(uint32_t cycles);
+
+/// Records the cycles from construction to destruction
+class ScopedStage {
+  public:
+    explicit ScopedStage(Stage stage) : m_stage(stage), m_start(now()) {}
+    ~ScopedStage() { record(m_stage, now() - m_start); }
+
+  private:
+    const Stage m_stage;
+    const uint32_t m_start;
+};
+
+} // namespace perf
+
+} // namespace z_quad_rotor
+
+#endif // __PERF_H
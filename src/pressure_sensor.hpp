@@ -11,9 +11,11 @@
 #ifndef __PRESSURE_SENSOR_H
 #define __PRESSURE_SENSOR_H
 
+#include <cstdint>
+
 #include <drivers/sensor.h>
 
-#include "synced_var.hpp"
+#include "seqlock_var.hpp"
 
 namespace z_quad_rotor {
 
@@ -21,13 +23,34 @@ namespace z_quad_rotor {
 class PressureSensor {
   public:
     /// Returns the current pressure.
-    /// @note Will block until pressure mutex is available
-    struct sensor_value get_pressure() { return m_pressure.get_read_lock().get_var(); }
-    /// Returns a write lock to the MARG sensor data
-    WriteLock<struct sensor_value> get_write_lock() { return m_pressure.get_write_lock(); }
+    /// @note Never blocks
+    struct sensor_value get_pressure() const { return m_sample.get_var().pressure; }
+    /// Returns the current pressure only if it was published after the sample last returned here
+    /// (for consumers that must use each sample once)
+    /// @param sequence Sequence number of the last sample consumed; updated on success
+    /// @note Never blocks
+    bool get_new_pressure(struct sensor_value &pressure, uint32_t &sequence) const
+    {
+        PressureSample sample = m_sample.get_var();
+        if (sample.sequence == sequence) return false;
+        pressure = sample.pressure;
+        sequence = sample.sequence;
+        return true;
+    }
+    /// Publishes a new pressure sample (single writer)
+    void set_pressure(const struct sensor_value &pressure)
+    {
+        m_sequence++;
+        m_sample.set_var({pressure, m_sequence});
+    }
 
   protected:
-    SyncedVar<struct sensor_value> m_pressure;
+    struct PressureSample {
+        struct sensor_value pressure;
+        uint32_t sequence; // 0 before the first sample
+    };
+    SeqLockVar<PressureSample> m_sample;
+    uint32_t m_sequence = 0; // writer only
 };
 
 } // namespace z_quad_rotor
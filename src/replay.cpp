@@ -0,0 +1,200 @@
+/**
+ * @file	replay.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the replay module (native_posix only; host file access)
+ *
+ */
+
+#include "replay.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <drivers/sensor.h>
+
+#include "altitude.hpp"
+#include "cycle_counter.hpp"
+#include "fusion.hpp"
+#include "orientation.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+/// records per batch: queued, then drained in one go (as a hw fifo batch would be)
+static constexpr size_t BATCH_SIZE = MargSensor::QUEUE_DEPTH / 2;
+
+// types
+/// One fusion step's output
+struct Estimate {
+    uint32_t timestamp_us;
+    Quaternion quat;
+    float altitude_m;
+    float climb_rate_m_s;
+};
+
+struct Totals {
+    uint64_t records;
+    uint64_t steps;
+    uint64_t pressures;
+    uint64_t estimator_cycles; // queueing, drains & altitude; file access excluded
+    uint64_t total_cycles;
+};
+
+// private variables
+// shell thread only
+static replay::Record s_records[BATCH_SIZE];
+static Estimate s_estimates[BATCH_SIZE];
+
+// private function definitions
+static struct sensor_value pressure_to_sensor_value(int32_t pressure_pa)
+{
+    struct sensor_value pressure;
+    pressure.val1 = pressure_pa / 1000; // kPa
+    pressure.val2 = (pressure_pa % 1000) * 1000;
+    return pressure;
+}
+
+/// Reads & checks the recording's header; returns 0 or a positive errno
+static int read_header(FILE *file, replay::Header &header)
+{
+    if (1 != fread(&header, sizeof(header), 1, file)) return EIO;
+    if (memcmp(header.magic, replay::MAGIC, sizeof(header.magic))) return EINVAL;
+    if (replay::VERSION != header.version) return ENOTSUP;
+    return 0;
+}
+
+/// Runs every record through a fresh Orientation<T> & Altitude, writing one csv row per fusion step
+template <class T>
+static Totals run(FILE *in, FILE *out, const MargScale &scale)
+{
+    MargSensor marg_sensor;
+    Orientation<T, IdentityRemap, false> orientation; // main's drains own the perf stages
+    Altitude altitude;
+    marg_sensor.set_accel_magn_scale(scale.accel, scale.magn);
+    marg_sensor.set_gyro_scale(scale.gyro);
+
+    Totals totals = {};
+    uint32_t last_timestamp_us = 0;
+    uint32_t timestamp = 0; // hw cycles; advanced by the recorded time steps
+    for (;;) {
+        // timed per batch, the cycle counter wraps within seconds on the host
+        uint32_t batch_start = cycle_counter::now();
+        size_t count = fread(s_records, sizeof(replay::Record), BATCH_SIZE, in);
+        if (!count) break;
+        size_t record_index = 0;
+        size_t estimate_count = 0;
+        uint32_t start = cycle_counter::now();
+
+        // queue the batch, as the drivers would
+        for (size_t i = 0; i < count; i++) {
+            const replay::Record &record = s_records[i];
+            timestamp += k_us_to_cyc_near32(record.timestamp_us - last_timestamp_us);
+            last_timestamp_us = record.timestamp_us;
+
+            AccelMagnData &accel_magn = marg_sensor.get_accel_magn_slot();
+            GyroData &gyro = marg_sensor.get_gyro_slot();
+            accel_magn.timestamp = timestamp;
+            gyro.timestamp = timestamp;
+            for (int axis = 0; axis < 3; axis++) {
+                accel_magn.accel[axis] = record.marg_data.accel[axis];
+                accel_magn.magn[axis] = record.marg_data.magn[axis];
+                gyro.gyro[axis] = record.marg_data.gyro[axis];
+            }
+            marg_sensor.publish_accel_magn();
+            marg_sensor.publish_gyro();
+        }
+        // the very first record only establishes drain's time reference
+        if (!totals.records) {
+            if (s_records[0].pressure_pa) {
+                altitude.update(pressure_to_sensor_value(s_records[0].pressure_pa));
+                totals.pressures++;
+            }
+            record_index = 1;
+        }
+        // then drain it, as the control loop would
+        orientation.drain(marg_sensor, [&](const FusionStep &step) {
+            const replay::Record &record = s_records[record_index++];
+            altitude.predict(step.accel_up, step.time_diff_us);
+            if (record.pressure_pa) {
+                altitude.update(pressure_to_sensor_value(record.pressure_pa));
+                totals.pressures++;
+            }
+            s_estimates[estimate_count++] = {record.timestamp_us, step.quat,
+                                             altitude.get_altitude(), altitude.get_velocity()};
+        });
+
+        totals.estimator_cycles += (uint32_t)(cycle_counter::now() - start);
+        totals.records += count;
+        totals.steps += estimate_count;
+
+        for (size_t i = 0; i < estimate_count; i++) {
+            const Estimate &estimate = s_estimates[i];
+            fprintf(out, "%u,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f\n", estimate.timestamp_us,
+                    (double)estimate.quat.w, (double)estimate.quat.x, (double)estimate.quat.y,
+                    (double)estimate.quat.z, (double)estimate.altitude_m,
+                    (double)estimate.climb_rate_m_s);
+        }
+        totals.total_cycles += (uint32_t)(cycle_counter::now() - batch_start);
+    }
+
+    return totals;
+}
+
+// public function definitions
+int replay::cmd(const struct shell *shell, size_t argc, char **argv)
+{
+    bool is_fusion9 = false;
+    if (argc > 3 && !strcmp(argv[3], "madgwick9")) {
+        is_fusion9 = true;
+    }
+    else if ((argc < 3) || (argc > 3 && strcmp(argv[3], "madgwick6"))) {
+        shell_error(shell, "Usage: replay <recording> <trajectory csv> [madgwick6|madgwick9]");
+        return -EINVAL;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        shell_error(shell, "Unable to open %s", argv[1]);
+        return -ENOENT;
+    }
+    Header header;
+    int err = read_header(in, header);
+    if (err) {
+        shell_error(shell, "Not a v%u recording: %s (err: %d)", VERSION, argv[1], err);
+        fclose(in);
+        return -EINVAL;
+    }
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        shell_error(shell, "Unable to create %s", argv[2]);
+        fclose(in);
+        return -EIO;
+    }
+    fprintf(out, "timestamp_us,qw,qx,qy,qz,altitude_m,climb_rate_m_s\n");
+
+    cycle_counter::start();
+    Totals totals = is_fusion9 ? run<MadgwickFusion9>(in, out, header.scale)
+                               : run<MadgwickFusion6>(in, out, header.scale);
+    cycle_counter::stop();
+    fclose(in);
+    err = fclose(out);
+
+    if (err) {
+        shell_error(shell, "Unable to write %s", argv[2]);
+        return -EIO;
+    }
+    if (!totals.steps) {
+        shell_error(shell, "No fusion steps in %s", argv[1]);
+        return -EINVAL;
+    }
+    const uint64_t estimator_ns = cycle_counter::to_ns(totals.estimator_cycles);
+    const uint64_t step_ns = estimator_ns / totals.steps;
+    shell_print(shell, "%s replay: %u records, %u steps, %u pressure updates",
+                is_fusion9 ? "Madgwick9" : "Madgwick6", (uint32_t)totals.records,
+                (uint32_t)totals.steps, (uint32_t)totals.pressures);
+    shell_print(shell, "%6u ns/step, %u samples/s (estimators), %u ms total incl. file access",
+                (uint32_t)step_ns,
+                estimator_ns ? (uint32_t)((totals.records * 1000000000ull) / estimator_ns) : 0,
+                (uint32_t)(cycle_counter::to_ns(totals.total_cycles) / 1000000));
+    return 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file	replay.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the replay module
+ *
+ * Replays a recorded flight through the estimators on native_posix: each recorded fusion step's
+ * MARG counts are queued through a MargSensor & drained by Orientation, driving Altitude as in the
+ * control loop, with recorded pressure samples correcting it. Nothing waits on sensor timing, so a
+ * replay runs as fast as the host allows; the estimated trajectory is written out for regression
+ * checks, and the estimators' throughput is reported. Recordings are made from blackbox logs by
+ * tools/replay.py, which also runs replays & compares trajectories.
+ *
+ *
+ */
+
+#ifndef __REPLAY_H
+#define __REPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <shell/shell.h>
+#include <zephyr.h>
+
+#include "marg_sensor.hpp"
+
+namespace z_quad_rotor {
+
+namespace replay {
+
+/// Recording file: a Header, then Records to the end of the file (little endian)
+static constexpr char MAGIC[4] = {'Z', 'Q', 'R', 'R'};
+static constexpr uint32_t VERSION = 1;
+
+struct __packed Header {
+    char magic[4];
+    uint32_t version;
+    MargScale scale; // as set by the sensor drivers
+};
+
+/// One fusion step's input
+struct __packed Record {
+    uint32_t timestamp_us; // gyro data ready (wraps)
+    MargData marg_data;    // raw counts
+    int32_t pressure_pa;   // a new pressure sample, or 0
+};
+
+/// zqr replay <recording> <trajectory csv> [madgwick6|madgwick9]
+int cmd(const struct shell *shell, size_t argc, char **argv);
+
+} // namespace replay
+
+} // namespace z_quad_rotor
+
+#endif // __REPLAY_H
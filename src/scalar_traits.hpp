@@ -0,0 +1,117 @@
+/**
+ * @file		scalar_traits.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only scalar traits
+ *
+ * The few operations the fusion & orientation templates need that differ between floating point
+ * (float, double) and fixed point (Fixed<FRAC>) scalars.
+ *
+ *
+ */
+
+#ifndef __SCALAR_TRAITS_H
+#define __SCALAR_TRAITS_H
+
+#include <cmath>
+#include <cstdint>
+
+#include "linalg.h"
+
+#include "fastmath.hpp"
+#include "fixed_point.hpp"
+
+namespace z_quad_rotor {
+
+/// Floating point scalar traits
+template <class S>
+struct ScalarTraits {
+    /// Type of raw count scale factors
+    using Scale = S;
+
+    static S sqrt(S val) { return std::sqrt(val); }
+    /// 1 / sqrt(val); approximated for float (see fastmath::inv_sqrt_refined)
+    static S inv_sqrt(S val) { return S(1) / std::sqrt(val); }
+    template <int M>
+    static S length(const linalg::vec<S, M> &vec)
+    {
+        return std::sqrt(linalg::length2(vec));
+    }
+    /// Converts raw sensor counts to units
+    static S from_counts(int32_t counts, Scale scale) { return counts * scale; }
+    /// Converts a time step in microseconds to seconds
+    static S from_micros(uint32_t us) { return us * S(0.000001); }
+    /// Scales vec to unit length (length must be non-zero); one division
+    template <int M>
+    static void normalize(linalg::vec<S, M> &vec, S length)
+    {
+        vec *= S(1) / length;
+    }
+    /// Scales vec to unit length; returns false (vec unchanged) for a zero length vec
+    template <int M>
+    static bool try_normalize(linalg::vec<S, M> &vec)
+    {
+        S length2 = linalg::length2(vec);
+        if (S(0) == length2) return false;
+        vec *= inv_sqrt(length2);
+        return true;
+    }
+};
+
+/// The float normalizations in the fusion hot path skip the sqrt & division
+template <>
+inline float ScalarTraits<float>::inv_sqrt(float val)
+{
+    return fastmath::inv_sqrt_refined(val);
+}
+
+/// Fixed point scalar traits
+template <int FRAC>
+struct ScalarTraits<Fixed<FRAC>> {
+    using S = Fixed<FRAC>;
+    /// Scale factors are far below 1, so they keep the extra fraction bits of Q0.31
+    using Scale = Q31;
+
+    static S sqrt(S val) { return S::sqrt(val); }
+    /// Sums the squares in 64 bits, so that vectors longer than sqrt(range) (e.g. raw accel) don't
+    /// overflow
+    template <int M>
+    static S length(const linalg::vec<S, M> &vec)
+    {
+        uint64_t length2 = 0;
+        for (int i = 0; i < M; i++) {
+            length2 += (uint64_t)((int64_t)vec[i].raw() * vec[i].raw());
+        }
+        // sqrt(sum(raw^2)) is already scaled by 2^FRAC
+        return S::from_raw((int32_t)isqrt(length2));
+    }
+    static S from_counts(int32_t counts, Scale scale)
+    {
+        return S::from_raw((int32_t)(((int64_t)counts * scale.raw()) >> (31 - FRAC)));
+    }
+    static S from_micros(uint32_t us)
+    {
+        // us * 2^FRAC / 1e6 as a multiply & shift
+        constexpr uint64_t MICROS_MULT = ((uint64_t(1) << (FRAC + 20)) + 500000) / 1000000;
+        return S::from_raw((int32_t)(((uint64_t)us * MICROS_MULT) >> 20));
+    }
+    /// Divides each element -- the reciprocal of a short vector's length can exceed the range
+    template <int M>
+    static void normalize(linalg::vec<S, M> &vec, S length)
+    {
+        for (int i = 0; i < M; i++) {
+            vec[i] = vec[i] / length;
+        }
+    }
+    template <int M>
+    static bool try_normalize(linalg::vec<S, M> &vec)
+    {
+        S vec_length = length(vec);
+        if (S(0) == vec_length) return false;
+        normalize(vec, vec_length);
+        return true;
+    }
+};
+
+} // namespace z_quad_rotor
+
+#endif // __SCALAR_TRAITS_H
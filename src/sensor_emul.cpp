@@ -0,0 +1,305 @@
+/**
+ * @file	sensor_emul.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the sensor_emul module
+ *
+ */
+
+#include "sensor_emul.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <logging/log.h>
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+#include "altitude.hpp"
+#include "orientation_defs.hpp"
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(sensor_emul, LOG_LEVEL_DBG);
+
+// constants
+static constexpr size_t LOAD_STACK_SIZE = 512;
+// preempts the sensor driver threads (not the control loop)
+static constexpr int LOAD_THREAD_PRIO =
+    MIN(CONFIG_FXOS8700_THREAD_PRIORITY, CONFIG_FXAS21002_THREAD_PRIORITY) - 1;
+static constexpr uint32_t LOAD_PERIOD_US = 1000;
+static constexpr uint32_t MAX_LOAD_PCT = 95; // leave the sensor threads something
+
+static constexpr float STANDARD_GRAVITY = 9.80665f;
+static constexpr float SEA_LEVEL_PA = (float)(baro::SEA_LEVEL_KPA * 1000.0);
+static constexpr float AMBIENT_TEMP_C = 25.0f;
+// world frame field (z up), as sim_sensors' level scene: ~0.56 gauss dipping 66 degrees
+static const linalg::vec<float, 3> FIELD_GAUSS = {0.23f, -0.04f, -0.51f};
+static const linalg::vec<float, 3> WOBBLE_AXIS = {0.70710678f, 0.70710678f, 0.0f};
+
+static const char *const SENSOR_NAMES[sensor_emul::SENSOR_COUNT] = {
+    "fxos8700",
+    "fxas21002",
+    "dps310",
+};
+static const char *const PROFILE_NAMES[sensor_emul::PROFILE_COUNT] = {
+    "still",
+    "yaw",
+    "roll",
+    "wobble",
+};
+
+static constexpr sensor_emul::Trajectory DEFAULT_TRAJECTORY = {
+    sensor_emul::PROFILE_STILL, 90, 2000, 0, 0, 100, 0,
+};
+
+// private variables
+static struct k_spinlock s_lock; // trajectory & stats
+static sensor_emul::Trajectory s_trajectory = DEFAULT_TRAJECTORY;
+static uint64_t s_start_us; // trajectory start
+static sensor_emul::Stats s_stats[sensor_emul::SENSOR_COUNT];
+static uint32_t s_noise_state = 0x2545F491; // xorshift32; any nonzero seed
+
+static atomic_t s_load_pct = ATOMIC_INIT(0);
+static k_thread s_load_thread;
+K_THREAD_STACK_DEFINE(s_load_stack, LOAD_STACK_SIZE);
+static bool s_has_load_thread;
+
+// private function definitions
+/// uniform in (0, 1]
+static float uniform()
+{
+    s_noise_state ^= s_noise_state << 13;
+    s_noise_state ^= s_noise_state >> 17;
+    s_noise_state ^= s_noise_state << 5;
+    return ((s_noise_state >> 8) + 1) * (1.0f / 16777216.0f);
+}
+
+/// rotation angle (rad) & rate (rad/s) about the profile's axis, t seconds into it
+static void rotate(const sensor_emul::Trajectory &trajectory, float t, float &angle, float &rate)
+{
+    float peak_rate = trajectory.rate_dps * DEG_TO_RAD;
+    if (sensor_emul::PROFILE_WOBBLE == trajectory.profile) {
+        float omega = 2.0f * PI * 1000.0f / MAX(trajectory.period_ms, 1u);
+        angle = (peak_rate / omega) * sinf(omega * t);
+        rate = peak_rate * cosf(omega * t);
+    }
+    else if (sensor_emul::PROFILE_STILL == trajectory.profile) {
+        angle = 0.0f;
+        rate = 0.0f;
+    }
+    else {
+        // wrapped, so that float keeps its resolution on long runs
+        angle = fmodf(peak_rate * t, 2.0f * PI);
+        rate = peak_rate;
+    }
+}
+
+static linalg::vec<float, 3> get_axis(sensor_emul::Profile profile)
+{
+    switch (profile) {
+    case sensor_emul::PROFILE_YAW:
+        return {0.0f, 0.0f, 1.0f};
+    case sensor_emul::PROFILE_ROLL:
+        return {1.0f, 0.0f, 0.0f};
+    default:
+        return WOBBLE_AXIS;
+    }
+}
+
+static void load_thread_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        uint32_t busy_us = (LOAD_PERIOD_US * atomic_get(&s_load_pct)) / 100;
+        if (busy_us) k_busy_wait(busy_us);
+        k_sleep(K_USEC(LOAD_PERIOD_US - busy_us));
+    }
+}
+
+static void print_stats(const struct shell *shell, sensor_emul::Sensor sensor)
+{
+    sensor_emul::Stats stats;
+    sensor_emul::get_stats(sensor, stats);
+    uint32_t drop_pct_x10 = stats.produced ? ((uint64_t)stats.dropped * 1000) / stats.produced : 0;
+    const auto &hist = stats.read_age_us;
+    shell_print(shell, "%-10s %9u %8u %3u.%u%% %6u %6u %6u %6u", sensor_emul::get_name(sensor),
+                stats.produced, stats.dropped, drop_pct_x10 / 10, drop_pct_x10 % 10,
+                hist.get_min(), hist.get_percentile(50), hist.get_percentile(99), hist.get_max());
+}
+
+// public function definitions
+void sensor_emul::set_trajectory(const Trajectory &trajectory)
+{
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    s_trajectory = trajectory;
+    s_start_us = now_us();
+    k_spin_unlock(&s_lock, key);
+}
+
+sensor_emul::Trajectory sensor_emul::get_trajectory()
+{
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    Trajectory trajectory = s_trajectory;
+    k_spin_unlock(&s_lock, key);
+    return trajectory;
+}
+
+sensor_emul::Truth sensor_emul::get_truth()
+{
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    Trajectory trajectory = s_trajectory;
+    float t = (now_us() - s_start_us) * 0.000001f;
+    k_spin_unlock(&s_lock, key);
+
+    // rotation about a fixed axis: the body rate is the axis times the angle's rate
+    float angle, rate;
+    rotate(trajectory, t, angle, rate);
+    linalg::vec<float, 3> axis = get_axis(trajectory.profile);
+    Quaternion attitude = linalg::rotation_quat(axis, angle); // body to world
+    Quaternion world_to_body = linalg::qconj(attitude);
+
+    Truth truth;
+    truth.rate = axis * rate;
+    truth.accel = linalg::qrot(world_to_body, linalg::vec<float, 3>(0.0f, 0.0f, STANDARD_GRAVITY));
+    truth.magn = linalg::qrot(world_to_body, FIELD_GAUSS);
+    if (trajectory.vibration_mg) {
+        // out of phase across axes, as a spinning imbalance
+        float amplitude = trajectory.vibration_mg * (0.001f * STANDARD_GRAVITY);
+        float phase = 2.0f * PI * fmodf(trajectory.vibration_hz * t, 1.0f);
+        truth.accel += amplitude * linalg::vec<float, 3>(sinf(phase), cosf(phase),
+                                                         sinf(phase + (PI / 4.0f)));
+    }
+    float altitude_m = trajectory.climb_rate_cm_s * t * 0.01f;
+    truth.pressure_pa =
+        SEA_LEVEL_PA * powf(1.0f - (altitude_m / (float)baro::SCALE_M), 1.0f / baro::EXPONENT);
+    truth.temp_c = AMBIENT_TEMP_C;
+    return truth;
+}
+
+uint64_t sensor_emul::now_us() { return k_ticks_to_us_floor64(k_uptime_ticks()); }
+
+float sensor_emul::noise(float sigma)
+{
+    uint32_t pct = s_trajectory.noise_pct;
+    if (!pct) return 0.0f;
+    // box-muller (one of the pair)
+    float radius = sqrtf(-2.0f * logf(uniform()));
+    return sigma * (pct * 0.01f) * radius * cosf(2.0f * PI * uniform());
+}
+
+void sensor_emul::record_produced(Sensor sensor)
+{
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    s_stats[sensor].produced++;
+    k_spin_unlock(&s_lock, key);
+}
+
+void sensor_emul::record_dropped(Sensor sensor, uint32_t count)
+{
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    s_stats[sensor].dropped += count;
+    k_spin_unlock(&s_lock, key);
+}
+
+void sensor_emul::record_read(Sensor sensor, uint64_t sample_us)
+{
+    uint64_t age_us = now_us() - sample_us;
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    s_stats[sensor].read_age_us.add((uint32_t)MIN(age_us, (uint64_t)UINT32_MAX));
+    k_spin_unlock(&s_lock, key);
+}
+
+void sensor_emul::get_stats(Sensor sensor, Stats &stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    stats = s_stats[sensor];
+    k_spin_unlock(&s_lock, key);
+}
+
+void sensor_emul::reset_stats()
+{
+    k_spinlock_key_t key = k_spin_lock(&s_lock);
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        s_stats[i].produced = 0;
+        s_stats[i].dropped = 0;
+        s_stats[i].read_age_us.reset();
+    }
+    k_spin_unlock(&s_lock, key);
+}
+
+const char *sensor_emul::get_name(Sensor sensor)
+{
+    return ((unsigned)sensor < SENSOR_COUNT) ? SENSOR_NAMES[sensor] : nullptr;
+}
+
+void sensor_emul::set_load(uint32_t pct)
+{
+    atomic_set(&s_load_pct, MIN(pct, MAX_LOAD_PCT));
+    // started on first use; shell thread only
+    if (pct && !s_has_load_thread) {
+        k_tid_t tid = k_thread_create(&s_load_thread, s_load_stack,
+                                      K_THREAD_STACK_SIZEOF(s_load_stack), load_thread_func, NULL,
+                                      NULL, NULL, LOAD_THREAD_PRIO, 0, K_NO_WAIT);
+        k_thread_name_set(tid, "emul load");
+        s_has_load_thread = true;
+    }
+}
+
+uint32_t sensor_emul::get_load() { return atomic_get(&s_load_pct); }
+
+int sensor_emul::cmd(const struct shell *shell, size_t argc, char **argv)
+{
+    Trajectory trajectory = get_trajectory();
+    int profile = PROFILE_COUNT;
+    for (int i = 0; argc > 1 && i < PROFILE_COUNT; i++) {
+        if (!strcmp(argv[1], PROFILE_NAMES[i])) profile = i;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "reset")) {
+        reset_stats();
+    }
+    else if (PROFILE_COUNT != profile) {
+        trajectory.profile = (Profile)profile;
+        if (argc > 2) trajectory.rate_dps = atoi(argv[2]);
+        if (argc > 3) trajectory.period_ms = atoi(argv[3]);
+        set_trajectory(trajectory);
+    }
+    else if (argc > 2 && !strcmp(argv[1], "vibration")) {
+        trajectory.vibration_mg = atoi(argv[2]);
+        trajectory.vibration_hz = (argc > 3) ? atoi(argv[3]) : trajectory.vibration_hz;
+        set_trajectory(trajectory);
+    }
+    else if (argc > 2 && !strcmp(argv[1], "noise")) {
+        trajectory.noise_pct = atoi(argv[2]);
+        set_trajectory(trajectory);
+    }
+    else if (argc > 2 && !strcmp(argv[1], "climb")) {
+        trajectory.climb_rate_cm_s = atoi(argv[2]);
+        set_trajectory(trajectory);
+    }
+    else if (argc > 2 && !strcmp(argv[1], "load")) {
+        set_load(atoi(argv[2]));
+    }
+    else if (argc > 1) {
+        shell_error(shell, "Usage: emul [reset | still|yaw|roll|wobble [dps [period_ms]] | "
+                           "vibration <mg> [hz] | noise <pct> | climb <cm/s> | load <pct>]");
+        return -EINVAL;
+    }
+
+    trajectory = get_trajectory();
+    shell_print(shell, "%s %u dps (%u ms), vibration %u mg at %u Hz, noise %u%%, climb %d cm/s",
+                PROFILE_NAMES[trajectory.profile], trajectory.rate_dps, trajectory.period_ms,
+                trajectory.vibration_mg, trajectory.vibration_hz, trajectory.noise_pct,
+                trajectory.climb_rate_cm_s);
+    shell_print(shell, "load %u%%", get_load());
+    shell_print(shell, "%-10s %9s %8s %6s %6s %6s %6s %6s (read age, us)", "sensor", "produced",
+                "dropped", "", "min", "p50", "p99", "max");
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        print_stats(shell, (Sensor)i);
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file	sensor_emul.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the sensor_emul module
+ *
+ * Shared side of the FXOS8700, FXAS21002 & DPS310 i2c emulators (fxos8700_emul.cpp, ...), built
+ * with emul.conf on native_posix. The emulators sit under the zephyr drivers & our driver wrappers
+ * unchanged: they model the registers those touch, sample a synthetic trajectory (a rotation
+ * profile, vibration, noise & a pressure ramp) at the configured output data rates, and assert
+ * their interrupt pins through the gpio emulator. Each also counts the samples it produced, the
+ * ones overwritten or overflowed before being read (dropped), & how old samples are when read --
+ * the handler half of the end to end latency (zqr latency has the data ready to attitude half).
+ *
+ *
+ */
+
+#ifndef __SENSOR_EMUL_H
+#define __SENSOR_EMUL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <drivers/i2c.h>
+#include <shell/shell.h>
+
+#include "linalg.h"
+#include "log2_histogram.hpp"
+
+namespace z_quad_rotor {
+
+namespace sensor_emul {
+
+enum Sensor {
+    SENSOR_FXOS8700,
+    SENSOR_FXAS21002,
+    SENSOR_DPS310,
+    SENSOR_COUNT,
+};
+
+/// Rotation about a fixed axis
+enum Profile {
+    PROFILE_STILL,  // level
+    PROFILE_YAW,    // constant rate about z
+    PROFILE_ROLL,   // constant rate about x
+    PROFILE_WOBBLE, // sinusoidal rate about a tilted (x = y) axis
+    PROFILE_COUNT,
+};
+
+struct Trajectory {
+    Profile profile;
+    uint32_t rate_dps;       // rotation rate (peak rate for wobble)
+    uint32_t period_ms;      // wobble period
+    uint32_t vibration_mg;   // sinusoidal accel vibration amplitude, all axes
+    uint32_t vibration_hz;   // (e.g. motor rotation frequency)
+    uint32_t noise_pct;      // sensor noise, relative to typical datasheet noise
+    int32_t climb_rate_cm_s; // pressure ramp, as altitude change
+};
+
+/// Emulator activity, since the last reset
+struct Stats {
+    uint32_t produced;
+    uint32_t dropped;              // overwritten or overflowed before being read
+    Log2Histogram<32> read_age_us; // sample to i2c read of it
+};
+
+/// The trajectory sampled by the emulators (in physical units, body frame)
+struct Truth {
+    linalg::vec<float, 3> rate;  // rad/s
+    linalg::vec<float, 3> accel; // specific force, m/s^2
+    linalg::vec<float, 3> magn;  // gauss
+    float pressure_pa;
+    float temp_c;
+};
+
+/// Replaces the trajectory; its profile & pressure ramp restart from level & sea level
+void set_trajectory(const Trajectory &trajectory);
+
+Trajectory get_trajectory();
+
+/// Samples the trajectory at time now_us() (noise free)
+Truth get_truth();
+
+/// Returns the emulators' time base (microseconds since boot, at tick resolution)
+uint64_t now_us();
+
+/// Returns one gaussian noise sample of standard deviation sigma, scaled by the noise setting
+/// @note Emulator (timer) context only
+float noise(float sigma);
+
+/// Records samples produced/dropped by a sensor
+void record_produced(Sensor sensor);
+void record_dropped(Sensor sensor, uint32_t count = 1);
+/// Records the read of a sample produced at sample_us
+void record_read(Sensor sensor, uint64_t sample_us);
+
+/// Copies a sensor's stats
+void get_stats(Sensor sensor, Stats &stats);
+
+/// Resets every sensor's stats
+void reset_stats();
+
+/// Returns a sensor's name, or nullptr if out of range
+const char *get_name(Sensor sensor);
+
+/// Busy-waits pct percent of every millisecond in a thread that preempts the sensor driver threads
+void set_load(uint32_t pct);
+
+uint32_t get_load();
+
+/// Handles the register pointer write & burst register accesses of an i2c_emul transfer; the
+/// device provides read(reg), write(reg, val) & next(reg) (the address that auto-increment
+/// moves to from reg)
+template <class D>
+int transfer_registers(D &device, struct i2c_msg *msgs, int num_msgs)
+{
+    bool has_pointer = false;
+    uint8_t reg = 0;
+    for (int i = 0; i < num_msgs; i++) {
+        struct i2c_msg &msg = msgs[i];
+        bool is_read = (msg.flags & I2C_MSG_RW_MASK) == I2C_MSG_READ;
+        for (uint32_t j = 0; j < msg.len; j++) {
+            if (is_read) {
+                msg.buf[j] = device.read(reg);
+                reg = device.next(reg);
+            }
+            else if (!has_pointer) {
+                reg = msg.buf[j];
+                has_pointer = true;
+            }
+            else {
+                device.write(reg, msg.buf[j]);
+                reg = device.next(reg);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/// zqr emul [reset | <profile> [rate_dps [period_ms]] | vibration <mg> <hz> | noise <pct> |
+/// climb <cm/s> | load <pct>]
+int cmd(const struct shell *shell, size_t argc, char **argv);
+
+} // namespace sensor_emul
+
+} // namespace z_quad_rotor
+
+#endif // __SENSOR_EMUL_H
@@ -0,0 +1,62 @@
+/**
+ * @file		seqlock_var.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only template for lock-free (sequence lock) access to a var
+ *
+ * Writers never wait on readers; readers take a copy and retry if a write was in progress while
+ * they were copying. Intended for small variables with a single writer thread.
+ *
+ */
+
+#ifndef __SEQLOCK_VAR_H
+#define __SEQLOCK_VAR_H
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+namespace z_quad_rotor {
+
+/// Provides sequence-lock protection for variable access
+/// @note Single writer only; set_var must not be called concurrently or from an ISR
+template <class T>
+class SeqLockVar {
+  public:
+    /// Constructor -- initializes sequence count as even (no write in progress)
+    SeqLockVar() : m_value(), m_seq(ATOMIC_INIT(0)) {}
+    SeqLockVar(T initial_val) : m_value(initial_val), m_seq(ATOMIC_INIT(0)) {}
+    /// Publishes a new value; never blocks.
+    /// @note Preemption is disabled for the duration of the copy so that a higher priority reader
+    /// can never spin on a write that a lower priority thread cannot finish.
+    void set_var(const T &val)
+    {
+        k_sched_lock();
+        atomic_inc(&m_seq); // odd -- write in progress
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        m_value = val;
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        atomic_inc(&m_seq); // even -- write complete
+        k_sched_unlock();
+    }
+    /// Returns a consistent copy of the variable; retries if a write occurred during the copy.
+    T get_var() const
+    {
+        T copy;
+        atomic_val_t seq;
+        do {
+            seq = atomic_get(&m_seq);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            copy = m_value;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while ((seq & 1) || seq != atomic_get(&m_seq));
+
+        return copy;
+    }
+
+  private:
+    T m_value;
+    atomic_t m_seq;
+};
+
+} // namespace z_quad_rotor
+
+#endif // __SEQLOCK_VAR_H
@@ -0,0 +1,137 @@
+/**
+ * @file	sim_sensors.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the sim_sensors module
+ *
+ */
+
+#include "sim_sensors.hpp"
+
+#include <logging/log.h>
+#include <zephyr.h>
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(sim_sensors, LOG_LEVEL_DBG);
+
+// constants
+static constexpr size_t STACK_SIZE = 1024;
+static constexpr int THREAD_PRIO = 10; // as the sensor drivers' trigger threads
+static constexpr uint32_t GYRO_PERIOD_US = 5000;
+static constexpr uint32_t ACCEL_MAGN_DIVIDER = 2;     // 100 Hz
+static constexpr uint32_t PRESSURE_PERIOD_US = 31250; // 32 Hz
+
+// scale factors at the board's ranges (CONFIG_FXOS8700_RANGE_2G, 0.1 uT, CONFIG_FXAS21002_RANGE=3)
+static constexpr float STANDARD_GRAVITY = 9.80665f;
+static constexpr int16_t ACCEL_LSB_PER_G = 4096;
+static constexpr float MAGN_GAUSS_PER_LSB = 0.001f;
+static constexpr float GYRO_RAD_PER_LSB = 0.0001363538f; // 7.8125 mdps
+
+// scene: level & stationary, field of ~0.56 gauss dipping 66 degrees, sea level
+static constexpr int16_t MAGN_COUNTS[3] = {230, -40, -510};
+static constexpr int16_t GYRO_BIAS_COUNTS[3] = {6, -4, 2};
+static constexpr int32_t PRESSURE_PA = 101325;
+// noise amplitudes (+/-, uniform)
+static constexpr int32_t ACCEL_NOISE_COUNTS = 8;
+static constexpr int32_t MAGN_NOISE_COUNTS = 3;
+static constexpr int32_t GYRO_NOISE_COUNTS = 4;
+static constexpr int32_t PRESSURE_NOISE_PA = 2;
+
+// private variables
+static MargSensor *s_marg_sink;
+static PressureSensor *s_pressure_sink;
+static uint32_t s_noise_state = 0x2545F491; // xorshift32; any nonzero seed
+
+static k_thread s_thread;
+K_THREAD_STACK_DEFINE(s_stack, STACK_SIZE);
+K_TIMER_DEFINE(s_sample_timer, NULL, NULL);
+
+// private function definitions
+/// uniform in [-amplitude, amplitude]
+static int32_t noise(int32_t amplitude)
+{
+    s_noise_state ^= s_noise_state << 13;
+    s_noise_state ^= s_noise_state >> 17;
+    s_noise_state ^= s_noise_state << 5;
+    return (int32_t)(s_noise_state % (uint32_t)((2 * amplitude) + 1)) - amplitude;
+}
+
+static void publish_gyro(uint32_t timestamp)
+{
+    GyroData &slot = s_marg_sink->get_gyro_slot();
+    slot.timestamp = timestamp;
+    for (int axis = 0; axis < 3; axis++) {
+        slot.gyro[axis] = (int16_t)(GYRO_BIAS_COUNTS[axis] + noise(GYRO_NOISE_COUNTS));
+    }
+    s_marg_sink->publish_gyro();
+}
+
+static void publish_accel_magn(uint32_t timestamp)
+{
+    AccelMagnData &slot = s_marg_sink->get_accel_magn_slot();
+    slot.timestamp = timestamp;
+    for (int axis = 0; axis < 3; axis++) {
+        int32_t gravity = (2 == axis) ? ACCEL_LSB_PER_G : 0;
+        slot.accel[axis] = (int16_t)(gravity + noise(ACCEL_NOISE_COUNTS));
+        slot.magn[axis] = (int16_t)(MAGN_COUNTS[axis] + noise(MAGN_NOISE_COUNTS));
+    }
+    s_marg_sink->publish_accel_magn();
+}
+
+static void publish_pressure()
+{
+    int32_t pa = PRESSURE_PA + noise(PRESSURE_NOISE_PA);
+    struct sensor_value pressure;
+    pressure.val1 = pa / 1000; // kPa
+    pressure.val2 = (pa % 1000) * 1000;
+    s_pressure_sink->set_pressure(pressure);
+}
+
+static void thread_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    uint32_t count = 0;
+    uint32_t pressure_due_us = 0;
+    for (;;) {
+        k_timer_status_sync(&s_sample_timer);
+        // accel/magn first, so that fusion pairs a gyro sample with the accel/magn taken with it
+        uint32_t timestamp = k_cycle_get_32();
+        if (0 == (count % ACCEL_MAGN_DIVIDER)) publish_accel_magn(timestamp);
+        publish_gyro(timestamp);
+        uint32_t elapsed_us = count * GYRO_PERIOD_US;
+        if ((int32_t)(elapsed_us - pressure_due_us) >= 0) {
+            publish_pressure();
+            pressure_due_us += PRESSURE_PERIOD_US;
+        }
+        count++;
+    }
+}
+
+// public function definitions
+int sim_sensors::setup(MargSensor *marg_sink, PressureSensor *pressure_sink)
+{
+    int err = 0;
+    // input validation
+    if (marg_sink == nullptr || pressure_sink == nullptr) {
+        LOG_ERR("Sim sensors nullptr error at line: %d.", __LINE__);
+        err = EINVAL;
+    }
+    // publish scale factors & start sampling
+    if (!err) {
+        s_marg_sink = marg_sink;
+        s_pressure_sink = pressure_sink;
+        s_marg_sink->set_accel_magn_scale(STANDARD_GRAVITY / ACCEL_LSB_PER_G, MAGN_GAUSS_PER_LSB);
+        s_marg_sink->set_gyro_scale(GYRO_RAD_PER_LSB);
+
+        k_tid_t tid = k_thread_create(&s_thread, s_stack, K_THREAD_STACK_SIZEOF(s_stack),
+                                      thread_func, NULL, NULL, NULL, THREAD_PRIO, 0, K_NO_WAIT);
+        k_thread_name_set(tid, "sim_sensors");
+        k_timer_start(&s_sample_timer, K_USEC(GYRO_PERIOD_US), K_USEC(GYRO_PERIOD_US));
+        LOG_INF("Simulated sensors started.");
+    }
+
+    return err;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file	sim_sensors.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the sim_sensors module
+ *
+ * Stand-in for the FXOS8700, FXAS21002 & DPS310 drivers on native_posix: a thread publishes
+ * synthetic raw samples of a level, stationary vehicle (gravity, a fixed magnetic field, sea level
+ * pressure, with deterministic noise & gyro bias) to the same sinks at the same rates, so the
+ * whole pipeline downstream of the drivers runs unchanged.
+ *
+ *
+ */
+
+#ifndef __SIM_SENSORS_H
+#define __SIM_SENSORS_H
+
+#include "marg_sensor.hpp"
+#include "pressure_sensor.hpp"
+
+namespace z_quad_rotor {
+
+namespace sim_sensors {
+
+/// Publishes scale factors & starts the sample thread
+/// @param marg_sink Receives accel/magn (100 Hz) & gyro (200 Hz) samples
+/// @param pressure_sink Receives pressure samples (32 Hz)
+int setup(MargSensor *marg_sink, PressureSensor *pressure_sink);
+
+} // namespace sim_sensors
+
+} // namespace z_quad_rotor
+
+#endif // __SIM_SENSORS_H
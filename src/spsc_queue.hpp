@@ -0,0 +1,79 @@
+/**
+ * @file		spsc_queue.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only template for a lock-free single-producer/single-consumer ring
+ *
+ * Head is only written by the producer and tail only by the consumer, so neither side blocks.
+ * Pushing to a full queue drops the new item and counts an overflow.
+ *
+ */
+
+#ifndef __SPSC_QUEUE_H
+#define __SPSC_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+namespace z_quad_rotor {
+
+/// Lock-free ring buffer for one producer thread and one consumer thread
+/// @tparam N Number of slots; holds up to N - 1 items
+template <class T, size_t N>
+class SpscQueue {
+    static_assert(N >= 2, "SpscQueue needs at least two slots");
+
+  public:
+    SpscQueue() : m_items(), m_head(ATOMIC_INIT(0)), m_tail(ATOMIC_INIT(0)), m_overflows(0) {}
+    /// Pushes an item (producer only); returns false and counts an overflow if full
+    bool push(const T &item)
+    {
+        atomic_val_t head = atomic_get(&m_head);
+        atomic_val_t next = increment(head);
+        if (next == atomic_get(&m_tail)) {
+            atomic_inc(&m_overflows);
+            return false;
+        }
+        m_items[head] = item;
+        atomic_set(&m_head, next); // publish item
+        return true;
+    }
+    /// Copies the oldest item without removing it (consumer only); returns false if empty
+    bool peek(T &item) const
+    {
+        atomic_val_t tail = atomic_get(&m_tail);
+        if (tail == atomic_get(&m_head)) return false;
+        item = m_items[tail];
+        return true;
+    }
+    /// Removes the oldest item (consumer only); returns false if empty
+    bool pop(T &item)
+    {
+        if (!peek(item)) return false;
+        atomic_set(&m_tail, increment(atomic_get(&m_tail))); // release slot
+        return true;
+    }
+    /// Returns the number of queued items
+    size_t size() const
+    {
+        atomic_val_t head = atomic_get(&m_head);
+        atomic_val_t tail = atomic_get(&m_tail);
+        return (head >= tail) ? (size_t)(head - tail) : (N - tail + head);
+    }
+    /// Returns the number of items dropped because the queue was full
+    uint32_t get_overflow_count() const { return atomic_get(&m_overflows); }
+
+  private:
+    T m_items[N];
+    atomic_t m_head;
+    atomic_t m_tail;
+    atomic_t m_overflows;
+
+    static atomic_val_t increment(atomic_val_t idx) { return ((size_t)idx + 1 == N) ? 0 : idx + 1; }
+};
+
+} // namespace z_quad_rotor
+
+#endif // __SPSC_QUEUE_H
@@ -0,0 +1,177 @@
+/**
+ * @file	telemetry.cpp
+ * @author	Andrew Loebs
+ * @brief	Source file of the telemetry module
+ *
+ */
+
+#include "telemetry.hpp"
+
+#include <cstring>
+
+#include <device.h>
+#include <drivers/uart.h>
+#include <logging/log.h>
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+#include "spsc_queue.hpp"
+
+using namespace z_quad_rotor;
+
+LOG_MODULE_REGISTER(telemetry, LOG_LEVEL_DBG);
+
+// constants
+static constexpr size_t STACK_SIZE = 1024;
+static constexpr int THREAD_PRIO = K_LOWEST_APPLICATION_THREAD_PRIO;
+static constexpr size_t QUEUE_DEPTH = 32; // 160 ms at 200 Hz
+static constexpr uint32_t POLL_PERIOD_MS = 5;
+static constexpr uint32_t MAX_WRITE_STALLS = 10; // ms; usb tx backed up -- drop the rest
+
+// packet, little endian: sync, header, Frame, CRC-16 over version through payload
+static constexpr uint8_t SYNC_0 = 'Z';
+static constexpr uint8_t SYNC_1 = 'Q';
+static constexpr size_t HEADER_SIZE = 4; // sync (2), version, payload length
+static constexpr size_t CRC_SIZE = 2;
+static constexpr size_t PACKET_SIZE = HEADER_SIZE + sizeof(telemetry::Frame) + CRC_SIZE;
+
+// private variables
+static const struct device *s_uart;
+static SpscQueue<telemetry::Frame, QUEUE_DEPTH> s_queue;
+static k_thread s_thread;
+K_THREAD_STACK_DEFINE(s_stack, STACK_SIZE);
+static uint8_t s_packet[PACKET_SIZE];
+
+static atomic_t s_divider = ATOMIC_INIT(0);
+static atomic_t s_sent = ATOMIC_INIT(0);
+static atomic_t s_dropped = ATOMIC_INIT(0); // port closed or write stalled; see also s_queue
+static uint32_t s_loop_count; // control thread only
+static uint16_t s_sequence;   // control thread only
+
+// private function definitions
+/// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF); bitwise -- runs on the telemetry thread only
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/// frames a queued snapshot into s_packet
+static void build_packet(const telemetry::Frame &frame)
+{
+    s_packet[0] = SYNC_0;
+    s_packet[1] = SYNC_1;
+    s_packet[2] = telemetry::VERSION;
+    s_packet[3] = sizeof(frame);
+    memcpy(&s_packet[HEADER_SIZE], &frame, sizeof(frame));
+    uint16_t crc = crc16(&s_packet[2], PACKET_SIZE - CRC_SIZE - 2);
+    s_packet[PACKET_SIZE - 2] = (uint8_t)crc;
+    s_packet[PACKET_SIZE - 1] = (uint8_t)(crc >> 8);
+}
+
+/// writes s_packet into the cdc acm driver's tx ring, waiting out short usb backlogs
+static int write_packet()
+{
+    size_t offset = 0;
+    uint32_t stalls = 0;
+    while (offset < PACKET_SIZE) {
+        int written = uart_fifo_fill(s_uart, &s_packet[offset], PACKET_SIZE - offset);
+        if (written > 0) {
+            offset += written;
+        }
+        else if (++stalls > MAX_WRITE_STALLS) {
+            return EAGAIN;
+        }
+        else {
+            k_sleep(K_MSEC(1));
+        }
+    }
+    return 0;
+}
+
+static void thread_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        telemetry::Frame frame;
+        if (!s_queue.pop(frame)) {
+            k_sleep(K_MSEC(POLL_PERIOD_MS));
+            continue;
+        }
+        // drop frames until a host opens the port
+        uint32_t dtr = 0;
+        int err = uart_line_ctrl_get(s_uart, UART_LINE_CTRL_DTR, &dtr);
+        if (!err && dtr) {
+            build_packet(frame);
+            err = write_packet();
+        }
+        if (!err && dtr) {
+            atomic_inc(&s_sent);
+        }
+        else {
+            atomic_inc(&s_dropped);
+        }
+    }
+}
+
+// public function definitions
+int telemetry::setup(const char *dev_name)
+{
+    int err = 0;
+    // input validation
+    if (dev_name == nullptr) {
+        LOG_ERR("Telemetry nullptr error at line: %d.", __LINE__);
+        err = EINVAL;
+    }
+    // get device from name
+    if (!err) {
+        s_uart = device_get_binding(dev_name);
+        if (!s_uart) {
+            LOG_ERR("Telemetry UART binding failed.");
+            err = ENXIO;
+        }
+    }
+    // start telemetry thread
+    if (!err) {
+        k_tid_t tid = k_thread_create(&s_thread, s_stack, K_THREAD_STACK_SIZEOF(s_stack),
+                                      thread_func, NULL, NULL, NULL, THREAD_PRIO, 0, K_NO_WAIT);
+        k_thread_name_set(tid, "telemetry");
+    }
+
+    return err;
+}
+
+void telemetry::set_divider(uint32_t divider) { atomic_set(&s_divider, divider); }
+
+uint32_t telemetry::get_divider() { return atomic_get(&s_divider); }
+
+bool telemetry::is_due()
+{
+    uint32_t divider = atomic_get(&s_divider);
+    if (!divider) return false;
+    if (++s_loop_count < divider) return false;
+    s_loop_count = 0;
+    return true;
+}
+
+void telemetry::publish(Frame &frame)
+{
+    frame.sequence = s_sequence++;
+    s_queue.push(frame);
+}
+
+uint32_t telemetry::get_sent_count() { return atomic_get(&s_sent); }
+
+uint32_t telemetry::get_drop_count()
+{
+    return atomic_get(&s_dropped) + s_queue.get_overflow_count();
+}
@@ -0,0 +1,70 @@
+/**
+ * @file	telemetry.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the telemetry module
+ *
+ * Binary telemetry over a dedicated USB CDC ACM port; a low priority thread frames & sends what
+ * the control loop publishes, dropping frames while the host isn't reading. tools/telemetry.py
+ * decodes it.
+ *
+ *
+ */
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <cstdint>
+
+#include <zephyr.h>
+
+namespace z_quad_rotor {
+
+namespace telemetry {
+
+/// Bumped on any change to Frame
+constexpr uint8_t VERSION = 1;
+
+/// Control loop snapshot, as sent; fields are naturally aligned
+struct __packed Frame {
+    uint32_t timestamp_us;   // loop wakeup, uptime
+    float quat[4];           // x, y, z, w
+    float altitude;          // m
+    float climb_rate;        // m/s
+    int16_t accel[3];        // newest raw counts
+    int16_t gyro[3];         // newest raw counts
+    int16_t magn[3];         // newest raw counts
+    uint16_t loop_period_us; // since the previous loop wakeup (saturated)
+    uint16_t latency_us;     // newest gyro sample to attitude (saturated)
+    uint16_t sequence;       // per published frame; gaps are drops
+    uint8_t step_count;      // fusion steps this loop
+    uint8_t flags;           // FLAG_*
+    uint16_t reserved;       // zero; pads ring slots to 4 byte alignment
+};
+static_assert(sizeof(Frame) == 56, "Telemetry frame layout changed -- bump VERSION");
+
+constexpr uint8_t FLAG_ARMED = BIT(0);
+
+/// Binds the CDC ACM port & starts the telemetry thread
+int setup(const char *dev_name);
+
+/// Sets the decimation: one frame every divider control loops (0 stops the stream)
+void set_divider(uint32_t divider);
+uint32_t get_divider();
+
+/// Counts a control loop; returns true if it should publish a frame (control thread only)
+bool is_due();
+
+/// Stamps the frame's sequence & queues it (control thread only)
+void publish(Frame &frame);
+
+/// Returns the number of frames sent
+uint32_t get_sent_count();
+
+/// Returns the number of frames dropped (ring full or port closed)
+uint32_t get_drop_count();
+
+} // namespace telemetry
+
+} // namespace z_quad_rotor
+
+#endif // __TELEMETRY_H
@@ -0,0 +1,75 @@
+/**
+ * @file	trace.hpp
+ * @author	Andrew Loebs
+ * @brief	Header file of the trace module
+ *
+ * Application events for zephyr's CTF tracing, interleaved with the kernel's own (thread switches,
+ * ISRs, semaphores, mutexes): sensor handler entry/exit, fusion start/end & waits on the blackbox
+ * flash lock. The control loop's wait on gyro data (MargSensor::wait_gyro) shows as the kernel's
+ * semaphore take. Built with tracing.conf (see the file for backends); without CONFIG_TRACING_CTF,
+ * every call compiles to nothing. Event layouts are declared for host tools in tools/ctf/zqr.tsdl,
+ * and tools/ctf_trace.py assembles a capture into a trace TraceCompass opens.
+ *
+ *
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <cstdint>
+
+#include <zephyr.h>
+
+#ifdef CONFIG_TRACING_CTF
+// emitted from trace_ctf.c (zephyr's ctf macros are C only)
+extern "C" {
+void zqr_trace_handler_enter(uint8_t source);
+void zqr_trace_handler_exit(uint8_t source, int32_t err);
+void zqr_trace_fusion_start(void);
+void zqr_trace_fusion_end(uint32_t step_count);
+void zqr_trace_lock_wait_start(const void *mutex);
+void zqr_trace_lock_wait_end(const void *mutex);
+}
+#endif
+
+namespace z_quad_rotor {
+
+namespace trace {
+
+/// Sensor handler, as in tools/ctf/zqr.tsdl
+enum Source : uint8_t {
+    SOURCE_ACCEL_MAGN, // fxos8700 trigger handler / fifo drain
+    SOURCE_GYRO,       // fxas21002 trigger handler / fifo drain
+    SOURCE_PRESSURE,   // dps310 fifo drain
+};
+
+#ifdef CONFIG_TRACING_CTF
+static inline void handler_enter(Source source) { zqr_trace_handler_enter(source); }
+static inline void handler_exit(Source source, int err) { zqr_trace_handler_exit(source, err); }
+static inline void fusion_start() { zqr_trace_fusion_start(); }
+/// @param step_count Fusion steps run (gyro samples drained)
+static inline void fusion_end(size_t step_count) { zqr_trace_fusion_end(step_count); }
+/// Brackets a mutex lock call, so waits show apart from the kernel's (immediate) lock events
+static inline void lock_wait_start(const struct k_mutex &mutex)
+{
+    zqr_trace_lock_wait_start(&mutex);
+}
+static inline void lock_wait_end(const struct k_mutex &mutex) { zqr_trace_lock_wait_end(&mutex); }
+#else
+static inline void handler_enter(Source source) { ARG_UNUSED(source); }
+static inline void handler_exit(Source source, int err)
+{
+    ARG_UNUSED(source);
+    ARG_UNUSED(err);
+}
+static inline void fusion_start() {}
+static inline void fusion_end(size_t step_count) { ARG_UNUSED(step_count); }
+static inline void lock_wait_start(const struct k_mutex &mutex) { ARG_UNUSED(mutex); }
+static inline void lock_wait_end(const struct k_mutex &mutex) { ARG_UNUSED(mutex); }
+#endif
+
+} // namespace trace
+
+} // namespace z_quad_rotor
+
+#endif // __TRACE_H
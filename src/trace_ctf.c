@@ -0,0 +1,51 @@
+/**
+ * @file	trace_ctf.c
+ * @author	Andrew Loebs
+ * @brief	Source file of the trace module's CTF events
+ *
+ * C, as zephyr's CTF_EVENT macros use compound literals. Event ids & fields must match
+ * tools/ctf/zqr.tsdl.
+ *
+ */
+
+#include <stdint.h>
+
+#include <ctf_top.h>
+#include <zephyr.h>
+
+// constants
+// above zephyr's kernel event ids
+#define EVENT_HANDLER_ENTER 0xE0
+#define EVENT_HANDLER_EXIT 0xE1
+#define EVENT_FUSION_START 0xE2
+#define EVENT_FUSION_END 0xE3
+#define EVENT_LOCK_WAIT_START 0xE4
+#define EVENT_LOCK_WAIT_END 0xE5
+
+// public function definitions
+void zqr_trace_handler_enter(uint8_t source)
+{
+    CTF_EVENT(CTF_LITERAL(uint8_t, EVENT_HANDLER_ENTER), source);
+}
+
+void zqr_trace_handler_exit(uint8_t source, int32_t err)
+{
+    CTF_EVENT(CTF_LITERAL(uint8_t, EVENT_HANDLER_EXIT), source, err);
+}
+
+void zqr_trace_fusion_start(void) { CTF_EVENT(CTF_LITERAL(uint8_t, EVENT_FUSION_START)); }
+
+void zqr_trace_fusion_end(uint32_t step_count)
+{
+    CTF_EVENT(CTF_LITERAL(uint8_t, EVENT_FUSION_END), step_count);
+}
+
+void zqr_trace_lock_wait_start(const void *mutex)
+{
+    CTF_EVENT(CTF_LITERAL(uint8_t, EVENT_LOCK_WAIT_START), CTF_LITERAL(uint32_t, (uintptr_t)mutex));
+}
+
+void zqr_trace_lock_wait_end(const void *mutex)
+{
+    CTF_EVENT(CTF_LITERAL(uint8_t, EVENT_LOCK_WAIT_END), CTF_LITERAL(uint32_t, (uintptr_t)mutex));
+}
@@ -0,0 +1,58 @@
+/**
+ * @file		triple_buffer.hpp
+ * @author	Andrew Loebs
+ * @brief		Header-only template for wait-free single-producer/single-consumer handoff
+ *
+ * The producer fills a private slot and publishes it with a single atomic swap; the consumer
+ * swaps in the newest published slot. Neither side ever waits on the other, and the consumer can
+ * never see a partially written frame.
+ *
+ */
+
+#ifndef __TRIPLE_BUFFER_H
+#define __TRIPLE_BUFFER_H
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+namespace z_quad_rotor {
+
+/// Provides wait-free handoff of the newest complete value from one producer to one consumer
+/// @note Exactly one producer thread and one consumer thread
+template <class T>
+class TripleBuffer {
+  public:
+    /// Constructor -- producer owns slot 0, consumer owns slot 1, slot 2 is shared
+    TripleBuffer() : m_slots(), m_write_idx(0), m_read_idx(1), m_shared(ATOMIC_INIT(2)) {}
+    /// Returns the producer's private slot (producer only)
+    T &get_write_slot() { return m_slots[m_write_idx]; }
+    /// Publishes the producer's slot as the newest frame (producer only)
+    void publish()
+    {
+        atomic_val_t prev = atomic_set(&m_shared, m_write_idx | NEW_DATA_FLAG);
+        m_write_idx = prev & INDEX_MASK;
+    }
+    /// Returns the newest complete frame (consumer only)
+    /// @note Reference is valid until the next call to get_read_slot
+    const T &get_read_slot()
+    {
+        if (atomic_get(&m_shared) & NEW_DATA_FLAG) {
+            atomic_val_t prev = atomic_set(&m_shared, m_read_idx);
+            m_read_idx = prev & INDEX_MASK;
+        }
+        return m_slots[m_read_idx];
+    }
+
+  private:
+    T m_slots[3];
+    atomic_val_t m_write_idx;
+    atomic_val_t m_read_idx;
+    atomic_t m_shared; // index of shared slot, flagged if it holds an unread frame
+
+    constexpr static atomic_val_t INDEX_MASK = 0x3;
+    constexpr static atomic_val_t NEW_DATA_FLAG = 0x4;
+};
+
+} // namespace z_quad_rotor
+
+#endif // __TRIPLE_BUFFER_H
@@ -0,0 +1,102 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	Altitude tests -- the estimate converges on a pressure step
+ *
+ * Steps run at the control loop's rate at rest (accel up is 1 g), with pressure samples at the
+ * barometer's rate.
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include <cmath>
+
+#include <drivers/sensor.h>
+
+#include "altitude.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr float STANDARD_GRAVITY = 9.80665f;
+static constexpr uint32_t TIME_DIFF_US = 1000;
+static constexpr uint32_t STEPS_PER_PRESSURE = 32; // ~32 Hz
+static constexpr uint32_t SETTLE_STEPS = 20000;    // 20 s
+static constexpr float STEP_M = 10.0f;
+static constexpr float TOLERANCE_M = 0.05f;
+static constexpr float TOLERANCE_M_S = 0.05f;
+
+// private function definitions
+/// pressure (standard atmosphere) at an altitude, as the barometer reports it
+static struct sensor_value altitude_to_pressure(float altitude_m)
+{
+    const double kpa = baro::SEA_LEVEL_KPA *
+                       std::pow(1.0 - (altitude_m / baro::SCALE_M), 1.0 / baro::EXPONENT);
+    struct sensor_value pressure;
+    pressure.val1 = (int32_t)kpa;
+    pressure.val2 = (int32_t)std::lround((kpa - pressure.val1) * 1000000.0);
+    return pressure;
+}
+
+/// runs steps at rest with the pressure of an altitude; accel_bias is added to the accel
+static void run(Altitude &altitude, float altitude_m, float accel_bias, uint32_t steps)
+{
+    const struct sensor_value pressure = altitude_to_pressure(altitude_m);
+    for (uint32_t i = 0; i < steps; i++) {
+        altitude.predict(STANDARD_GRAVITY + accel_bias, TIME_DIFF_US);
+        if ((i % STEPS_PER_PRESSURE) == 0) altitude.update(pressure);
+    }
+}
+
+/// for assertion messages (no float printf on every libc)
+static int to_milli(float value) { return (int)(value * 1000.0f); }
+
+static void check_pressure_step(float accel_bias)
+{
+    Altitude altitude;
+
+    run(altitude, 0.0f, accel_bias, SETTLE_STEPS);
+    zassert_within(altitude.get_altitude(), 0.0f, TOLERANCE_M, "%d mm before the step",
+                   to_milli(altitude.get_altitude()));
+
+    // filtered: the first sample after the step only moves the estimate part way
+    run(altitude, STEP_M, accel_bias, 1);
+    zassert_true(altitude.get_altitude() < STEP_M - TOLERANCE_M, "%d mm, unfiltered",
+                 to_milli(altitude.get_altitude()));
+
+    run(altitude, STEP_M, accel_bias, SETTLE_STEPS);
+    zassert_within(altitude.get_altitude(), STEP_M, TOLERANCE_M, "%d mm after the step",
+                   to_milli(altitude.get_altitude()));
+    zassert_within(altitude.get_velocity(), 0.0f, TOLERANCE_M_S, "%d mm/s after the step",
+                   to_milli(altitude.get_velocity()));
+}
+
+static void test_first_update_initializes(void)
+{
+    Altitude altitude;
+
+    // predictions before the first pressure sample are ignored
+    altitude.predict(STANDARD_GRAVITY + 1.0f, TIME_DIFF_US);
+    zassert_within(altitude.get_altitude(), 0.0f, 0.0f, "predicted before initialization");
+
+    altitude.update(altitude_to_pressure(STEP_M));
+    zassert_within(altitude.get_altitude(), STEP_M, baro::TOLERANCE_M, "%d mm",
+                   to_milli(altitude.get_altitude()));
+    zassert_within(altitude.get_velocity(), 0.0f, 0.0f, "%d mm/s",
+                   to_milli(altitude.get_velocity()));
+}
+
+static void test_pressure_step(void) { check_pressure_step(0.0f); }
+
+static void test_pressure_step_accel_bias(void) { check_pressure_step(0.2f); }
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(altitude, ztest_unit_test(test_first_update_initializes),
+                     ztest_unit_test(test_pressure_step),
+                     ztest_unit_test(test_pressure_step_accel_bias));
+    ztest_run_test_suite(altitude);
+}
@@ -0,0 +1,98 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	Fusion tests -- each algorithm converges to a known static attitude
+ *
+ * Raw counts are made from the attitude's view of gravity & the earth's field, at the board's
+ * sensor scales, and run through Orientation from level (the identity quaternion).
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include <cmath>
+
+#include "linalg.h"
+
+#include "axis_remap.hpp"
+#include "fusion.hpp"
+#include "orientation.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+/// the board's ranges: +/-2 g accel (CONFIG_FXOS8700_RANGE_2G), 0.1 uT magn, 250 dps gyro
+static const MargScale SCALE = {9.80665f / 4096.0f, 1091e-6f / 8, 0.001f};
+static constexpr uint32_t TIME_DIFF_US = 1000;
+static constexpr uint32_t STEPS = 120000; // 120 s; Mahony's magn feedback (yaw) is the slowest
+static constexpr float TOLERANCE = 1.0f * DEG_TO_RAD;
+
+static const EulerAngle ATTITUDE(20.0f * DEG_TO_RAD, -10.0f * DEG_TO_RAD, 30.0f * DEG_TO_RAD);
+static const linalg::vec<float, 3> GRAVITY(0.0f, 0.0f, 9.80665f); // at rest, up is +z
+static const linalg::vec<float, 3> EARTH_FIELD(0.25f, 0.0f, -0.433f); // gauss; 60 deg dip, x north
+
+// private function definitions
+/// earth frame vector as seen from the body frame at an attitude (roll, pitch, yaw; radians)
+static linalg::vec<float, 3> to_body(const EulerAngle &euler, const linalg::vec<float, 3> &earth)
+{
+    const Quaternion quat =
+        linalg::qmul(linalg::qmul(linalg::rotation_quat(linalg::vec<float, 3>(0, 0, 1), euler.z),
+                                  linalg::rotation_quat(linalg::vec<float, 3>(0, 1, 0), euler.y)),
+                     linalg::rotation_quat(linalg::vec<float, 3>(1, 0, 0), euler.x));
+    return linalg::qrot(linalg::qconj(quat), earth);
+}
+
+static int16_t to_counts(float value, float scale) { return (int16_t)std::lround(value / scale); }
+
+/// for assertion messages (no float printf on every libc)
+static int to_mdeg(float radians) { return (int)(radians * RAD_TO_DEG * 1000.0f); }
+
+/// raw sensor values at rest at an attitude
+static MargData make_marg_data(const EulerAngle &euler)
+{
+    const linalg::vec<float, 3> accel = to_body(euler, GRAVITY);
+    const linalg::vec<float, 3> magn = to_body(euler, EARTH_FIELD);
+    MargData marg_data = {};
+    for (int axis = 0; axis < 3; axis++) {
+        marg_data.accel[axis] = to_counts(accel[axis], SCALE.accel);
+        marg_data.magn[axis] = to_counts(magn[axis], SCALE.magn);
+    }
+    return marg_data;
+}
+
+/// runs T from level at rest at ATTITUDE; yaw is only observable with the magn (is_marg)
+template <class T>
+static void check_converges(bool is_marg)
+{
+    Orientation<T, IdentityRemap> orientation;
+    const MargData marg_data = make_marg_data(ATTITUDE);
+    for (uint32_t i = 0; i < STEPS; i++) {
+        orientation.update(marg_data, SCALE, TIME_DIFF_US);
+    }
+
+    const EulerAngle euler = orientation.get_euler_angle();
+    zassert_within(euler.x, ATTITUDE.x, TOLERANCE, "roll %d mdeg", to_mdeg(euler.x));
+    zassert_within(euler.y, ATTITUDE.y, TOLERANCE, "pitch %d mdeg", to_mdeg(euler.y));
+    if (is_marg) {
+        zassert_within(euler.z, ATTITUDE.z, TOLERANCE, "yaw %d mdeg", to_mdeg(euler.z));
+    }
+}
+
+static void test_madgwick6(void) { check_converges<MadgwickFusion6>(false); }
+static void test_madgwick9(void) { check_converges<MadgwickFusion9>(true); }
+static void test_madgwick6_fixed(void) { check_converges<MadgwickFusion6Fixed>(false); }
+static void test_mahony6(void) { check_converges<MahonyFusion6>(false); }
+static void test_mahony9(void) { check_converges<MahonyFusion9>(true); }
+static void test_eskf6(void) { check_converges<EskfFusion6>(false); }
+static void test_eskf9(void) { check_converges<EskfFusion9>(true); }
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(fusion, ztest_unit_test(test_madgwick6), ztest_unit_test(test_madgwick9),
+                     ztest_unit_test(test_madgwick6_fixed), ztest_unit_test(test_mahony6),
+                     ztest_unit_test(test_mahony9), ztest_unit_test(test_eskf6),
+                     ztest_unit_test(test_eskf9));
+    ztest_run_test_suite(fusion);
+}
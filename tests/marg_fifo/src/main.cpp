@@ -0,0 +1,132 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	Sensor FIFO mode tests -- batches, timestamps & drops over the sensor emulators
+ *
+ * fxos8700 & fxas21002 run in FIFO mode (nonzero watermarks) over their emulators, as the app
+ * built with emul.conf. The test thread polls the MargSensor queues every tick; batches are
+ * published whole by the fifo threads, so each poll finds at most one batch per sensor.
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include <cstdlib>
+
+#include <zephyr.h>
+
+#include "fxas21002.hpp"
+#include "fxos8700.hpp"
+#include "marg_sensor.hpp"
+#include "sensor_emul.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr uint8_t ACCEL_WATERMARK = 4;
+static constexpr uint8_t GYRO_WATERMARK = 8;
+static constexpr uint32_t ACCEL_PERIOD_US = 5000;                      // as set by fxos8700.cpp
+static constexpr uint32_t GYRO_PERIOD_US = 1250 << CONFIG_FXAS21002_DR; // 800 Hz >> DR
+static constexpr int32_t RUN_MS = 500;
+
+// types
+/// What a sensor's batches looked like
+struct BatchStats {
+    uint32_t samples;
+    uint32_t batches;
+    uint32_t wrong_size_batches; // not a watermark of samples
+    uint32_t bad_spacings;       // samples not a sample period apart, within or across batches
+    uint32_t last_timestamp;
+};
+
+// private variables
+static MargSensor s_marg_sensor;
+
+// private function definitions
+/// checks one poll's samples (oldest first), which are a single batch
+static void check_batch(BatchStats &stats, const uint32_t *timestamps, size_t count,
+                        uint8_t watermark, uint32_t period_us)
+{
+    if (!count) return;
+    const int32_t period_cyc = (int32_t)k_us_to_cyc_near32(period_us);
+    const int32_t tolerance_cyc = (int32_t)k_ticks_to_cyc_ceil32(1); // emulator time resolution
+
+    stats.batches++;
+    if (count != watermark) stats.wrong_size_batches++;
+    for (size_t i = 0; i < count; i++) {
+        if (stats.samples) {
+            int32_t spacing = (int32_t)(timestamps[i] - stats.last_timestamp);
+            if (abs(spacing - period_cyc) > tolerance_cyc) stats.bad_spacings++;
+        }
+        stats.last_timestamp = timestamps[i];
+        stats.samples++;
+    }
+}
+
+static void poll_accel_magn(BatchStats &stats)
+{
+    uint32_t timestamps[MargSensor::QUEUE_DEPTH];
+    size_t count = 0;
+    AccelMagnData sample;
+    while (count < ARRAY_SIZE(timestamps) && s_marg_sensor.pop_accel_magn(sample)) {
+        timestamps[count++] = sample.timestamp;
+    }
+    check_batch(stats, timestamps, count, ACCEL_WATERMARK, ACCEL_PERIOD_US);
+}
+
+static void poll_gyro(BatchStats &stats)
+{
+    uint32_t timestamps[MargSensor::QUEUE_DEPTH];
+    size_t count = 0;
+    GyroData sample;
+    while (count < ARRAY_SIZE(timestamps) && s_marg_sensor.pop_gyro(sample)) {
+        timestamps[count++] = sample.timestamp;
+    }
+    check_batch(stats, timestamps, count, GYRO_WATERMARK, GYRO_PERIOD_US);
+}
+
+static void check_sensor(const char *name, const BatchStats &stats, sensor_emul::Sensor sensor)
+{
+    sensor_emul::Stats emul_stats;
+    sensor_emul::get_stats(sensor, emul_stats);
+
+    zassert_true(stats.batches > 1, "%s: %u batches", name, stats.batches);
+    zassert_equal(stats.wrong_size_batches, 0, "%s: %u of %u batches not a watermark of samples",
+                  name, stats.wrong_size_batches, stats.batches);
+    zassert_equal(stats.bad_spacings, 0, "%s: %u samples off the sample period", name,
+                  stats.bad_spacings);
+    zassert_equal(emul_stats.dropped, 0, "%s: %u samples dropped by the emulator", name,
+                  emul_stats.dropped);
+}
+
+static void test_fifo_batches(void)
+{
+    int err = fxos8700::setup(DT_LABEL(DT_INST(0, nxp_fxos8700)), &s_marg_sensor,
+                              ACCEL_WATERMARK);
+    zassert_equal(err, 0, "fxos8700 setup err: %d", err);
+    err = fxas21002::setup(DT_LABEL(DT_INST(0, nxp_fxas21002)), &s_marg_sensor, GYRO_WATERMARK);
+    zassert_equal(err, 0, "fxas21002 setup err: %d", err);
+    sensor_emul::reset_stats();
+
+    BatchStats accel_magn = {};
+    BatchStats gyro = {};
+    const int64_t stop_ms = k_uptime_get() + RUN_MS;
+    while (k_uptime_get() < stop_ms) {
+        k_sleep(K_TICKS(1));
+        poll_accel_magn(accel_magn);
+        poll_gyro(gyro);
+    }
+
+    check_sensor("fxos8700", accel_magn, sensor_emul::SENSOR_FXOS8700);
+    check_sensor("fxas21002", gyro, sensor_emul::SENSOR_FXAS21002);
+    zassert_equal(s_marg_sensor.get_accel_magn_overflows(), 0, "accel/magn queue overflowed");
+    zassert_equal(s_marg_sensor.get_gyro_overflows(), 0, "gyro queue overflowed");
+}
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(marg_fifo, ztest_unit_test(test_fifo_batches));
+    ztest_run_test_suite(marg_fifo);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	Orientation tests -- drain pairs queued samples & measures each time step
+ *
+ * Samples are tagged by their accel x count, so each fusion step shows which accel/magn sample
+ * drain paired with its gyro sample.
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include "axis_remap.hpp"
+#include "fusion.hpp"
+#include "marg_sensor.hpp"
+#include "orientation.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr int16_t ONE_G = 4096; // counts (+/-2 g range)
+static constexpr size_t MAX_STEPS = 8;
+
+// types
+/// Fusion steps passed on by one drain
+struct Steps {
+    FusionStep steps[MAX_STEPS];
+    uint32_t count;
+};
+
+// private function definitions
+static uint32_t to_cycles(uint32_t us) { return k_us_to_cyc_near32(us); }
+
+/// queues an accel/magn sample at rest, tagged with id
+static void publish_accel_magn(MargSensor &marg_sensor, uint32_t timestamp, int16_t id)
+{
+    AccelMagnData &accel_magn = marg_sensor.get_accel_magn_slot();
+    accel_magn = {};
+    accel_magn.timestamp = timestamp;
+    accel_magn.accel[0] = id;
+    accel_magn.accel[2] = ONE_G;
+    marg_sensor.publish_accel_magn();
+}
+
+/// queues a gyro sample at rest
+static void publish_gyro(MargSensor &marg_sensor, uint32_t timestamp)
+{
+    GyroData &gyro = marg_sensor.get_gyro_slot();
+    gyro = {};
+    gyro.timestamp = timestamp;
+    marg_sensor.publish_gyro();
+}
+
+template <class O>
+static size_t drain(O &orientation, MargSensor &marg_sensor, Steps &steps)
+{
+    steps.count = 0;
+    return orientation.drain(marg_sensor, [&](const FusionStep &step) {
+        if (steps.count < MAX_STEPS) steps.steps[steps.count] = step;
+        steps.count++;
+    });
+}
+
+static void test_pairs_by_timestamp(void)
+{
+    MargSensor marg_sensor;
+    Orientation<MadgwickFusion6, IdentityRemap> orientation;
+    Steps steps;
+
+    publish_accel_magn(marg_sensor, to_cycles(500), 1);
+    publish_accel_magn(marg_sensor, to_cycles(1500), 2);
+    publish_accel_magn(marg_sensor, to_cycles(2600), 3);
+    publish_accel_magn(marg_sensor, to_cycles(3500), 4); // after every gyro sample below
+    publish_gyro(marg_sensor, to_cycles(1000));
+    publish_gyro(marg_sensor, to_cycles(2000));
+    publish_gyro(marg_sensor, to_cycles(3000));
+
+    // the first gyro sample only sets the time reference
+    zassert_equal(drain(orientation, marg_sensor, steps), 3, "gyro samples not all drained");
+    zassert_equal(steps.count, 2, "%u steps", steps.count);
+    // each paired with the newest accel/magn sample at or before it
+    zassert_equal(steps.steps[0].marg_data.accel[0], 2, "paired with sample %d",
+                  steps.steps[0].marg_data.accel[0]);
+    zassert_equal(steps.steps[0].timestamp, to_cycles(2000), "not the gyro sample's timestamp");
+    zassert_equal(steps.steps[1].marg_data.accel[0], 3, "paired with sample %d",
+                  steps.steps[1].marg_data.accel[0]);
+    zassert_equal(steps.steps[1].timestamp, to_cycles(3000), "not the gyro sample's timestamp");
+
+    // the later accel/magn sample stays queued for the next drain
+    publish_gyro(marg_sensor, to_cycles(4000));
+    zassert_equal(drain(orientation, marg_sensor, steps), 1, "gyro sample not drained");
+    zassert_equal(steps.count, 1, "%u steps", steps.count);
+    zassert_equal(steps.steps[0].marg_data.accel[0], 4, "paired with sample %d",
+                  steps.steps[0].marg_data.accel[0]);
+}
+
+static void test_time_diff(void)
+{
+    MargSensor marg_sensor;
+    Orientation<MadgwickFusion6, IdentityRemap> orientation;
+    Steps steps;
+
+    // uneven steps, measured between gyro timestamps
+    publish_accel_magn(marg_sensor, to_cycles(0), 1);
+    publish_gyro(marg_sensor, to_cycles(1000));
+    publish_gyro(marg_sensor, to_cycles(1250));
+    publish_gyro(marg_sensor, to_cycles(3250));
+    zassert_equal(drain(orientation, marg_sensor, steps), 3, "gyro samples not all drained");
+    zassert_equal(steps.count, 2, "%u steps", steps.count);
+    zassert_within(steps.steps[0].time_diff_us, 250, 1, "%u us", steps.steps[0].time_diff_us);
+    zassert_within(steps.steps[1].time_diff_us, 2000, 1, "%u us", steps.steps[1].time_diff_us);
+
+    // from the previous drain's last sample
+    publish_gyro(marg_sensor, to_cycles(3750));
+    zassert_equal(drain(orientation, marg_sensor, steps), 1, "gyro sample not drained");
+    zassert_within(steps.steps[0].time_diff_us, 500, 1, "%u us", steps.steps[0].time_diff_us);
+}
+
+static void test_time_diff_wraparound(void)
+{
+    MargSensor marg_sensor;
+    Orientation<MadgwickFusion6, IdentityRemap> orientation;
+    Steps steps;
+
+    // the hw cycle counter wraps between (and within) the pairs
+    const uint32_t start = (uint32_t)0 - to_cycles(1500);
+    publish_accel_magn(marg_sensor, start, 1);
+    publish_gyro(marg_sensor, start + to_cycles(500));
+    publish_accel_magn(marg_sensor, start + to_cycles(1400), 2);
+    publish_gyro(marg_sensor, start + to_cycles(1500));
+    publish_accel_magn(marg_sensor, start + to_cycles(2400), 3);
+    publish_gyro(marg_sensor, start + to_cycles(2500));
+    zassert_equal(drain(orientation, marg_sensor, steps), 3, "gyro samples not all drained");
+    zassert_equal(steps.count, 2, "%u steps", steps.count);
+    zassert_equal(steps.steps[0].marg_data.accel[0], 2, "paired with sample %d",
+                  steps.steps[0].marg_data.accel[0]);
+    zassert_within(steps.steps[0].time_diff_us, 1000, 1, "%u us", steps.steps[0].time_diff_us);
+    zassert_equal(steps.steps[1].marg_data.accel[0], 3, "paired with sample %d",
+                  steps.steps[1].marg_data.accel[0]);
+    zassert_within(steps.steps[1].time_diff_us, 1000, 1, "%u us", steps.steps[1].time_diff_us);
+}
+
+static void test_underflow(void)
+{
+    MargSensor marg_sensor;
+    Orientation<MadgwickFusion6, IdentityRemap> orientation;
+    Steps steps;
+
+    zassert_equal(drain(orientation, marg_sensor, steps), 0, "drained an empty queue");
+    zassert_equal(steps.count, 0, "%u steps", steps.count);
+    zassert_equal(orientation.get_underflow_count(), 1, "underflow not counted");
+
+    publish_accel_magn(marg_sensor, to_cycles(0), 1);
+    publish_gyro(marg_sensor, to_cycles(1000));
+    zassert_equal(drain(orientation, marg_sensor, steps), 1, "gyro sample not drained");
+    zassert_equal(orientation.get_underflow_count(), 1, "underflow counted");
+}
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(orientation, ztest_unit_test(test_pairs_by_timestamp),
+                     ztest_unit_test(test_time_diff), ztest_unit_test(test_time_diff_wraparound),
+                     ztest_unit_test(test_underflow));
+    ztest_run_test_suite(orientation);
+}
@@ -0,0 +1,149 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	SeqLockVar tests -- readers never see a torn value under contention
+ *
+ * The var's copies busy wait between their two halves, so the periodic (higher priority) thread
+ * wakes on a tick in the middle of the other thread's copy.
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+#include "seqlock_var.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr size_t STACK_SIZE = 1024;
+static constexpr int HIGH_PRIO = 5;
+static constexpr int LOW_PRIO = 6;
+static constexpr uint32_t COPY_US = 100;
+static constexpr int32_t RUN_MS = 500;
+
+// types
+/// Two halves that always match when written; a copy takes COPY_US
+struct Sample {
+    uint32_t first;
+    uint32_t second;
+
+    Sample() : first(0), second(0) {}
+    Sample(uint32_t value) : first(value), second(value) {}
+    Sample(const Sample &other) : first(other.first), second(other.second) {}
+    Sample &operator=(const Sample &other);
+};
+
+// private variables
+static k_thread s_reader_thread;
+static k_thread s_writer_thread;
+K_THREAD_STACK_DEFINE(s_reader_stack, STACK_SIZE);
+K_THREAD_STACK_DEFINE(s_writer_stack, STACK_SIZE);
+// uptime at which the threads stop themselves (whatever the test thread's priority)
+static int64_t s_stop_ms;
+
+static SeqLockVar<Sample> s_var;
+static atomic_t s_copies; // by set_var & get_var (each attempt)
+static volatile uint32_t s_writes;
+static volatile uint32_t s_reads;
+static volatile uint32_t s_torn_reads;
+static volatile uint32_t s_stale_reads;
+
+// private function definitions
+Sample &Sample::operator=(const Sample &other)
+{
+    atomic_inc(&s_copies);
+    first = other.first;
+    k_busy_wait(COPY_US);
+    second = other.second;
+    return *this;
+}
+
+/// writes increasing values; p1: sleeps a tick between writes if nonzero
+static void writer_func(void *p1, void *p2, void *p3)
+{
+    const bool is_periodic = POINTER_TO_UINT(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (k_uptime_get() < s_stop_ms) {
+        s_var.set_var(Sample(s_writes + 1));
+        s_writes++;
+        if (is_periodic) k_sleep(K_TICKS(1));
+    }
+}
+
+/// checks each value read; p1: sleeps a tick between reads if nonzero
+static void reader_func(void *p1, void *p2, void *p3)
+{
+    const bool is_periodic = POINTER_TO_UINT(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    uint32_t last = 0;
+    while (k_uptime_get() < s_stop_ms) {
+        const Sample sample = s_var.get_var();
+        if (sample.first != sample.second) s_torn_reads++;
+        if (sample.first < last) s_stale_reads++;
+        last = sample.first;
+        s_reads++;
+        if (is_periodic) k_sleep(K_TICKS(1));
+    }
+}
+
+/// runs reader & writer for RUN_MS; returns the number of get_var retries
+static uint32_t run_contention(bool is_writer_periodic)
+{
+    s_var.set_var(Sample());
+    atomic_set(&s_copies, 0);
+    s_writes = 0;
+    s_reads = 0;
+    s_torn_reads = 0;
+    s_stale_reads = 0;
+
+    // the periodic thread preempts the spinning one
+    s_stop_ms = k_uptime_get() + RUN_MS;
+    k_thread_create(&s_writer_thread, s_writer_stack, K_THREAD_STACK_SIZEOF(s_writer_stack),
+                    writer_func, UINT_TO_POINTER(is_writer_periodic), NULL, NULL,
+                    is_writer_periodic ? HIGH_PRIO : LOW_PRIO, 0, K_NO_WAIT);
+    k_thread_create(&s_reader_thread, s_reader_stack, K_THREAD_STACK_SIZEOF(s_reader_stack),
+                    reader_func, UINT_TO_POINTER(!is_writer_periodic), NULL, NULL,
+                    is_writer_periodic ? LOW_PRIO : HIGH_PRIO, 0, K_NO_WAIT);
+    k_thread_join(&s_writer_thread, K_FOREVER);
+    k_thread_join(&s_reader_thread, K_FOREVER);
+
+    // one copy per write, one per read attempt
+    const uint32_t retries = atomic_get(&s_copies) - s_writes - s_reads;
+
+    zassert_true(s_writes > 1, "%u writes", s_writes);
+    zassert_true(s_reads > 1, "%u reads", s_reads);
+    zassert_equal(s_torn_reads, 0, "%u torn reads", s_torn_reads);
+    zassert_equal(s_stale_reads, 0, "%u reads went back in time", s_stale_reads);
+    zassert_equal(s_var.get_var().first, s_writes, "last write lost");
+    return retries;
+}
+
+static void test_writer_preempts_reader(void)
+{
+    // writes land in the middle of reads, which retry
+    const uint32_t retries = run_contention(true);
+    zassert_true(retries > 0, "no reads retried, contention not exercised");
+}
+
+static void test_reader_preempts_writer(void)
+{
+    // the writer holds off preemption while copying, so reads never find a write in progress
+    const uint32_t retries = run_contention(false);
+    zassert_equal(retries, 0, "%u reads retried", retries);
+}
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(seqlock_var, ztest_unit_test(test_writer_preempts_reader),
+                     ztest_unit_test(test_reader_preempts_writer));
+    ztest_run_test_suite(seqlock_var);
+}
@@ -0,0 +1,260 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	SpscQueue tests -- order, wraparound, overflow & preemption between the two sides
+ *
+ * The spinning (lower priority) thread's item copies busy wait for two ticks between their halves,
+ * so the periodic thread, woken every tick, lands in the middle of its push or pop.
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+#include "spsc_queue.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr size_t STACK_SIZE = 1024;
+static constexpr int HIGH_PRIO = 5;
+static constexpr int LOW_PRIO = 6;
+static constexpr int32_t COPY_TICKS = 2;
+static constexpr uint32_t IDLE_US = 10; // spinning on an empty or full queue
+static constexpr int64_t RUN_TICKS = 100;
+static constexpr size_t QUEUE_SIZE = 16;
+static constexpr size_t BURST_SIZE = QUEUE_SIZE; // pushed per wake; overflows a full queue
+
+// types
+/// Two halves that always match when written
+struct Item {
+    uint32_t first;
+    uint32_t second;
+
+    Item() : first(0), second(0) {}
+    Item(uint32_t value) : first(value), second(value) {}
+    Item(const Item &other) : first(other.first), second(other.second) {}
+    Item &operator=(const Item &other);
+};
+
+// private variables
+static k_thread s_producer_thread;
+static k_thread s_consumer_thread;
+K_THREAD_STACK_DEFINE(s_producer_stack, STACK_SIZE);
+K_THREAD_STACK_DEFINE(s_consumer_stack, STACK_SIZE);
+// uptime at which the threads stop themselves (whatever the test thread's priority)
+static int64_t s_stop_ticks;
+static k_thread *s_low_thread;
+static uint32_t s_copy_us;
+static atomic_t s_low_copying;
+
+static SpscQueue<Item, QUEUE_SIZE> s_queue;
+static volatile uint32_t s_pushes;           // items queued (numbered 1...)
+static volatile uint32_t s_full_pushes;      // pushes rejected by a full queue
+static volatile uint32_t s_pops;
+static volatile uint32_t s_last_popped;
+static volatile uint32_t s_torn_pops;
+static volatile uint32_t s_misordered_pops;  // not the next item pushed
+static volatile uint32_t s_preempted_copies; // the periodic thread woke mid-copy
+
+// private function definitions
+Item &Item::operator=(const Item &other)
+{
+    if (k_current_get() != s_low_thread) {
+        first = other.first;
+        second = other.second;
+        return *this;
+    }
+    atomic_set(&s_low_copying, 1);
+    first = other.first;
+    k_busy_wait(s_copy_us);
+    second = other.second;
+    atomic_set(&s_low_copying, 0);
+    return *this;
+}
+
+static bool push_next()
+{
+    if (s_queue.push(Item(s_pushes + 1))) {
+        s_pushes++;
+        return true;
+    }
+    s_full_pushes++;
+    return false;
+}
+
+static void check_popped(const Item &item)
+{
+    if (item.first != item.second) s_torn_pops++;
+    if (item.first != s_last_popped + 1) s_misordered_pops++;
+    s_last_popped = item.first;
+    s_pops++;
+}
+
+/// p1: pushes a burst every tick if nonzero, else spins
+static void producer_func(void *p1, void *p2, void *p3)
+{
+    const bool is_periodic = POINTER_TO_UINT(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (k_uptime_ticks() < s_stop_ticks) {
+        if (is_periodic) {
+            if (atomic_get(&s_low_copying)) s_preempted_copies++;
+            for (size_t i = 0; i < BURST_SIZE; i++) {
+                push_next();
+            }
+            k_sleep(K_TICKS(1));
+        }
+        else if (!push_next()) {
+            k_busy_wait(IDLE_US);
+        }
+    }
+}
+
+/// p1: drains the queue every tick if nonzero, else spins
+static void consumer_func(void *p1, void *p2, void *p3)
+{
+    const bool is_periodic = POINTER_TO_UINT(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    Item item;
+    while (k_uptime_ticks() < s_stop_ticks) {
+        if (is_periodic) {
+            if (atomic_get(&s_low_copying)) s_preempted_copies++;
+            while (s_queue.pop(item)) {
+                check_popped(item);
+            }
+            k_sleep(K_TICKS(1));
+        }
+        else if (s_queue.pop(item)) {
+            check_popped(item);
+        }
+        else {
+            k_busy_wait(IDLE_US);
+        }
+    }
+}
+
+/// runs producer & consumer for RUN_TICKS, then drains the queue & checks what went through it
+static void run_contention(bool is_producer_periodic)
+{
+    Item item;
+    while (s_queue.pop(item)) {
+    }
+    const uint32_t overflows = s_queue.get_overflow_count();
+    atomic_set(&s_low_copying, 0);
+    s_pushes = 0;
+    s_full_pushes = 0;
+    s_pops = 0;
+    s_last_popped = 0;
+    s_torn_pops = 0;
+    s_misordered_pops = 0;
+    s_preempted_copies = 0;
+
+    // the periodic thread preempts the spinning one
+    s_low_thread = is_producer_periodic ? &s_consumer_thread : &s_producer_thread;
+    s_copy_us = k_ticks_to_us_floor32(COPY_TICKS);
+    s_stop_ticks = k_uptime_ticks() + RUN_TICKS;
+    k_thread_create(&s_producer_thread, s_producer_stack, K_THREAD_STACK_SIZEOF(s_producer_stack),
+                    producer_func, UINT_TO_POINTER(is_producer_periodic), NULL, NULL,
+                    is_producer_periodic ? HIGH_PRIO : LOW_PRIO, 0, K_NO_WAIT);
+    k_thread_create(&s_consumer_thread, s_consumer_stack, K_THREAD_STACK_SIZEOF(s_consumer_stack),
+                    consumer_func, UINT_TO_POINTER(!is_producer_periodic), NULL, NULL,
+                    is_producer_periodic ? LOW_PRIO : HIGH_PRIO, 0, K_NO_WAIT);
+    k_thread_join(&s_producer_thread, K_FOREVER);
+    k_thread_join(&s_consumer_thread, K_FOREVER);
+
+    // the consumer has stopped, so this thread takes over its side
+    while (s_queue.pop(item)) {
+        check_popped(item);
+    }
+
+    zassert_true(s_pushes > 1, "%u pushes", s_pushes);
+    zassert_true(s_preempted_copies > 0, "never preempted a copy, contention not exercised");
+    zassert_equal(s_torn_pops, 0, "%u torn items", s_torn_pops);
+    zassert_equal(s_misordered_pops, 0, "%u items lost or out of order", s_misordered_pops);
+    zassert_equal(s_pops, s_pushes, "%u of %u items popped", s_pops, s_pushes);
+    const uint32_t new_overflows = s_queue.get_overflow_count() - overflows;
+    zassert_equal(new_overflows, s_full_pushes, "%u overflows counted for %u full pushes",
+                  new_overflows, s_full_pushes);
+}
+
+static void test_order_wraparound(void)
+{
+    SpscQueue<uint32_t, 4> queue;
+    uint32_t item;
+
+    zassert_false(queue.pop(item), "popped from an empty queue");
+    zassert_false(queue.peek(item), "peeked into an empty queue");
+    // head & tail wrap around the 4 slots many times over, at every fill level
+    uint32_t pushed = 0;
+    uint32_t popped = 0;
+    for (uint32_t round = 0; round < 10; round++) {
+        const uint32_t fill = (round % 3) + 1;
+        for (uint32_t i = 0; i < fill; i++) {
+            zassert_true(queue.push(++pushed), "push %u failed", pushed);
+        }
+        zassert_equal(queue.size(), fill, "size %u, %u queued", (uint32_t)queue.size(), fill);
+        zassert_true(queue.peek(item), "peek failed");
+        zassert_equal(item, popped + 1, "peeked %u, not the oldest", item);
+        for (uint32_t i = 0; i < fill; i++) {
+            zassert_true(queue.pop(item), "pop failed");
+            zassert_equal(item, ++popped, "popped %u, expected %u", item, popped);
+        }
+        zassert_equal(queue.size(), 0, "size %u when empty", (uint32_t)queue.size());
+    }
+    zassert_equal(queue.get_overflow_count(), 0, "overflows without a full queue");
+}
+
+static void test_overflow(void)
+{
+    SpscQueue<uint32_t, 4> queue;
+    uint32_t item;
+
+    // holds N - 1 items; pushing more drops the new item
+    for (uint32_t i = 1; i <= 3; i++) {
+        zassert_true(queue.push(i), "push %u failed", i);
+    }
+    zassert_false(queue.push(4), "pushed to a full queue");
+    zassert_false(queue.push(5), "pushed to a full queue");
+    zassert_equal(queue.get_overflow_count(), 2, "%u overflows", queue.get_overflow_count());
+    zassert_equal(queue.size(), 3, "size %u when full", (uint32_t)queue.size());
+
+    // a pop frees one slot
+    zassert_true(queue.pop(item) && (1 == item), "lost the oldest item");
+    zassert_true(queue.push(6), "push after pop failed");
+    const uint32_t expected[] = {2, 3, 6};
+    for (uint32_t value : expected) {
+        zassert_true(queue.pop(item), "pop failed");
+        zassert_equal(item, value, "popped %u, expected %u", item, value);
+    }
+    zassert_equal(queue.get_overflow_count(), 2, "%u overflows", queue.get_overflow_count());
+}
+
+static void test_producer_preempts_consumer(void)
+{
+    // bursts land in the middle of pops, and overflow the queue
+    run_contention(true);
+    zassert_true(s_full_pushes > 0, "queue never full");
+}
+
+static void test_consumer_preempts_producer(void)
+{
+    // drains land in the middle of pushes
+    run_contention(false);
+}
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(spsc_queue, ztest_unit_test(test_order_wraparound),
+                     ztest_unit_test(test_overflow),
+                     ztest_unit_test(test_producer_preempts_consumer),
+                     ztest_unit_test(test_consumer_preempts_producer));
+    ztest_run_test_suite(spsc_queue);
+}
@@ -0,0 +1,162 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	SyncedVar tests -- locks exclude each other under contention
+ *
+ * The low priority thread busy waits while holding the lock, so the periodic high priority thread
+ * wakes on a tick in the middle of it and has to wait for the lock.
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+#include "synced_var.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr size_t STACK_SIZE = 1024;
+static constexpr int HIGH_PRIO = 5;
+static constexpr int LOW_PRIO = 6;
+static constexpr uint32_t HOLD_US = 100;
+static constexpr int32_t RUN_MS = 500;
+
+// types
+/// Two halves that always match when written
+struct Sample {
+    uint32_t first;
+    uint32_t second;
+};
+
+// private variables
+static k_thread s_high_thread;
+static k_thread s_low_thread;
+K_THREAD_STACK_DEFINE(s_high_stack, STACK_SIZE);
+K_THREAD_STACK_DEFINE(s_low_stack, STACK_SIZE);
+// uptime at which the threads stop themselves (whatever the test thread's priority)
+static int64_t s_stop_ms;
+
+static SyncedVar<Sample> s_var;
+static atomic_t s_low_holds_lock;
+static volatile uint32_t s_low_updates;
+static volatile uint32_t s_high_updates;
+static volatile uint32_t s_contended;  // high found low holding the lock
+static volatile uint32_t s_violations; // high got the lock while low held it
+static volatile uint32_t s_torn_reads;
+
+// private function definitions
+/// increments both halves under the write lock, slowly
+static void low_writer_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (k_uptime_get() < s_stop_ms) {
+        WriteLock<Sample> write_lock = s_var.get_write_lock();
+        atomic_set(&s_low_holds_lock, 1);
+        Sample &sample = write_lock.get_ref();
+        sample.first++;
+        k_busy_wait(HOLD_US);
+        sample.second++;
+        s_low_updates++;
+        atomic_set(&s_low_holds_lock, 0);
+    }
+}
+
+/// increments both halves under the write lock every tick
+static void high_writer_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (k_uptime_get() < s_stop_ms) {
+        if (atomic_get(&s_low_holds_lock)) s_contended++;
+        {
+            WriteLock<Sample> write_lock = s_var.get_write_lock();
+            if (atomic_get(&s_low_holds_lock)) s_violations++;
+            Sample &sample = write_lock.get_ref();
+            sample.first++;
+            sample.second++;
+            s_high_updates++;
+        }
+        k_sleep(K_TICKS(1));
+    }
+}
+
+/// checks both halves under the read lock every tick
+static void high_reader_func(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (k_uptime_get() < s_stop_ms) {
+        if (atomic_get(&s_low_holds_lock)) s_contended++;
+        {
+            ReadLock<Sample> read_lock = s_var.get_read_lock();
+            if (atomic_get(&s_low_holds_lock)) s_violations++;
+            if (read_lock.get_var().first != read_lock.get_var().second) s_torn_reads++;
+        }
+        k_sleep(K_TICKS(1));
+    }
+}
+
+/// runs the low priority writer against a high priority thread for RUN_MS
+static void run_contention(k_thread_entry_t high_func)
+{
+    {
+        WriteLock<Sample> write_lock = s_var.get_write_lock();
+        write_lock.set_var(Sample{0, 0});
+    }
+    atomic_set(&s_low_holds_lock, 0);
+    s_low_updates = 0;
+    s_high_updates = 0;
+    s_contended = 0;
+    s_violations = 0;
+    s_torn_reads = 0;
+
+    s_stop_ms = k_uptime_get() + RUN_MS;
+    k_thread_create(&s_low_thread, s_low_stack, K_THREAD_STACK_SIZEOF(s_low_stack),
+                    low_writer_func, NULL, NULL, NULL, LOW_PRIO, 0, K_NO_WAIT);
+    k_thread_create(&s_high_thread, s_high_stack, K_THREAD_STACK_SIZEOF(s_high_stack), high_func,
+                    NULL, NULL, NULL, HIGH_PRIO, 0, K_NO_WAIT);
+    k_thread_join(&s_high_thread, K_FOREVER);
+    k_thread_join(&s_low_thread, K_FOREVER);
+
+    zassert_true(s_low_updates > 1, "%u low priority updates", s_low_updates);
+    zassert_true(s_contended > 0, "lock never contended");
+    zassert_equal(s_violations, 0, "%u times both threads held the lock", s_violations);
+}
+
+static void test_write_locks_exclude(void)
+{
+    run_contention(high_writer_func);
+
+    // no increment lost to the other thread's
+    const Sample sample = s_var.get_read_lock().get_var();
+    zassert_true(s_high_updates > 1, "%u high priority updates", s_high_updates);
+    zassert_equal(sample.first, s_low_updates + s_high_updates, "%u of %u updates", sample.first,
+                  s_low_updates + s_high_updates);
+    zassert_equal(sample.second, sample.first, "halves differ");
+}
+
+static void test_read_lock_excludes_writer(void)
+{
+    run_contention(high_reader_func);
+
+    zassert_equal(s_torn_reads, 0, "%u torn reads", s_torn_reads);
+}
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(synced_var, ztest_unit_test(test_write_locks_exclude),
+                     ztest_unit_test(test_read_lock_excludes_writer));
+    ztest_run_test_suite(synced_var);
+}
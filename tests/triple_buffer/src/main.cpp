@@ -0,0 +1,193 @@
+/**
+ * @file	main.cpp
+ * @author	Andrew Loebs
+ * @brief	TripleBuffer tests -- the reader gets the newest complete frame under contention
+ *
+ * The spinning (lower priority) thread takes two ticks between the halves of each frame it fills
+ * or reads, so the periodic thread, woken every tick, lands in the middle of it.
+ *
+ *
+ */
+
+#include <ztest.h>
+
+#include <sys/atomic.h>
+#include <zephyr.h>
+
+#include "triple_buffer.hpp"
+
+using namespace z_quad_rotor;
+
+// constants
+static constexpr size_t STACK_SIZE = 1024;
+static constexpr int HIGH_PRIO = 5;
+static constexpr int LOW_PRIO = 6;
+static constexpr int32_t HALF_TICKS = 2;
+static constexpr int64_t RUN_TICKS = 100;
+
+// types
+/// Two halves that always match when published
+struct Frame {
+    uint32_t first;
+    uint32_t second;
+};
+
+// private variables
+static k_thread s_writer_thread;
+static k_thread s_reader_thread;
+K_THREAD_STACK_DEFINE(s_writer_stack, STACK_SIZE);
+K_THREAD_STACK_DEFINE(s_reader_stack, STACK_SIZE);
+// uptime at which the threads stop themselves (whatever the test thread's priority)
+static int64_t s_stop_ticks;
+static uint32_t s_half_us;
+static atomic_t s_low_in_frame; // the spinning thread is between the halves of a frame
+
+static TripleBuffer<Frame> s_buffer;
+static volatile uint32_t s_published; // frames published (numbered 1...)
+static volatile uint32_t s_reads;
+static volatile uint32_t s_torn_reads;
+static volatile uint32_t s_stale_reads;      // older than the newest published before the read
+static volatile uint32_t s_preempted_frames; // the periodic thread woke mid-frame
+
+// private function definitions
+/// fills & publishes the next frame; slow: waits between the halves
+static void write_next(bool is_slow)
+{
+    Frame &frame = s_buffer.get_write_slot();
+    frame.first = s_published + 1;
+    if (is_slow) {
+        atomic_set(&s_low_in_frame, 1);
+        k_busy_wait(s_half_us);
+        atomic_set(&s_low_in_frame, 0);
+    }
+    frame.second = s_published + 1;
+    s_buffer.publish();
+    s_published++;
+}
+
+/// reads & checks the newest frame; slow: waits between the halves
+static void read_newest(bool is_slow, uint32_t &last)
+{
+    const uint32_t newest = s_published;
+    const Frame &frame = s_buffer.get_read_slot();
+    const uint32_t first = frame.first;
+    if (is_slow) {
+        atomic_set(&s_low_in_frame, 1);
+        k_busy_wait(s_half_us);
+        atomic_set(&s_low_in_frame, 0);
+    }
+    if (first != frame.second) s_torn_reads++;
+    if ((first < newest) || (first < last)) s_stale_reads++;
+    last = first;
+    s_reads++;
+}
+
+/// p1: publishes a frame every tick if nonzero, else spins
+static void writer_func(void *p1, void *p2, void *p3)
+{
+    const bool is_periodic = POINTER_TO_UINT(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (k_uptime_ticks() < s_stop_ticks) {
+        if (is_periodic) {
+            if (atomic_get(&s_low_in_frame)) s_preempted_frames++;
+            write_next(false);
+            k_sleep(K_TICKS(1));
+        }
+        else {
+            write_next(true);
+        }
+    }
+}
+
+/// p1: reads a frame every tick if nonzero, else spins
+static void reader_func(void *p1, void *p2, void *p3)
+{
+    const bool is_periodic = POINTER_TO_UINT(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    uint32_t last = 0;
+    while (k_uptime_ticks() < s_stop_ticks) {
+        if (is_periodic) {
+            if (atomic_get(&s_low_in_frame)) s_preempted_frames++;
+            read_newest(false, last);
+            k_sleep(K_TICKS(1));
+        }
+        else {
+            read_newest(true, last);
+        }
+    }
+}
+
+/// runs writer & reader for RUN_TICKS
+static void run_contention(bool is_writer_periodic)
+{
+    // the previous run's frames are all older than this one's
+    s_buffer.get_write_slot() = Frame{0, 0};
+    s_buffer.publish();
+    (void)s_buffer.get_read_slot();
+    atomic_set(&s_low_in_frame, 0);
+    s_published = 0;
+    s_reads = 0;
+    s_torn_reads = 0;
+    s_stale_reads = 0;
+    s_preempted_frames = 0;
+
+    // the periodic thread preempts the spinning one
+    s_half_us = k_ticks_to_us_floor32(HALF_TICKS);
+    s_stop_ticks = k_uptime_ticks() + RUN_TICKS;
+    k_thread_create(&s_writer_thread, s_writer_stack, K_THREAD_STACK_SIZEOF(s_writer_stack),
+                    writer_func, UINT_TO_POINTER(is_writer_periodic), NULL, NULL,
+                    is_writer_periodic ? HIGH_PRIO : LOW_PRIO, 0, K_NO_WAIT);
+    k_thread_create(&s_reader_thread, s_reader_stack, K_THREAD_STACK_SIZEOF(s_reader_stack),
+                    reader_func, UINT_TO_POINTER(!is_writer_periodic), NULL, NULL,
+                    is_writer_periodic ? LOW_PRIO : HIGH_PRIO, 0, K_NO_WAIT);
+    k_thread_join(&s_writer_thread, K_FOREVER);
+    k_thread_join(&s_reader_thread, K_FOREVER);
+
+    zassert_true(s_published > 1, "%u frames published", s_published);
+    zassert_true(s_reads > 1, "%u reads", s_reads);
+    zassert_true(s_preempted_frames > 0, "never preempted a frame, contention not exercised");
+    zassert_equal(s_torn_reads, 0, "%u torn reads", s_torn_reads);
+    zassert_equal(s_stale_reads, 0, "%u reads missed a newer frame", s_stale_reads);
+    zassert_equal(s_buffer.get_read_slot().first, s_published, "last frame lost");
+}
+
+static void test_newest_frame(void)
+{
+    TripleBuffer<uint32_t> buffer;
+
+    // frames published between reads are skipped; rereads keep the same frame
+    for (uint32_t i = 1; i <= 3; i++) {
+        buffer.get_write_slot() = i;
+        buffer.publish();
+    }
+    zassert_equal(buffer.get_read_slot(), 3, "read %u, not the newest", buffer.get_read_slot());
+    zassert_equal(buffer.get_read_slot(), 3, "reread %u", buffer.get_read_slot());
+    buffer.get_write_slot() = 4;
+    buffer.publish();
+    zassert_equal(buffer.get_read_slot(), 4, "read %u after publish", buffer.get_read_slot());
+}
+
+static void test_writer_preempts_reader(void)
+{
+    // frames are published in the middle of reads, into the other two slots
+    run_contention(true);
+}
+
+static void test_reader_preempts_writer(void)
+{
+    // reads land in the middle of fills, and get the last published frame
+    run_contention(false);
+}
+
+// public function definitions
+void test_main(void)
+{
+    ztest_test_suite(triple_buffer, ztest_unit_test(test_newest_frame),
+                     ztest_unit_test(test_writer_preempts_reader),
+                     ztest_unit_test(test_reader_preempts_writer));
+    ztest_run_test_suite(triple_buffer);
+}
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Decodes a z_quad_rotor blackbox log dump (see src/blackbox.hpp) to CSV.
+
+Takes a capture of the `zqr blackbox dump` shell output -- "chunk <index> <length>" lines, each
+followed by the chunk as hex lines -- and writes one CSV row per logged sample. Other shell output
+in the capture is ignored. Each chunk decodes on its own, so a truncated capture only loses its
+last chunk.
+
+    zqr> zqr blackbox dump          # capture the output, e.g. with the terminal's log function
+    tools/blackbox.py capture.txt > flight.csv
+"""
+
+import argparse
+import csv
+import re
+import sys
+
+RECORD_KEY = 0x01
+RECORD_PRESSURE = 0x02
+MARG_CHANNELS = 9
+CHANNELS = (
+    ("ax", 1), ("ay", 1), ("az", 1), ("gx", 1), ("gy", 1), ("gz", 1), ("mx", 1), ("my", 1),
+    ("mz", 1),
+    ("qx", 16384), ("qy", 16384), ("qz", 16384), ("qw", 16384),
+    ("rate_sp_x", 1000), ("rate_sp_y", 1000), ("rate_sp_z", 1000),
+    ("torque_x", 16384), ("torque_y", 16384), ("torque_z", 16384),
+)  # name, scale (as in src/blackbox.cpp)
+FIELDS = ("timestamp_us",) + tuple(name for name, _ in CHANNELS) + ("pressure_pa",)
+CHUNK_LINE = re.compile(r"chunk (\d+) (\d+)")
+HEX_LINE = re.compile(r"[0-9a-f]+")
+
+
+class ChunkError(Exception):
+    pass
+
+
+def read_varint(data, pos):
+    """LEB128; returns (value, next position)"""
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data) or shift > 28:
+            raise ChunkError("truncated varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def read_zigzag(data, pos):
+    value, pos = read_varint(data, pos)
+    return (value >> 1) ^ -(value & 1), pos
+
+
+def decode_chunk(data):
+    """Returns the chunk's samples as dicts, undoing the encoder's predictors"""
+    samples = []
+    prev = [0] * len(CHANNELS)
+    prev2 = [0] * len(CHANNELS)
+    timestamp_us = 0
+    pressure_pa = 0
+    pos = 0
+    while pos < len(data):
+        flags = data[pos]
+        pos += 1
+        key = bool(flags & RECORD_KEY)
+        if not samples and not key:
+            raise ChunkError("chunk doesn't start with a key record")
+        delta, pos = read_varint(data, pos)
+        timestamp_us = delta if key else (timestamp_us + delta) & 0xFFFFFFFF
+
+        sample = {"timestamp_us": timestamp_us}
+        for i, (name, scale) in enumerate(CHANNELS):
+            error, pos = read_zigzag(data, pos)
+            predicted = 0
+            if not key:
+                predicted = prev[i] if i < MARG_CHANNELS else (2 * prev[i]) - prev2[i]
+            value = predicted + error
+            prev2[i] = value if key else prev[i]
+            prev[i] = value
+            sample[name] = value if scale == 1 else value / scale
+
+        if key:
+            pressure_pa = 0
+        sample["pressure_pa"] = ""
+        if flags & RECORD_PRESSURE:
+            error, pos = read_zigzag(data, pos)
+            pressure_pa += error
+            sample["pressure_pa"] = pressure_pa
+        samples.append(sample)
+    return samples
+
+
+def read_chunks(lines):
+    """Yields (index, bytes) for each complete chunk in the dump"""
+    index = None
+    length = 0
+    data = bytearray()
+    for line in lines:
+        line = line.strip()
+        match = CHUNK_LINE.search(line)
+        if match:
+            if index is not None and len(data) == length:
+                yield index, bytes(data)
+            index, length = int(match.group(1)), int(match.group(2))
+            data = bytearray()
+        elif index is not None and HEX_LINE.fullmatch(line) and len(line) % 2 == 0:
+            data += bytes.fromhex(line)
+    if index is not None and len(data) == length:
+        yield index, bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="capture of the `zqr blackbox dump` output")
+    args = parser.parse_args()
+
+    writer = csv.DictWriter(sys.stdout, fieldnames=FIELDS)
+    writer.writeheader()
+    chunks = 0
+    samples = 0
+    encoded_bytes = 0
+    with open(args.input, errors="replace") as capture:
+        for index, data in read_chunks(capture):
+            try:
+                rows = decode_chunk(data)
+            except ChunkError as err:
+                print(f"chunk {index}: {err}; skipped", file=sys.stderr)
+                continue
+            writer.writerows(rows)
+            chunks += 1
+            samples += len(rows)
+            encoded_bytes += len(data)
+    print(f"{chunks} chunks, {samples} samples, {encoded_bytes} bytes", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""Assembles a z_quad_rotor CTF capture into a trace directory (see tracing.conf).
+
+The directory gets zephyr's CTF metadata with the application's events (tools/ctf/zqr.tsdl)
+appended, and the capture as its stream. Open it in TraceCompass (File > Open Trace, select the
+metadata file) or print it with babeltrace.
+
+    $ZEPHYR_BASE/scripts/tracing/trace_capture_usb.py -v 0x2FE3 -p 0x0100 -o capture.bin
+    tools/ctf_trace.py capture.bin trace/
+    babeltrace trace/ | grep zqr_
+"""
+
+import argparse
+import os
+import shutil
+import sys
+
+APP_METADATA = os.path.join(os.path.dirname(os.path.abspath(__file__)), "ctf", "zqr.tsdl")
+ZEPHYR_METADATA = os.path.join("subsys", "tracing", "ctf", "tsdl", "metadata")
+STREAM_NAME = "channel0_0"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", help="raw CTF stream (usb, ram or native_posix capture)")
+    parser.add_argument("output", help="trace directory to create")
+    parser.add_argument(
+        "--zephyr-base",
+        default=os.environ.get("ZEPHYR_BASE"),
+        help="zephyr tree the firmware was built from (default: $ZEPHYR_BASE)",
+    )
+    args = parser.parse_args()
+
+    if not args.zephyr_base:
+        sys.exit("Zephyr tree unknown: set ZEPHYR_BASE or pass --zephyr-base")
+    os.makedirs(args.output, exist_ok=True)
+    with open(os.path.join(args.output, "metadata"), "w") as metadata:
+        for path in (os.path.join(args.zephyr_base, ZEPHYR_METADATA), APP_METADATA):
+            with open(path) as part:
+                metadata.write(part.read())
+            metadata.write("\n")
+    shutil.copyfile(args.capture, os.path.join(args.output, STREAM_NAME))
+    size = os.path.getsize(args.capture)
+    print(f"{args.output}: {size} bytes of events", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Runs the z_quad_rotor benchmarks on a native_posix build (see boards/native_posix.conf).
+
+Feeds zqr bench commands to the shell on zephyr.exe's stdin, echoes the output, and exits nonzero
+if a benchmark reports FAIL or doesn't run. On native_posix, benchmarks time the host (nanosecond
+"cycles", see src/cycle_counter.hpp), so this runs on any Linux box, e.g. in CI:
+
+    west build -b native_posix
+    tools/native_bench.py build/zephyr/zephyr.exe
+    tools/native_bench.py build/zephyr/zephyr.exe fusion orientation
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+BENCHES = (
+    "altitude",
+    "controller",
+    "convert",
+    "eskf",
+    "fastmath",
+    "fusion",
+    "madgwick9",
+    "mixer",
+    "orientation",
+    "seqlock",
+)
+STOP_AT_S = 60  # simulated seconds; seqlock needs ~2
+PERF_HEADER = re.compile(r"stage\s+n\s+min")  # zqr perf, run last
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("exe", help="native_posix build (build/zephyr/zephyr.exe)")
+    parser.add_argument("benches", nargs="*", default=BENCHES, help="default: all")
+    parser.add_argument("--timeout", type=float, default=600, help="host seconds (default: 600)")
+    args = parser.parse_args()
+
+    commands = "".join(f"zqr bench {bench}\n" for bench in args.benches) + "zqr perf\n"
+    # -no-rt: simulated time runs as fast as the host allows
+    result = subprocess.run(
+        [args.exe, "-no-rt", f"-stop_at={STOP_AT_S}"],
+        input=commands,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT,
+        universal_newlines=True,
+        timeout=args.timeout,
+    )
+    sys.stdout.write(result.stdout)
+
+    failures = [line for line in result.stdout.splitlines() if "FAIL" in line]
+    if not PERF_HEADER.search(result.stdout):
+        failures.append(f"benchmarks didn't finish within {STOP_AT_S} simulated seconds")
+    for failure in failures:
+        print(f"native_bench: {failure}", file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Replays recorded flights through the z_quad_rotor estimators on a native_posix build.
+
+Recordings (see src/replay.hpp) are made from blackbox logs decoded by tools/blackbox.py; each
+logged fusion step's raw MARG counts & pressure sample become one record. `zqr replay` on
+zephyr.exe runs them through Orientation & Altitude as fast as the host allows and writes the
+estimated trajectory as CSV; this prints its throughput, and with --reference compares the
+trajectory to a previous one (or to the quaternions logged on board), exiting nonzero past the
+tolerances -- a regression check for fusion changes:
+
+    tools/blackbox.py capture.txt > flight.csv
+    tools/replay.py record flight.csv flight.zqrr --repeat 100    # ~millions of samples
+    west build -b native_posix
+    tools/replay.py run build/zephyr/zephyr.exe flight.zqrr -o baseline.csv
+    tools/replay.py run build/zephyr/zephyr.exe flight.zqrr -o new.csv --reference baseline.csv
+"""
+
+import argparse
+import csv
+import math
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+MAGIC = b"ZQRR"
+VERSION = 1
+HEADER = struct.Struct("<4sI3f")  # magic, version, accel/gyro/magn scale
+RECORD = struct.Struct("<I9hi")  # timestamp_us, accel/gyro/magn counts, pressure_pa (0: none)
+MARG_FIELDS = ("ax", "ay", "az", "gx", "gy", "gz", "mx", "my", "mz")  # tools/blackbox.py columns
+QUAT_FIELDS = ("qw", "qx", "qy", "qz")
+
+# the board's sensor ranges (boards/adafruit_feather_nrf52840.conf): +/-2 g accel
+# (CONFIG_FXOS8700_RANGE_2G), 0.1 uT magn, 250 dps gyro (CONFIG_FXAS21002_RANGE=3)
+ACCEL_SCALE = 9.80665 / 4096
+GYRO_SCALE = 1091e-6 / 8
+MAGN_SCALE = 0.001
+
+STOP_AT_S = 1  # simulated seconds; a replay takes none
+SUMMARY_LINE = re.compile(r"(\d+) ns/step, (\d+) samples/s")
+
+
+def record(args):
+    """Converts a decoded blackbox log to a recording, repeated end to end"""
+    with open(args.input, newline="") as log:
+        rows = [
+            (int(row["timestamp_us"]), [int(row[field]) for field in MARG_FIELDS],
+             int(row["pressure_pa"] or 0))
+            for row in csv.DictReader(log)
+        ]
+    if len(rows) < 2:
+        sys.exit(f"replay: {args.input} has too few samples")
+
+    # repeats continue the timeline at the log's mean step
+    span_us = (rows[-1][0] - rows[0][0]) & 0xFFFFFFFF
+    period_us = span_us + (span_us // (len(rows) - 1))
+    with open(args.output, "wb") as out:
+        out.write(HEADER.pack(MAGIC, VERSION, args.accel_scale, args.gyro_scale, args.magn_scale))
+        for repeat in range(args.repeat):
+            offset = repeat * period_us
+            for timestamp_us, marg, pressure_pa in rows:
+                out.write(RECORD.pack((timestamp_us + offset) & 0xFFFFFFFF, *marg, pressure_pa))
+    print(f"{len(rows) * args.repeat} records ({len(rows)} x {args.repeat})", file=sys.stderr)
+
+
+def angle_deg(a, b):
+    """angle between two orientations"""
+    dot = abs(sum(x * y for x, y in zip(a, b)))
+    norm = math.sqrt(sum(x * x for x in a) * sum(y * y for y in b))
+    return math.degrees(2 * math.acos(min(dot / norm, 1.0))) if norm else 180.0
+
+
+def compare(trajectory_path, reference_path):
+    """Returns (steps compared, max angle error, max altitude error or None)"""
+    with open(trajectory_path, newline="") as trajectory, \
+            open(reference_path, newline="") as reference:
+        estimates = csv.DictReader(trajectory)
+        references = csv.DictReader(reference)
+        has_altitude = "altitude_m" in (references.fieldnames or ())
+        # align on the first estimate (a replay has no step for its first record)
+        first = next(estimates, None)
+        ref = next(references, None)
+        while first and ref and ref["timestamp_us"] != first["timestamp_us"]:
+            ref = next(references, None)
+        if not first or not ref:
+            return 0, 0.0, None
+
+        steps = 0
+        max_angle = 0.0
+        max_altitude = 0.0 if has_altitude else None
+        estimate = first
+        while estimate and ref:
+            max_angle = max(max_angle, angle_deg([float(estimate[f]) for f in QUAT_FIELDS],
+                                                 [float(ref[f]) for f in QUAT_FIELDS]))
+            if has_altitude:
+                error = abs(float(estimate["altitude_m"]) - float(ref["altitude_m"]))
+                max_altitude = max(max_altitude, error)
+            steps += 1
+            estimate = next(estimates, None)
+            ref = next(references, None)
+    return steps, max_angle, max_altitude
+
+
+def run(args):
+    """Replays a recording on zephyr.exe, then checks the trajectory against a reference"""
+    output = args.output
+    if not output:
+        handle, output = tempfile.mkstemp(suffix=".csv")
+        os.close(handle)
+    command = f"zqr replay {os.path.abspath(args.recording)} {os.path.abspath(output)}"
+    result = subprocess.run(
+        [args.exe, "-no-rt", f"-stop_at={STOP_AT_S}"],
+        input=f"{command} {args.fusion}\n",
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT,
+        universal_newlines=True,
+        timeout=args.timeout,
+    )
+    summary = [line for line in result.stdout.splitlines() if "replay:" in line or
+               SUMMARY_LINE.search(line)]
+    print("\n".join(summary) if summary else result.stdout)
+    failures = []
+    if not SUMMARY_LINE.search(result.stdout):
+        failures.append("replay didn't finish")
+    elif args.reference:
+        steps, max_angle, max_altitude = compare(output, args.reference)
+        altitude = f", altitude {max_altitude:.3f} m" if max_altitude is not None else ""
+        print(f"vs {args.reference}: {steps} steps, max error {max_angle:.4f} deg{altitude}")
+        if not steps:
+            failures.append("no steps in common with the reference")
+        if max_angle > args.max_angle_deg:
+            failures.append(f"angle error over {args.max_angle_deg} deg")
+        if max_altitude is not None and max_altitude > args.max_altitude_m:
+            failures.append(f"altitude error over {args.max_altitude_m} m")
+    if not args.output:
+        os.remove(output)
+
+    for failure in failures:
+        print(f"replay: FAIL {failure}", file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    parser_record = subparsers.add_parser("record", help="make a recording from a blackbox CSV")
+    parser_record.add_argument("input", help="tools/blackbox.py output")
+    parser_record.add_argument("output", help="recording")
+    parser_record.add_argument("--repeat", type=int, default=1, help="times to repeat the log")
+    parser_record.add_argument("--accel-scale", type=float, default=ACCEL_SCALE,
+                               help="(m/s^2)/count")
+    parser_record.add_argument("--gyro-scale", type=float, default=GYRO_SCALE, help="(rad/s)/count")
+    parser_record.add_argument("--magn-scale", type=float, default=MAGN_SCALE, help="gauss/count")
+    parser_record.set_defaults(func=record)
+
+    parser_run = subparsers.add_parser("run", help="replay a recording on zephyr.exe")
+    parser_run.add_argument("exe", help="native_posix build (build/zephyr/zephyr.exe)")
+    parser_run.add_argument("recording")
+    parser_run.add_argument("-o", "--output", help="trajectory CSV (default: discarded)")
+    parser_run.add_argument("--fusion", choices=("madgwick6", "madgwick9"), default="madgwick6")
+    parser_run.add_argument("--reference", help="trajectory or blackbox CSV to compare against")
+    parser_run.add_argument("--max-angle-deg", type=float, default=0.1)
+    parser_run.add_argument("--max-altitude-m", type=float, default=0.05)
+    parser_run.add_argument("--timeout", type=float, default=3600, help="host seconds")
+    parser_run.set_defaults(func=run)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
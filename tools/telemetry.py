@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Decodes the z_quad_rotor binary telemetry stream (see src/telemetry.hpp).
+
+Reads the telemetry CDC ACM port (e.g. /dev/ttyACM1 -- the shell is on the first port) or a
+capture of it, and writes one CSV row per valid frame. Packets failing the CRC are skipped (the
+parser resyncs on the next 'ZQ'), and sequence gaps are counted as dropped frames.
+
+    tools/telemetry.py /dev/ttyACM1 > flight.csv
+    zqr> zqr telemetry 4            # one frame every 4 control loops
+"""
+
+import argparse
+import csv
+import os
+import struct
+import sys
+import termios
+import tty
+
+SYNC = b"ZQ"
+VERSION = 1
+HEADER = struct.Struct("<2sBB")  # sync, version, payload length
+FRAME = struct.Struct("<I6f9h3H2BH")
+CRC = struct.Struct("<H")
+FIELDS = (
+    "timestamp_us",
+    "qx", "qy", "qz", "qw",
+    "altitude", "climb_rate",
+    "ax", "ay", "az", "gx", "gy", "gz", "mx", "my", "mz",
+    "loop_period_us", "latency_us", "sequence", "step_count", "flags",
+)
+READ_SIZE = 4096
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), as in src/telemetry.cpp"""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+class Decoder:
+    """Incremental packet parser; feed() returns the frames completed by new bytes"""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.frames = 0
+        self.crc_errors = 0
+        self.dropped = 0
+        self.last_sequence = None
+
+    def feed(self, data):
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                # keep a trailing sync byte that may start the next packet
+                del self.buffer[: max(len(self.buffer) - 1, 0)]
+                return frames
+            del self.buffer[:start]
+            if len(self.buffer) < HEADER.size:
+                return frames
+            _, version, length = HEADER.unpack_from(self.buffer)
+            if version != VERSION or length != FRAME.size:
+                del self.buffer[:1]
+                continue
+            packet_size = HEADER.size + length + CRC.size
+            if len(self.buffer) < packet_size:
+                return frames
+            (crc,) = CRC.unpack_from(self.buffer, HEADER.size + length)
+            if crc != crc16(self.buffer[2 : HEADER.size + length]):
+                self.crc_errors += 1
+                del self.buffer[:1]
+                continue
+            values = FRAME.unpack_from(self.buffer, HEADER.size)[:-1]  # drop reserved
+            frame = dict(zip(FIELDS, values))
+            del self.buffer[:packet_size]
+            self.count(frame["sequence"])
+            frames.append(frame)
+
+    def count(self, sequence):
+        if self.last_sequence is not None:
+            self.dropped += (sequence - self.last_sequence - 1) & 0xFFFF
+        self.last_sequence = sequence
+        self.frames += 1
+
+
+def open_input(path):
+    """Opens a capture file, or a tty in raw mode (opening it raises DTR, which starts the stream)"""
+    fd = os.open(path, os.O_RDONLY | os.O_NOCTTY)
+    if os.isatty(fd):
+        tty.setraw(fd, termios.TCSANOW)
+    return fd
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="telemetry port (e.g. /dev/ttyACM1) or capture file")
+    parser.add_argument("--raw", metavar="FILE", help="also save the raw stream to FILE")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    fd = open_input(args.input)
+    raw = open(args.raw, "wb") if args.raw else None
+    writer = csv.DictWriter(sys.stdout, fieldnames=FIELDS)
+    writer.writeheader()
+    try:
+        while True:
+            data = os.read(fd, READ_SIZE)
+            if not data:
+                break
+            if raw:
+                raw.write(data)
+            writer.writerows(decoder.feed(data))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+        if raw:
+            raw.close()
+        print(
+            f"{decoder.frames} frames, {decoder.dropped} dropped, {decoder.crc_errors} crc errors",
+            file=sys.stderr,
+        )
+
+
+if __name__ == "__main__":
+    main()